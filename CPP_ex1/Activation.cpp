@@ -2,51 +2,178 @@
 // Created by Guy on 12/23/2019.
 //
 
+#include <algorithm>
 #include "Activation.h"
-#include "math.h"
+#include "Kernels.h"
+
+namespace
+{
+/**
+ * maxes[j] = max of the column j0 + j of m, for j < width, and classes[j] its first row if
+ * classes isn't nullptr.
+ */
+void columnMaxes(const Matrix &m, int j0, int width, float maxes[], unsigned int classes[])
+{
+    const float *first = &m(0, j0);
+    std::copy(first, first + width, maxes);
+    if (classes != nullptr)
+    {
+        std::fill(classes, classes + width, 0);
+    }
+    for (int i = 1; i < m.getRows(); i++)
+    {
+        const float *row = &m(i, j0);
+        for (int j = 0; j < width; j++)
+        {
+            if (row[j] > maxes[j])
+            {
+                maxes[j] = row[j];
+                if (classes != nullptr)
+                {
+                    classes[j] = i;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * out = exp(m - the column's max) over the columns [j0, j0 + width), and sums[j] = sum of
+ * the column j0 + j of out. out may be m.
+ * @param negMaxes the columns' maxes, negated
+ */
+void columnExp(const Matrix &m, Matrix &out, int j0, int width, const float negMaxes[],
+               float sums[])
+{
+    const Kernels &k = kernels();
+    std::fill(sums, sums + width, 0.0f);
+    for (int i = 0; i < m.getRows(); i++)
+    {
+        float *row = &out(i, j0);
+        k.add(&m(i, j0), negMaxes, row, width);
+        k.exp(row, row, width);
+        k.add(sums, row, sums, width);
+    }
+}
+}
+
 Activation::Activation(ActivationType actType)
 : type(actType){}
 
-Matrix Activation::activateRelu(const Matrix &m) const
+ActivationType Activation::getType() const
 {
-    Matrix res(m);
-    for (int i = 0; i < m.getRows(); i++)
+    return type;
+}
+
+void Activation::activateRelu(const Matrix &m, Matrix &out) const
+{
+    kernels().relu(m.getData(), out.getData(), m.getRows() * m.getCols());
+}
+
+void Activation::activateSoftmax(const Matrix &m, Matrix &out) const
+{
+    // every column of m is a separate sample, shifted by its max: exp(x - max) is at most 1,
+    // so large logits can't overflow the exp, and the shift cancels out in the normalization.
+    const Kernels &k = kernels();
+    int rows = m.getRows();
+    int cols = m.getCols();
+    if (cols == 1)
     {
-        for (int j = 0; j < m.getCols(); j++)
+        float sum = k.expSum(m.getData(), k.max(m.getData(), rows), out.getData(), rows);
+        k.scale(out.getData(), 1 / sum, out.getData(), rows);
+        return;
+    }
+
+    // the columns are strided, so a block of them is done a row at a time: every loop runs
+    // along a contiguous row segment, and the segments go through the vector exp whole.
+    float maxes[SOFTMAX_BLOCK];
+    float sums[SOFTMAX_BLOCK];
+    for (int j0 = 0; j0 < cols; j0 += SOFTMAX_BLOCK)
+    {
+        int width = std::min(SOFTMAX_BLOCK, cols - j0);
+        columnMaxes(m, j0, width, maxes, nullptr);
+        k.scale(maxes, -1, maxes, width);
+        columnExp(m, out, j0, width, maxes, sums);
+        for (int j = 0; j < width; j++)
         {
-            if (res(i,j) < 0)
+            sums[j] = 1 / sums[j];
+        }
+        for (int i = 0; i < rows; i++)
+        {
+            float *row = &out(i, j0);
+            for (int j = 0; j < width; j++)
             {
-                res(i,j) = 0;
+                row[j] *= sums[j];
             }
         }
     }
-    return res;
 }
 
-Matrix Activation::activateSoftmax(const Matrix &m) const
+Digit Activation::softmaxDigit(float *logits, int n)
 {
-    //assuming m is a vector! todo: check it.
-    Matrix res(m);
-    float sum = 0;
-    for (int i = 0; i < m.getRows(), i++)
+    const Kernels &k = kernels();
+    float max = k.max(logits, n);
+    Digit digit = {0, 0};
+    for (int i = 0; i < n; i++)
     {
-        float expm = std::exp(m[i]);
-        res[i] = expm;
-        sum += expm;
+        if (logits[i] == max)
+        {
+            digit.value = i;
+            break;
+        }
     }
+    // exp(max - max) == 1 is the numerator of the max's probability.
+    digit.probability = 1 / k.expSum(logits, max, logits, n);
+    return digit;
+}
 
-    return  (1/sum) * res;
+void Activation::softmaxDigits(Matrix &logits, Digit results[])
+{
+    const Kernels &k = kernels();
+    int cols = logits.getCols();
+    if (cols == 1)
+    {
+        results[0] = softmaxDigit(logits.getData(), logits.getRows());
+        return;
+    }
+    float maxes[SOFTMAX_BLOCK];
+    float sums[SOFTMAX_BLOCK];
+    unsigned int classes[SOFTMAX_BLOCK];
+    for (int j0 = 0; j0 < cols; j0 += SOFTMAX_BLOCK)
+    {
+        int width = std::min(SOFTMAX_BLOCK, cols - j0);
+        columnMaxes(logits, j0, width, maxes, classes);
+        k.scale(maxes, -1, maxes, width);
+        columnExp(logits, logits, j0, width, maxes, sums);
+        for (int j = 0; j < width; j++)
+        {
+            results[j0 + j] = Digit{classes[j], 1 / sums[j]};
+        }
+    }
 }
 
-Matrix Activation::operator()(const Matrix &m) const
+void Activation::apply(Matrix &m) const
 {
     if (type == Relu)
     {
-        return activateRelu(m);
+        activateRelu(m, m);
     }
     else
     {
-        return activateSoftmax(m);
+        activateSoftmax(m, m);
     }
 }
 
+Matrix Activation::operator()(const Matrix &m) const
+{
+    Matrix res(m.getRows(), m.getCols());
+    if (type == Relu)
+    {
+        activateRelu(m, res);
+    }
+    else
+    {
+        activateSoftmax(m, res);
+    }
+    return res;
+}
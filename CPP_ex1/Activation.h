@@ -2,7 +2,12 @@
 #ifndef ACTIVATION_H
 #define ACTIVATION_H
 
+#include "Digit.h"
 #include "Matrix.h"
+
+// columns of a batch the softmax handles at once, with their maxes and sums on the stack.
+#define SOFTMAX_BLOCK 64
+
 /**
  * @enum ActivationType
  * @brief Indicator of activation function.
@@ -17,12 +22,35 @@ class Activation
 {
 private:
     ActivationType type;
-    Matrix activateRelu(const Matrix &m) const;
-    Matrix activateSoftmax(const Matrix &m) const;
+    /**
+     * out = activation(m), out must have m's dims and may be m itself.
+     */
+    void activateRelu(const Matrix &m, Matrix &out) const;
+    void activateSoftmax(const Matrix &m, Matrix &out) const;
 
 public:
     Activation(ActivationType actType);
+    ActivationType getType() const;
+    /**
+     * Applies the activation on m in place, softmax normalizes every column separately.
+     * The softmax subtracts the column's max before the exp, so any finite logits work.
+     */
+    void apply(Matrix &m) const;
     Matrix operator()(const Matrix &m) const;
+
+    /**
+     * The most probable class of a softmax and its probability, straight from the logits:
+     * the max logit is the class, and its probability 1 / sum(exp(logit - max)), so the
+     * softmax is never normalized. Ties go to the lowest class.
+     * @param logits n softmax inputs, overwritten by exp(logit - max)
+     */
+    static Digit softmaxDigit(float *logits, int n);
+
+    /**
+     * softmaxDigit of every column of logits.
+     * @param results array of logits.getCols() digits, results[j] is the j'th column's.
+     */
+    static void softmaxDigits(Matrix &logits, Digit results[]);
 };
 
 #endif //ACTIVATION_H
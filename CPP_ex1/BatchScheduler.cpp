@@ -0,0 +1,130 @@
+// BatchScheduler.cpp
+
+#include <algorithm>
+#include <cstdlib>
+#include "BatchScheduler.h"
+
+BatchScheduler::BatchScheduler(const ClassifyFunc &classify, int maxBatch,
+                               std::chrono::microseconds maxWait)
+: _classify(classify), _maxBatch(maxBatch > 0 ? maxBatch : 1), _maxWait(maxWait),
+  _queuedImages(0), _leading(false), _batches(0), _images(0){}
+
+void BatchScheduler::classify(const Matrix images[], int count, Digit results[])
+{
+    if (count <= 0)
+    {
+        return;
+    }
+    Request request{images, count, results, std::chrono::steady_clock::now(), false};
+    std::unique_lock<std::mutex> lock(_mutex);
+    _queue.push_back(&request);
+    _queuedImages += count;
+    _queued.notify_one();
+    while (!request.done)
+    {
+        if (_leading)
+        {
+            _done.wait(lock);
+        }
+        else
+        {
+            lead(lock); // may run the batch of older requests only, then loop
+        }
+    }
+}
+
+long BatchScheduler::getBatchCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _batches;
+}
+
+long BatchScheduler::getImageCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _images;
+}
+
+void BatchScheduler::lead(std::unique_lock<std::mutex> &lock)
+{
+    _leading = true;
+    // the batch starts full, or when its oldest request has waited enough. Checked first:
+    // even past its deadline, the wait releases and retakes the lock, which lets the woken
+    // requests in and costs a few context switches.
+    std::chrono::steady_clock::time_point deadline = _queue.front()->arrival + _maxWait;
+    if (_queuedImages < _maxBatch && std::chrono::steady_clock::now() < deadline)
+    {
+        _queued.wait_until(lock, deadline, [this]() { return _queuedImages >= _maxBatch; });
+    }
+    // always at least one request, however large.
+    _taken.clear();
+    int count = 0;
+    do
+    {
+        _taken.push_back(_queue.front());
+        count += _queue.front()->count;
+        _queue.pop_front();
+    } while (!_queue.empty() && count + _queue.front()->count <= _maxBatch);
+    _queuedImages -= count;
+    lock.unlock();
+
+    if (_taken.size() == 1)
+    {
+        _classify(_taken[0]->images, count, _taken[0]->results);
+    }
+    else
+    {
+        // the requests' images side by side, as views.
+        _batchImages.resize(count);
+        _batchResults.resize(count);
+        int j = 0;
+        for (Request *request : _taken)
+        {
+            for (int i = 0; i < request->count; i++)
+            {
+                const Matrix &img = request->images[i];
+                _batchImages[j++] = Matrix(img.getRows(), img.getCols(), img.getData());
+            }
+        }
+        _classify(_batchImages.data(), count, _batchResults.data());
+        j = 0;
+        for (Request *request : _taken)
+        {
+            std::copy(_batchResults.begin() + j, _batchResults.begin() + j + request->count,
+                      request->results);
+            j += request->count;
+        }
+    }
+
+    lock.lock();
+    for (Request *request : _taken)
+    {
+        request->done = true;
+    }
+    _batches++;
+    _images += count;
+    _leading = false;
+    _done.notify_all();
+}
+
+int defaultBatchMax()
+{
+    const char *env = std::getenv(BATCH_MAX_ENV_VAR);
+    if (env != nullptr && std::atoi(env) > 0)
+    {
+        return std::atoi(env);
+    }
+    return DEFAULT_BATCH_MAX;
+}
+
+std::chrono::microseconds defaultBatchWait()
+{
+    const char *env = std::getenv(BATCH_WAIT_ENV_VAR);
+    char *end = nullptr;
+    long micros = env != nullptr ? std::strtol(env, &end, 10) : -1;
+    if (env != nullptr && *env != '\0' && *end == '\0' && micros >= 0)
+    {
+        return std::chrono::microseconds(micros);
+    }
+    return std::chrono::microseconds(DEFAULT_BATCH_WAIT_US);
+}
@@ -0,0 +1,145 @@
+// BatchScheduler.h
+
+#ifndef BATCHSCHEDULER_H
+#define BATCHSCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "Digit.h"
+#include "Matrix.h"
+
+#define BATCH_MAX_ENV_VAR "MLP_BATCH_MAX"
+#define BATCH_WAIT_ENV_VAR "MLP_BATCH_WAIT_US"
+// a batch holds up to this many images...
+#define DEFAULT_BATCH_MAX 256
+// ...and its first request waits at most this long for others to join it. None by default:
+// a wait adds its full length to the latency of the clients that send one request at a
+// time, while the requests that arrive during a batch already share the next one.
+#define DEFAULT_BATCH_WAIT_US 0
+
+/**
+ * @class BatchScheduler
+ * @brief Micro-batching in front of a network's batched forward pass: requests of one or more
+ *        images from any number of threads are queued, and run together as one batch once
+ *        the queue holds maxBatch images or once its oldest request has waited maxWait,
+ *        whichever comes first. The batch-sized products then run at batch throughput, while
+ *        no request waits more than maxWait for its batch to start.
+ *        There's no scheduler thread: when no batch is running, the thread of a queued
+ *        request becomes the leader, which waits for the batch to fill, runs it and wakes the
+ *        requests it held. So a lone request on an idle scheduler with a maxWait of 0 runs on
+ *        its own thread right away, with no hand-off at all. A maxWait of 0 batches only the
+ *        requests queued while the previous batch ran.
+ *        A request larger than maxBatch runs as a batch of its own, requests are never split.
+ */
+class BatchScheduler
+{
+public:
+    /**
+     * classify(images, count, results) sets results[j] to the digit of images[j]. It's called
+     * by one thread at a time, but not always the same one.
+     */
+    typedef std::function<void(const Matrix[], int, Digit[])> ClassifyFunc;
+
+    /**
+     * @param classify the network's batched forward pass
+     * @param maxBatch images that start a batch without waiting, at least 1
+     * @param maxWait longest wait of a request for others to share its batch
+     */
+    BatchScheduler(const ClassifyFunc &classify, int maxBatch,
+                   std::chrono::microseconds maxWait);
+    BatchScheduler(const BatchScheduler &other) = delete;
+    BatchScheduler& operator=(const BatchScheduler &other) = delete;
+
+    /**
+     * Classifies count images as part of a batch, returning once they're done. Thread safe.
+     * @param images array of count contiguous images of the network input size, left alone
+     *        until the call returns
+     * @param results array of count digits, results[j] is set to the j'th image's digit.
+     */
+    void classify(const Matrix images[], int count, Digit results[]);
+
+    /**
+     * @return batches run so far.
+     */
+    long getBatchCount() const;
+
+    /**
+     * @return images classified so far.
+     */
+    long getImageCount() const;
+
+private:
+    /**
+     * A classify call waiting for its batch.
+     * @var images - its images
+     * @var count - number of images
+     * @var results - their digits, set by the leader
+     * @var arrival - when it was queued
+     * @var done - set by the leader once results is
+     */
+    typedef struct Request
+    {
+        const Matrix *images;
+        int count;
+        Digit *results;
+        std::chrono::steady_clock::time_point arrival;
+        bool done;
+    } Request;
+
+    ClassifyFunc _classify;
+    int _maxBatch;
+    std::chrono::microseconds _maxWait;
+    /**
+     * guards the members below.
+     */
+    mutable std::mutex _mutex;
+    /**
+     * a request was queued.
+     */
+    std::condition_variable _queued;
+    /**
+     * a batch is done.
+     */
+    std::condition_variable _done;
+    std::deque<Request *> _queue;
+    /**
+     * images of the queued requests.
+     */
+    int _queuedImages;
+    /**
+     * a leader is filling or running a batch.
+     */
+    bool _leading;
+    long _batches;
+    long _images;
+    /**
+     * the batch being run, used by the leader only.
+     */
+    std::vector<Request *> _taken;
+    std::vector<Matrix> _batchImages;
+    std::vector<Digit> _batchResults;
+
+    /**
+     * Waits for the batch at the head of the queue to fill and runs it, as the leader.
+     * @param lock holding _mutex, released while the batch runs
+     */
+    void lead(std::unique_lock<std::mutex> &lock);
+};
+
+/**
+ * @return the maxBatch to use: the MLP_BATCH_MAX environment variable if set to a positive
+ *         number, DEFAULT_BATCH_MAX otherwise.
+ */
+int defaultBatchMax();
+
+/**
+ * @return the maxWait to use: the MLP_BATCH_WAIT_US environment variable if set to a
+ *         non negative number of microseconds, DEFAULT_BATCH_WAIT_US otherwise.
+ */
+std::chrono::microseconds defaultBatchWait();
+
+#endif //BATCHSCHEDULER_H
@@ -0,0 +1,144 @@
+// CascadeNetwork.cpp
+
+#include <cstdlib>
+#include <iostream>
+#include "CascadeNetwork.h"
+
+CascadeNetwork::CascadeNetwork(const MlpNetwork &network, const Dense &head, int tap,
+                               float threshold)
+: _network(network), _head(head), _tap(tap), _threshold(threshold),
+  _workspace(network.makeWorkspace(DEFAULT_MAX_BATCH)), _images(0), _exits(0)
+{
+    if (!fits(network, head, tap))
+    {
+        std::cerr << EXIT_HEAD_ERR << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool CascadeNetwork::fits(const MlpNetwork &network, const Dense &head, int tap)
+{
+    const Matrix &weights = head.getWeights();
+    return head.getActivation().getType() == Softmax &&
+           weights.getRows() == network.getOutputSize() && tap >= 0 &&
+           tap < network.getLayerCount() &&
+           network.getLayers()[tap].getWeights().getCols() == weights.getCols();
+}
+
+int CascadeNetwork::getTap() const
+{
+    return _tap;
+}
+
+float CascadeNetwork::getThreshold() const
+{
+    return _threshold;
+}
+
+long CascadeNetwork::getImageCount() const
+{
+    return _images.load(std::memory_order_relaxed);
+}
+
+long CascadeNetwork::getExitCount() const
+{
+    return _exits.load(std::memory_order_relaxed);
+}
+
+Workspace CascadeNetwork::makeWorkspace(int maxBatch) const
+{
+    return _network.makeWorkspace(maxBatch);
+}
+
+Digit CascadeNetwork::operator()(const Matrix &img) const
+{
+    return (*this)(img, _workspace);
+}
+
+Digit CascadeNetwork::operator()(const Matrix &img, Workspace &ws) const
+{
+    if (img.getRows() * img.getCols() != _network.getInputSize())
+    {
+        std::cerr << BATCH_DIM_ERR << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    Matrix vec(_network.getInputSize(), 1, img.getData()); // view, no copy
+    // the head writes the buffer of the tap layer, the activations it reads stay.
+    const Matrix &activations = _network.forwardLayers(vec, 0, _tap, ws);
+    Matrix &logits = ws.layerOutput(_tap);
+    _head.forwardLogits(activations, logits);
+    Digit digit;
+    Activation::softmaxDigits(logits, &digit);
+    _images.fetch_add(1, std::memory_order_relaxed);
+    if (digit.probability >= _threshold)
+    {
+        _exits.fetch_add(1, std::memory_order_relaxed);
+        return digit;
+    }
+    int layers = _network.getLayerCount();
+    _network.forwardLayers(activations, _tap, layers, ws);
+    _network.toDigits(ws.layerOutput(layers - 1), &digit);
+    return digit;
+}
+
+void CascadeNetwork::classifyBatch(const Matrix images[], int count, Digit results[],
+                                   Workspace &ws) const
+{
+    Matrix &batch = _network.gather(images, count, ws);
+    _network.forwardLayers(batch, 0, _tap, ws);
+    Matrix &activations = _tap == 0 ? batch : ws.layerOutput(_tap - 1);
+    Matrix &logits = ws.layerOutput(_tap);
+    _head.forwardLogits(activations, logits);
+    Activation::softmaxDigits(logits, results);
+    int left = 0;
+    for (int j = 0; j < count; j++)
+    {
+        left += results[j].probability < _threshold;
+    }
+    _images.fetch_add(count, std::memory_order_relaxed);
+    _exits.fetch_add(count - left, std::memory_order_relaxed);
+    if (left == 0)
+    {
+        return;
+    }
+
+    // the columns of the images left move to the first left columns, in place: an element's
+    // new position is never after its old one, which is read before anything is written to it.
+    int rows = activations.getRows();
+    int stride = activations.getStride();
+    float *data = activations.getData();
+    for (int i = 0; i < rows; i++)
+    {
+        int k = 0;
+        for (int j = 0; j < count; j++)
+        {
+            if (results[j].probability < _threshold)
+            {
+                data[i * left + k++] = data[i * stride + j];
+            }
+        }
+    }
+    int layers = _network.getLayerCount();
+    _network.forwardLayers(Matrix(rows, left, data), _tap, layers, ws);
+    Digit *digits = ws.digits(left);
+    _network.toDigits(ws.layerOutput(layers - 1), digits);
+    for (int j = 0, k = 0; j < count; j++)
+    {
+        if (results[j].probability < _threshold)
+        {
+            results[j] = digits[k++];
+        }
+    }
+}
+
+float defaultExitThreshold()
+{
+    const char *env = std::getenv(EXIT_THRESHOLD_ENV_VAR);
+    char *end = nullptr;
+    float threshold = env != nullptr ? std::strtof(env, &end) : 0;
+    if (env != nullptr && *env != '\0' && *end == '\0' && threshold > 0 && threshold <= 1)
+    {
+        return threshold;
+    }
+    return DEFAULT_EXIT_THRESHOLD;
+}
@@ -0,0 +1,100 @@
+// CascadeNetwork.h
+
+#ifndef CASCADENETWORK_H
+#define CASCADENETWORK_H
+
+#include <atomic>
+#include "Dense.h"
+#include "Digit.h"
+#include "Matrix.h"
+#include "MlpNetwork.h"
+#include "Workspace.h"
+
+#define EXIT_HEAD_ENV_VAR "MLP_EXIT_HEAD"
+#define EXIT_THRESHOLD_ENV_VAR "MLP_EXIT_THRESHOLD"
+// an image leaves at the exit head when the head's digit is at least this probable.
+#define DEFAULT_EXIT_THRESHOLD 0.99f
+#define EXIT_HEAD_ERR "Error: the exit head must be a Softmax layer of the network's classes, " \
+                      "reading the input of the layer it was fitted on"
+
+/**
+ * @class CascadeNetwork
+ * @brief Early exit in front of an MlpNetwork: a cheap Softmax exit head (see mlpcascade)
+ *        classifies every image from the input of one of the network's layers, its tap, and
+ *        the images it classifies with at least the threshold's probability skip the layers
+ *        from the tap on. The others fall through to the rest of the network, which starts
+ *        from the activations the head read.
+ *        Like MlpNetwork, the variants taking a Workspace are safe to call from several
+ *        threads with one workspace each.
+ */
+class CascadeNetwork
+{
+private:
+    const MlpNetwork &_network;
+    Dense _head;
+    int _tap;
+    float _threshold;
+    mutable Workspace _workspace;
+    mutable std::atomic<long> _images;
+    mutable std::atomic<long> _exits;
+
+public:
+    /**
+     * Exits (code == 1) if head doesn't fit the network at tap, see fits.
+     * @param network the full network, must outlive the cascade
+     * @param head exit head
+     * @param tap layer of network whose input the head reads (the pixels are layer 0's
+     *        input): the one it was fitted on, recorded in its model file (see
+     *        ModelFile::getInputLayer). Widths alone can't tell, layers may share one.
+     * @param threshold least probability of a digit of the head to skip the rest
+     */
+    CascadeNetwork(const MlpNetwork &network, const Dense &head, int tap, float threshold);
+
+    /**
+     * @return true if tap is a layer of network whose input is as wide as head's, and head is
+     *         a Softmax of the network's classes.
+     */
+    static bool fits(const MlpNetwork &network, const Dense &head, int tap);
+
+    int getTap() const;
+    float getThreshold() const;
+
+    /**
+     * @return images classified so far.
+     */
+    long getImageCount() const;
+
+    /**
+     * @return images classified by the exit head so far.
+     */
+    long getExitCount() const;
+
+    /**
+     * @param maxBatch largest number of images a forward pass is expected to hold.
+     * @return a workspace sized for the network's layers.
+     */
+    Workspace makeWorkspace(int maxBatch) const;
+
+    /**
+     * Classifies a single image.
+     * @param img image of the network input size, in any shape.
+     */
+    Digit operator()(const Matrix &img) const;
+    Digit operator()(const Matrix &img, Workspace &ws) const;
+
+    /**
+     * Classifies count images in one forward pass up to the exit head, then one more through
+     * the rest of the network for the images left.
+     * @param images array of count images of the network input size.
+     * @param results array of count digits, results[j] is set to the j'th image's digit.
+     */
+    void classifyBatch(const Matrix images[], int count, Digit results[], Workspace &ws) const;
+};
+
+/**
+ * @return the threshold to use: the MLP_EXIT_THRESHOLD environment variable if set to a
+ *         probability in (0, 1], DEFAULT_EXIT_THRESHOLD otherwise.
+ */
+float defaultExitThreshold();
+
+#endif //CASCADENETWORK_H
@@ -0,0 +1,352 @@
+// CascadeTrainer.cpp
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "CascadeNetwork.h"
+#include "ImageList.h"
+#include "MappedFile.h"
+#include "MlpNetwork.h"
+#include "ModelFile.h"
+
+#define ERROR_INVALID_MODEL "Error: invalid model file: "
+#define ERROR_INVALID_LAYER "Error: the exit head must read the input of a layer in [0, layers): "
+#define ERROR_INVALID_DIR "Error: unable to read images directory or list: "
+#define ERROR_INVALID_IMG "Error: invalid image path or size: "
+#define ERROR_NO_IMAGES "Error: no images to fit the exit head on in: "
+#define ERROR_WRITE_HEAD "Error: failed to write exit head file: "
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlpcascade model images head [layer]\n" \
+                  "\tmodel - packed model file (see mlpconvert)\n" \
+                  "\timages - directory or list file of raw float32 images to fit the head on " \
+                  "and report on\n" \
+                  "\thead - output packed model file of the exit head (see MLP_EXIT_HEAD)\n" \
+                  "\tlayer - the head reads the input of this layer: 0 (the default) for the " \
+                  "pixels, 1 for the first hidden layer..."
+
+#define ARGS_START_IDX 1
+#define MODEL_PATH_IDX ARGS_START_IDX
+#define IMAGES_IDX (MODEL_PATH_IDX + 1)
+#define OUTPUT_IDX (IMAGES_IDX + 1)
+#define LAYER_IDX (OUTPUT_IDX + 1)
+#define ARGS_COUNT (OUTPUT_IDX + 1)
+#define LAYER_ARGS_COUNT (LAYER_IDX + 1)
+// the pixels: the first layer is most of the work of the default topology, a head after it
+// saves little even when every image leaves there (see mlpcascade's speedup).
+#define DEFAULT_TAP 0
+
+// every image is shifted by up to this many pixels each way: the shifts of even dx + dy fit
+// the head, the odd ones are held out to report on.
+#define MAX_SHIFT 2
+#define FIT_EPOCHS 2000
+#define WEIGHT_DECAY 1e-4f
+#define MOMENTUM 0.9f
+#define REPORT_THRESHOLDS {0.9f, 0.99f, 0.999f}
+// the speedup is the ratio of the best of TIMING_ROUNDS interleaved timings of each network,
+// TIMING_SECONDS long: the least disturbed runs.
+#define TIMING_ROUNDS 5
+#define TIMING_SECONDS 0.05
+
+namespace
+{
+/**
+ * @return img moved by dx columns and dy rows, zero filled.
+ */
+Matrix shifted(const Matrix &img, MatrixDims dims, int dx, int dy)
+{
+    Matrix out(dims.rows * dims.cols, 1);
+    for (int r = 0; r < dims.rows; r++)
+    {
+        for (int c = 0; c < dims.cols; c++)
+        {
+            int sr = r - dy;
+            int sc = c - dx;
+            bool inside = sr >= 0 && sr < dims.rows && sc >= 0 && sc < dims.cols;
+            out[r * dims.cols + c] = inside ? img.getData()[sr * dims.cols + sc] : 0;
+        }
+    }
+    return out;
+}
+
+/**
+ * Softmax of n logits in place.
+ */
+void softmax(float *z, int n)
+{
+    float max = *std::max_element(z, z + n);
+    float sum = 0;
+    for (int i = 0; i < n; i++)
+    {
+        z[i] = std::exp(z[i] - max);
+        sum += z[i];
+    }
+    for (int i = 0; i < n; i++)
+    {
+        z[i] /= sum;
+    }
+}
+
+/**
+ * Distillation: fits a Softmax layer to map the features of every sample to the full
+ * network's probabilities of it, by full batch gradient descent on the cross entropy.
+ * @param features samples x inputs, row major
+ * @param targets samples x classes, row major
+ * @param weights classes x inputs, fitted
+ * @param bias classes x 1, fitted
+ * @return the mean cross entropy of the fitted head, less the targets' own entropy.
+ */
+float fitHead(const std::vector<float> &features, const std::vector<float> &targets,
+              int samples, Matrix &weights, Matrix &bias)
+{
+    int classes = weights.getRows();
+    int inputs = weights.getCols();
+    // a step of 1 / L, L bounding the curvature of the loss: half the largest squared norm
+    // of a sample, its bias input included.
+    float maxNorm = 0;
+    for (int s = 0; s < samples; s++)
+    {
+        float norm = 1;
+        for (int f = 0; f < inputs; f++)
+        {
+            norm += features[s * inputs + f] * features[s * inputs + f];
+        }
+        maxNorm = std::max(maxNorm, norm);
+    }
+    float step = 2 / maxNorm;
+    std::vector<float> gradWeights(classes * inputs);
+    std::vector<float> gradBias(classes);
+    std::vector<float> velocityWeights(classes * inputs, 0.0f);
+    std::vector<float> velocityBias(classes, 0.0f);
+    std::vector<float> p(classes);
+    float loss = 0;
+    for (int epoch = 0; epoch <= FIT_EPOCHS; epoch++)
+    {
+        std::fill(gradWeights.begin(), gradWeights.end(), 0.0f);
+        std::fill(gradBias.begin(), gradBias.end(), 0.0f);
+        loss = 0;
+        for (int s = 0; s < samples; s++)
+        {
+            const float *x = &features[s * inputs];
+            const float *t = &targets[s * classes];
+            for (int c = 0; c < classes; c++)
+            {
+                float z = bias[c];
+                for (int f = 0; f < inputs; f++)
+                {
+                    z += weights(c, f) * x[f];
+                }
+                p[c] = z;
+            }
+            softmax(p.data(), classes);
+            for (int c = 0; c < classes; c++)
+            {
+                if (t[c] > 0)
+                {
+                    loss += t[c] * std::log(t[c] / std::max(p[c], 1e-30f));
+                }
+                float d = p[c] - t[c];
+                gradBias[c] += d;
+                for (int f = 0; f < inputs; f++)
+                {
+                    gradWeights[c * inputs + f] += d * x[f];
+                }
+            }
+        }
+        if (epoch == FIT_EPOCHS)
+        {
+            break;
+        }
+        for (int c = 0; c < classes; c++)
+        {
+            velocityBias[c] = MOMENTUM * velocityBias[c] - step * gradBias[c] / samples;
+            bias[c] += velocityBias[c];
+            for (int f = 0; f < inputs; f++)
+            {
+                float &v = velocityWeights[c * inputs + f];
+                v = MOMENTUM * v - step * (gradWeights[c * inputs + f] / samples +
+                                           WEIGHT_DECAY * weights(c, f));
+                weights(c, f) += v;
+            }
+        }
+    }
+    return loss / samples;
+}
+
+/**
+ * @return seconds per image of classify over images, run for TIMING_SECONDS.
+ */
+template <typename Classify>
+double timePerImage(const std::vector<Matrix> &images, Classify classify)
+{
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point start = Clock::now();
+    long count = 0;
+    double elapsed = 0;
+    while (elapsed < TIMING_SECONDS)
+    {
+        for (const Matrix &img : images)
+        {
+            classify(img);
+        }
+        count += images.size();
+        elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+    }
+    return elapsed / count;
+}
+}
+
+/**
+ * Fits the exit head of a CascadeNetwork: a Softmax layer reading the input of one of the
+ * model's layers, distilled from the model's own probabilities on shifted copies of a set of
+ * images (the model is the reference, the images need no labels), and writes it as a packed
+ * model file of one layer.
+ * Then reports for several thresholds how many images leave at the head, how many of their
+ * digits agree with the model's, on the images and on the held out shifts, and the speedup of
+ * single image classification of the images.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    if (argc != ARGS_COUNT && argc != LAYER_ARGS_COUNT)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        return EXIT_FAILURE;
+    }
+    ModelFile model;
+    if (!model.load(argv[MODEL_PATH_IDX]) ||
+        model.getActivation(model.getLayerCount() - 1) != Softmax)
+    {
+        std::cerr << ERROR_INVALID_MODEL << argv[MODEL_PATH_IDX] << std::endl;
+        return EXIT_FAILURE;
+    }
+    MlpNetwork mlp(model);
+    int tap = argc == LAYER_ARGS_COUNT ? std::atoi(argv[LAYER_IDX]) : DEFAULT_TAP;
+    if (tap < 0 || tap >= mlp.getLayerCount())
+    {
+        std::cerr << ERROR_INVALID_LAYER << tap << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<std::string> paths;
+    if (!listImages(argv[IMAGES_IDX], paths))
+    {
+        std::cerr << ERROR_INVALID_DIR << argv[IMAGES_IDX] << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (paths.empty())
+    {
+        std::cerr << ERROR_NO_IMAGES << argv[IMAGES_IDX] << std::endl;
+        return EXIT_FAILURE;
+    }
+    MatrixDims dims = model.getInputDims();
+    std::vector<Matrix> images;
+    std::vector<Matrix> fit;
+    std::vector<Matrix> heldOut;
+    for (const std::string &path : paths)
+    {
+        MappedFile file;
+        Matrix img;
+        if (!mapFileToMatrix(path, file, dims.rows, dims.cols, img))
+        {
+            std::cerr << ERROR_INVALID_IMG << path << std::endl;
+            return EXIT_FAILURE;
+        }
+        images.push_back(shifted(img, dims, 0, 0));
+        for (int dy = -MAX_SHIFT; dy <= MAX_SHIFT; dy++)
+        {
+            for (int dx = -MAX_SHIFT; dx <= MAX_SHIFT; dx++)
+            {
+                ((dx + dy) % 2 == 0 ? fit : heldOut).push_back(shifted(img, dims, dx, dy));
+            }
+        }
+    }
+
+    int inputs = mlp.getLayers()[tap].getWeights().getCols();
+    int classes = mlp.getOutputSize();
+    int samples = (int) fit.size();
+    std::vector<float> features((size_t) samples * inputs);
+    std::vector<float> targets((size_t) samples * classes);
+    Workspace ws = mlp.makeWorkspace(1);
+    for (int s = 0; s < samples; s++)
+    {
+        const Matrix &x = mlp.forwardLayers(fit[s], 0, tap, ws);
+        std::copy(x.getData(), x.getData() + inputs, &features[(size_t) s * inputs]);
+        const Matrix &logits = mlp.forwardLayers(fit[s], 0, mlp.getLayerCount(), ws);
+        std::copy(logits.getData(), logits.getData() + classes, &targets[(size_t) s * classes]);
+        softmax(&targets[(size_t) s * classes], classes);
+    }
+    Matrix weights(classes, inputs);
+    Matrix bias(classes, 1);
+    for (int i = 0; i < classes * inputs; i++)
+    {
+        weights[i] = 0;
+    }
+    for (int i = 0; i < classes; i++)
+    {
+        bias[i] = 0;
+    }
+    float divergence = fitHead(features, targets, samples, weights, bias);
+    ActivationType activation = Softmax;
+    // the tap is recorded in the head's file: the layers' widths can't tell it, they may repeat.
+    if (!ModelFile::write(argv[OUTPUT_IDX], MatrixDims{inputs, 1}, &weights, &bias, &activation,
+                          1, tap))
+    {
+        std::cerr << ERROR_WRITE_HEAD << argv[OUTPUT_IDX] << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "exit head " << classes << "x" << inputs << " on layer " << tap << "'s input, "
+              << "fitted on " << samples << " shifted images, KL divergence "
+              << std::setprecision(4) << divergence << std::endl;
+
+    Dense head(weights, bias, Softmax);
+    std::cout << std::endl << std::left << std::setw(11) << "threshold" << std::setw(9)
+              << "exits" << std::setw(11) << "agreement" << std::setw(16) << "held out exits"
+              << std::setw(20) << "held out agreement" << "speedup" << std::endl;
+    for (float threshold : REPORT_THRESHOLDS)
+    {
+        long exits[2];
+        int agree[2] = {0, 0};
+        for (int set = 0; set < 2; set++)
+        {
+            CascadeNetwork cascade(mlp, head, tap, threshold);
+            for (const Matrix &img : set == 0 ? images : heldOut)
+            {
+                agree[set] += cascade(img).value == mlp(img).value;
+            }
+            exits[set] = cascade.getExitCount();
+        }
+        CascadeNetwork cascade(mlp, head, tap, threshold);
+        double fullSeconds = 1e9;
+        double seconds = 1e9;
+        for (int round = 0; round < TIMING_ROUNDS; round++)
+        {
+            fullSeconds = std::min(fullSeconds, timePerImage(images, [&](const Matrix &img)
+            {
+                mlp(img);
+            }));
+            seconds = std::min(seconds, timePerImage(images, [&](const Matrix &img)
+            {
+                cascade(img);
+            }));
+        }
+        std::cout << std::left << std::setprecision(4) << std::setw(11) << threshold
+                  << std::setw(9)
+                  << std::to_string(exits[0]) + "/" + std::to_string(images.size())
+                  << std::setw(11)
+                  << std::to_string(agree[0]) + "/" + std::to_string(images.size())
+                  << std::setw(16)
+                  << std::to_string(exits[1]) + "/" + std::to_string(heldOut.size())
+                  << std::setw(20)
+                  << std::to_string(agree[1]) + "/" + std::to_string(heldOut.size())
+                  << std::fixed << std::setprecision(2) << fullSeconds / seconds << "x"
+                  << std::defaultfloat << std::endl;
+    }
+    return EXIT_SUCCESS;
+}
@@ -2,3 +2,78 @@
 // Created by Guy on 12/23/2019.
 //
 
+#include "Dense.h"
+#include "Kernels.h"
+
+Dense::Dense(const Matrix &weights, const Matrix &bias, ActivationType actType)
+: _weights(weights), _bias(bias), _activation(actType),
+  _kernels(&kernelsForWidth(weights.getCols()))
+{
+    // the layout of the weights is chosen once, here: aligned rows for the single image
+    // products, which stream the rows, and gemm's panels for the batched ones, packed by the
+    // first batch.
+    _weights.alignRows().prepack();
+    if (SparseMatrix::worthBuilding(weights))
+    {
+        _sparse = std::make_shared<const SparseMatrix>(weights);
+    }
+}
+
+const Matrix& Dense::getWeights() const
+{
+    return _weights;
+}
+
+const Matrix& Dense::getBias() const
+{
+    return _bias;
+}
+
+const Activation& Dense::getActivation() const
+{
+    return _activation;
+}
+
+const Kernels& Dense::getKernels() const
+{
+    return *_kernels;
+}
+
+const SparseMatrix *Dense::getSparseWeights() const
+{
+    return _sparse.get();
+}
+
+void Dense::forward(const Matrix &input, Matrix &output) const
+{
+    // softmax needs the whole column, and only runs on the small last layer.
+    forwardLogits(input, output);
+    if (_activation.getType() != Relu)
+    {
+        _activation.apply(output);
+    }
+}
+
+void Dense::forwardLogits(const Matrix &input, Matrix &output) const
+{
+    // bias (broadcast over the columns / samples of the batch) and relu are fused into the
+    // store of the product, so the hidden layers touch their output once.
+    bool relu = _activation.getType() == Relu;
+    if (_sparse != nullptr && input.getCols() == 1 && _sparse->beatsDense(input.getData()))
+    {
+        // the sparse product skips the zero inputs, which batches can't: their columns have
+        // different zeros.
+        output.resize(_weights.getRows(), 1);
+        _sparse->gemv(input.getData(), output.getData(), GemmEpilogue{_bias.getData(), relu},
+                      _kernels);
+        return;
+    }
+    output.assignProduct(_weights, input, GemmEpilogue{_bias.getData(), relu}, _kernels);
+}
+
+Matrix Dense::operator()(const Matrix &input) const
+{
+    Matrix res(_weights.getRows(), input.getCols());
+    forward(input, res);
+    return res;
+}
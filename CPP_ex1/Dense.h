@@ -5,4 +5,66 @@
 #ifndef CPP_EX1_DENSE_H
 #define CPP_EX1_DENSE_H
 
+#include <memory>
+#include "Matrix.h"
+#include "Activation.h"
+#include "SparseMatrix.h"
+
+/**
+ * @class Dense
+ * @brief A fully connected layer: activation(weights * input + bias).
+ *        The input may hold several samples, one per column, in which case the bias is added
+ *        to every column and the activation is applied per column.
+ */
+class Dense
+{
+private:
+    Matrix _weights;
+    Matrix _bias;
+    Activation _activation;
+    const Kernels *_kernels;
+    /**
+     * sparse copy of the weights, shared by the copies of the layer, null unless they're
+     * pruned enough (see SparseMatrix::worthBuilding).
+     */
+    std::shared_ptr<const SparseMatrix> _sparse;
+
+public:
+    /**
+     * The kernel table of the layer's products is picked here, from its width
+     * (see kernelsForWidth), and the weights are kept aligned and prepacked (see
+     * Matrix::alignRows and Matrix::prepack): a view of weights stays one if it's aligned,
+     * and a layer that never sees a batch holds no packed copy.
+     * Pruned weights also get a sparse copy (see SparseMatrix::worthBuilding), which the
+     * single image products run on when it saves work (see SparseMatrix::beatsDense): on
+     * the zero blocks, and on the zero pixels of a digit.
+     */
+    Dense(const Matrix &weights, const Matrix &bias, ActivationType actType);
+
+    const Matrix& getWeights() const;
+    const Matrix& getBias() const;
+    const Activation& getActivation() const;
+    const Kernels& getKernels() const;
+    /**
+     * @return the sparse copy of the weights, nullptr if they don't have one.
+     */
+    const SparseMatrix *getSparseWeights() const;
+
+    /**
+     * output = activation(weights * input + bias), computed in output's storage.
+     * The bias and relu are applied by the product kernel as it stores each output, without
+     * extra passes or intermediate matrices.
+     * Allocates nothing once output is big enough. output may not be input.
+     */
+    void forward(const Matrix &input, Matrix &output) const;
+
+    /**
+     * forward without the softmax of a Softmax layer, whose logits are left in output for
+     * Activation::softmaxDigits. Same as forward on a Relu layer.
+     */
+    void forwardLogits(const Matrix &input, Matrix &output) const;
+
+    Matrix operator()(const Matrix &input) const;
+};
+
 #endif //CPP_EX1_DENSE_H
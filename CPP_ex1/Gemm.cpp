@@ -0,0 +1,299 @@
+// Gemm.cpp
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <vector>
+#include "Gemm.h"
+#include "Kernels.h"
+#include "ThreadPool.h"
+
+// the register tile (GEMM_MR x the table's gemmNr) is defined by the micro-kernels in
+// Kernels.h.
+// cache blocking: a KC x NR panel of B stays in L1, an MC x KC block of A stays in L2
+// and a KC x NC block of B stays in L3.
+#define GEMM_MC 96
+#define GEMM_KC 256
+#define GEMM_NC 2048
+
+namespace
+{
+/**
+ * Packs an mc x kc block of A into consecutive MR row panels. Inside a panel the MR values of
+ * every column are stored together, which is the order the micro-kernel consumes them.
+ * Rows past mc are zero padded so the micro-kernel never has to check bounds.
+ */
+void packA(int mc, int kc, const float *a, int lda, float *packed)
+{
+    for (int i = 0; i < mc; i += GEMM_MR)
+    {
+        int rows = std::min(GEMM_MR, mc - i);
+        for (int p = 0; p < kc; p++)
+        {
+            for (int r = 0; r < GEMM_MR; r++)
+            {
+                *packed++ = (r < rows) ? a[(i + r) * lda + p] : 0.0f;
+            }
+        }
+    }
+}
+
+/**
+ * Packs a kc x nc block of B into consecutive nr column panels, row by row inside a panel.
+ * Columns past nc are zero padded.
+ */
+void packB(int kc, int nc, const float *b, int ldb, int nr, float *packed)
+{
+    for (int j = 0; j < nc; j += nr)
+    {
+        int cols = std::min(nr, nc - j);
+        for (int p = 0; p < kc; p++)
+        {
+            const float *row = b + p * ldb + j;
+            std::copy(row, row + cols, packed);
+            std::fill(packed + cols, packed + nr, 0.0f);
+            packed += nr;
+        }
+    }
+}
+
+/**
+ * C[m x n] = epilogue(A * B) as one gemv per col of B, gathered into a contiguous vector.
+ */
+void gemvCols(int m, int n, int k, const float *a, int lda, const float *b, int ldb,
+              float *c, int ldc, GemmEpilogue epilogue, const Kernels &kern)
+{
+    static thread_local std::vector<float> col;
+    if ((int) col.size() < k + m)
+    {
+        col.resize(k + m);
+    }
+    float *x = col.data();
+    float *y = x + k;
+    for (int j = 0; j < n; j++)
+    {
+        for (int p = 0; p < k; p++)
+        {
+            x[p] = b[p * ldb + j];
+        }
+        kern.gemv(m, k, a, lda, x, epilogue.bias, epilogue.relu, y);
+        for (int i = 0; i < m; i++)
+        {
+            c[i * ldc + j] = y[i];
+        }
+    }
+}
+
+/**
+ * Serial product, see gemm.
+ * @param prepacked A in packGemmA order or nullptr, packed from packedRows rows of which A
+ *        starts at firstRow (a multiple of GEMM_MR) when the product is a slice of a bigger one
+ */
+void gemmSerial(int m, int n, int k, const float *a, int lda, const float *b, int ldb,
+                float *c, int ldc, GemmEpilogue epilogue, const Kernels &kern,
+                const float *prepacked, int packedRows, int firstRow)
+{
+    if (n == 1 && ldb == 1 && ldc == 1)
+    {
+        kern.gemv(m, k, a, lda, b, epilogue.bias, epilogue.relu, c);
+        return;
+    }
+    if (k == 0)
+    {
+        for (int i = 0; i < m; i++)
+        {
+            float v = (epilogue.bias != nullptr) ? epilogue.bias[i] : 0.0f;
+            std::fill(c + i * ldc, c + i * ldc + n, (epilogue.relu && v < 0) ? 0.0f : v);
+        }
+        return;
+    }
+
+    // the cols past the last full tile run on gemv when they fill at most half a tile, as do
+    // all the cols of a product that narrow: gemv runs at about half the rate of full tiles,
+    // as fast as half empty ones.
+    int nr = kern.gemmNr;
+    int tail = n % nr;
+    if (tail > 0 && 2 * tail <= nr)
+    {
+        n -= tail;
+        gemvCols(m, tail, k, a, lda, b + n, ldb, c + n, ldc, epilogue, kern);
+        if (n == 0)
+        {
+            return;
+        }
+    }
+
+    // packing buffers are reused by every call on the same thread.
+    static thread_local std::vector<float> packedA;
+    static thread_local std::vector<float> packedB;
+    int ncMax = std::min(GEMM_NC, n);
+    int mcMax = std::min(GEMM_MC, m);
+    int kcMax = std::min(GEMM_KC, k);
+    size_t sizeA = (size_t) ((mcMax + GEMM_MR - 1) / GEMM_MR) * GEMM_MR * kcMax;
+    size_t sizeB = (size_t) ((ncMax + nr - 1) / nr) * nr * kcMax;
+    if (prepacked == nullptr && packedA.size() < sizeA)
+    {
+        packedA.resize(sizeA);
+    }
+    if (packedB.size() < sizeB)
+    {
+        packedB.resize(sizeB);
+    }
+
+    for (int jc = 0; jc < n; jc += GEMM_NC)
+    {
+        int nc = std::min(GEMM_NC, n - jc);
+        for (int pc = 0; pc < k; pc += GEMM_KC)
+        {
+            int kc = std::min(GEMM_KC, k - pc);
+            bool lastBlock = pc + kc == k;
+            packB(kc, nc, b + pc * ldb + jc, ldb, nr, packedB.data());
+            for (int ic = 0; ic < m; ic += GEMM_MC)
+            {
+                int mc = std::min(GEMM_MC, m - ic);
+                // the panels of a prepacked A are in place already: the KC blocks follow each
+                // other, and the row panels of a block too.
+                const float *blockA = (prepacked != nullptr) ?
+                                      prepacked + (size_t) pc * packedRows +
+                                      (size_t) (firstRow + ic) * kc : packedA.data();
+                if (prepacked == nullptr)
+                {
+                    packA(mc, kc, a + ic * lda + pc, lda, packedA.data());
+                }
+                for (int jr = 0; jr < nc; jr += nr)
+                {
+                    const float *panelB = packedB.data() + jr * kc;
+                    for (int ir = 0; ir < mc; ir += GEMM_MR)
+                    {
+                        const float *panelA = blockA + ir * kc;
+                        float *tile = c + (ic + ir) * ldc + jc + jr;
+                        // the epilogue is applied once, by the tiles of the last KC block.
+                        const float *bias = (lastBlock && epilogue.bias != nullptr) ?
+                                            epilogue.bias + ic + ir : nullptr;
+                        kern.gemmTile(kc, panelA, panelB, tile, ldc, std::min(GEMM_MR, mc - ir),
+                                      std::min(nr, nc - jr), pc > 0, bias,
+                                      lastBlock && epilogue.relu);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Arguments of a product split by rows of C.
+ */
+typedef struct GemmCall
+{
+    int n;
+    int k;
+    const float *a;
+    int lda;
+    const float *b;
+    int ldb;
+    float *c;
+    int ldc;
+    GemmEpilogue epilogue;
+    const Kernels *kern;
+    const float *packedA;
+    int packedRows;
+} GemmCall;
+
+/**
+ * Computes the rows [begin, end) of C.
+ */
+void gemmRows(const GemmCall &call, int begin, int end)
+{
+    GemmEpilogue epilogue = {(call.epilogue.bias != nullptr) ? call.epilogue.bias + begin :
+                             nullptr, call.epilogue.relu};
+    gemmSerial(end - begin, call.n, call.k, call.a + (size_t) begin * call.lda, call.lda,
+               call.b, call.ldb, call.c + (size_t) begin * call.ldc, call.ldc, epilogue,
+               *call.kern, call.packedA, call.packedRows, begin);
+}
+
+int threadsFromEnv()
+{
+    const char *env = std::getenv(GEMM_THREADS_ENV_VAR);
+    return (env != nullptr && std::atoi(env) > 0) ? std::atoi(env) : 1;
+}
+
+std::atomic<int> &gemmThreads()
+{
+    static std::atomic<int> threads(threadsFromEnv());
+    return threads;
+}
+
+/**
+ * @return rows of C per chunk when a product of m rows and flops is worth splitting,
+ *         0 to run it on the calling thread.
+ */
+int parallelGrain(int m, double flops)
+{
+    int threads = gemmThreads().load();
+    if (threads <= 1 || flops < GEMM_PARALLEL_MIN_FLOPS || ThreadPool::inTask())
+    {
+        return 0;
+    }
+    int chunks = std::min(std::min(threads, defaultPool().getSlotCount()),
+                          m / GEMM_PARALLEL_MIN_ROWS);
+    if (chunks <= 1)
+    {
+        return 0;
+    }
+    // whole register tiles per chunk, so the split adds no edge tiles.
+    int grain = (m + chunks - 1) / chunks;
+    return (grain + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+}
+}
+
+void setGemmThreads(int threads)
+{
+    gemmThreads() = (threads > 0) ? threads : defaultThreadCount();
+}
+
+int getGemmThreads()
+{
+    return gemmThreads().load();
+}
+
+void gemv(int m, int k, const float *a, int lda, const float *x, float *y,
+          GemmEpilogue epilogue, const Kernels *kern)
+{
+    gemm(m, 1, k, a, lda, x, 1, y, 1, epilogue, kern);
+}
+
+size_t packedGemmASize(int m, int k)
+{
+    return (size_t) ((m + GEMM_MR - 1) / GEMM_MR) * GEMM_MR * k;
+}
+
+void packGemmA(int m, int k, const float *a, int lda, float *packed)
+{
+    int packedRows = (m + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+    for (int pc = 0; pc < k; pc += GEMM_KC)
+    {
+        packA(m, std::min(GEMM_KC, k - pc), a + pc, lda, packed + (size_t) pc * packedRows);
+    }
+}
+
+void gemm(int m, int n, int k, const float *a, int lda, const float *b, int ldb,
+          float *c, int ldc, GemmEpilogue epilogue, const Kernels *kern, const float *packedA)
+{
+    if (kern == nullptr)
+    {
+        kern = &kernels();
+    }
+    int packedRows = (m + GEMM_MR - 1) / GEMM_MR * GEMM_MR;
+    int grain = parallelGrain(m, 2.0 * m * n * k);
+    if (grain == 0)
+    {
+        gemmSerial(m, n, k, a, lda, b, ldb, c, ldc, epilogue, *kern, packedA, packedRows, 0);
+        return;
+    }
+    // a single captured pointer keeps the std::function from allocating.
+    GemmCall call = {n, k, a, lda, b, ldb, c, ldc, epilogue, kern, packedA, packedRows};
+    defaultPool().parallelFor(m, grain, [&call](int begin, int end, int)
+    {
+        gemmRows(call, begin, end);
+    });
+}
@@ -0,0 +1,99 @@
+// Gemm.h
+
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <cstddef>
+
+struct Kernels;
+
+/**
+ * @struct GemmEpilogue
+ * @brief Work fused into the store of every output element: c = act(c + bias[row]).
+ *        Applying it while the result is still in registers saves a pass over C for the bias
+ *        and another one for the activation.
+ * @var bias - per row bias, broadcast over the columns of C, or nullptr for none
+ * @var relu - clamp negative outputs to 0
+ */
+typedef struct GemmEpilogue
+{
+    const float *bias;
+    bool relu;
+} GemmEpilogue;
+
+#define NO_EPILOGUE (GemmEpilogue{nullptr, false})
+
+#define GEMM_THREADS_ENV_VAR "MLP_GEMM_THREADS"
+// products below this many flops run on the calling thread: waking the pool costs more than
+// it saves. The first layer (2 x 128 x 784) of a single image is above it, the others below.
+#define GEMM_PARALLEL_MIN_FLOPS (1 << 17)
+// fewest rows of C worth a chunk of their own.
+#define GEMM_PARALLEL_MIN_ROWS 16
+
+/**
+ * Intra-op parallelism: gemm and gemv split the rows of C across up to this many threads of
+ * defaultPool(), which mostly helps the latency of a single image since a batch is better
+ * spread by image. Products called from inside a pool task stay serial.
+ * @param threads thread count, 1 (the default, unless set by MLP_GEMM_THREADS) to disable,
+ *        0 for defaultThreadCount()
+ */
+void setGemmThreads(int threads);
+
+/**
+ * @return the intra-op thread count, see setGemmThreads.
+ */
+int getGemmThreads();
+
+/**
+ * General matrix-matrix product on row-major buffers:
+ *      C[m x n] = A[m x k] * B[k x n]
+ * A, B and C are addressed through their leading dimensions (distance in floats between two
+ * consecutive rows), so sub-blocks of bigger buffers can be passed directly.
+ * The product is computed on packed, cache blocked panels with a register tiled micro-kernel.
+ * @param m rows of A and C
+ * @param n cols of B and C
+ * @param k cols of A / rows of B
+ * @param a pointer to A
+ * @param lda leading dimension of A
+ * @param b pointer to B
+ * @param ldb leading dimension of B
+ * @param c pointer to C, overwritten by the product
+ * @param ldc leading dimension of C
+ * @param epilogue bias and activation fused into the product
+ * @param kern kernel table to run the product with (see kernelsForWidth), nullptr for
+ *        kernels()
+ * @param packedA A already packed by packGemmA, or nullptr to pack it on the fly. A matrix
+ *        multiplied many times, like the weights of a layer, is better packed once.
+ */
+void gemm(int m, int n, int k, const float *a, int lda, const float *b, int ldb,
+          float *c, int ldc, GemmEpilogue epilogue = NO_EPILOGUE,
+          const Kernels *kern = nullptr, const float *packedA = nullptr);
+
+/**
+ * @return floats needed by packGemmA for an m x k matrix.
+ */
+size_t packedGemmASize(int m, int k);
+
+/**
+ * Packs A[m x k] into the panel layout gemm's micro-kernel reads, for gemm's packedA.
+ * @param a pointer to A
+ * @param lda leading dimension of A
+ * @param packed output of packedGemmASize(m, k) floats
+ */
+void packGemmA(int m, int k, const float *a, int lda, float *packed);
+
+/**
+ * Matrix-vector product on a row-major matrix: y[m] = A[m x k] * x[k].
+ * @param m rows of A
+ * @param k cols of A, length of x
+ * @param a pointer to A
+ * @param lda leading dimension of A
+ * @param x input vector
+ * @param y output vector, overwritten by the product
+ * @param epilogue bias and activation fused into the product
+ * @param kern kernel table, as for gemm
+ */
+void gemv(int m, int k, const float *a, int lda, const float *x, float *y,
+          GemmEpilogue epilogue = NO_EPILOGUE, const Kernels *kern = nullptr);
+
+#endif //GEMM_H
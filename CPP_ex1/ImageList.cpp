@@ -0,0 +1,59 @@
+// ImageList.cpp
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <fstream>
+#include "ImageList.h"
+
+bool listImages(const std::string &path, std::vector<std::string> &paths)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+    {
+        return false;
+    }
+
+    if (!S_ISDIR(info.st_mode))
+    {
+        std::ifstream is(path);
+        if (!is.is_open())
+        {
+            return false;
+        }
+        std::string line;
+        while (std::getline(is, line))
+        {
+            if (!line.empty() && line.back() == '\r')
+            {
+                line.pop_back();
+            }
+            if (!line.empty())
+            {
+                paths.push_back(line);
+            }
+        }
+        return true;
+    }
+
+    DIR *dir = opendir(path.c_str());
+    if (dir == nullptr)
+    {
+        return false;
+    }
+    std::vector<std::string> names;
+    for (dirent *entry = readdir(dir); entry != nullptr; entry = readdir(dir))
+    {
+        if (entry->d_name[0] != '.')
+        {
+            names.emplace_back(entry->d_name);
+        }
+    }
+    closedir(dir);
+    std::sort(names.begin(), names.end());
+    for (const std::string &name : names)
+    {
+        paths.push_back(path + "/" + name);
+    }
+    return true;
+}
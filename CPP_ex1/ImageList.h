@@ -0,0 +1,20 @@
+// ImageList.h
+
+#ifndef IMAGELIST_H
+#define IMAGELIST_H
+
+#include <string>
+#include <vector>
+
+/**
+ * Collects the image files named by path.
+ * @param path either a directory, whose entries (but the hidden ones) are taken in name
+ *        order, or a text file listing one image path per line.
+ * @param paths output, the image paths in order
+ * @return boolean status
+ *          true - success
+ *          false - failure (path is neither a readable directory nor a readable file)
+ */
+bool listImages(const std::string &path, std::vector<std::string> &paths);
+
+#endif //IMAGELIST_H
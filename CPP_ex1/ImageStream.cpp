@@ -0,0 +1,120 @@
+// ImageStream.cpp
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ImageStream.h"
+
+ImageStream::ImageStream(int recordFloats)
+: _recordBytes((size_t) recordFloats * sizeof(float)), _offset(0), _fd(-1), _ownsFd(false),
+  _eof(false), _failed(false){}
+
+ImageStream::~ImageStream()
+{
+    close();
+}
+
+bool ImageStream::open(const std::string &path)
+{
+    close();
+    if (path == STREAM_STDIN)
+    {
+        _fd = STDIN_FILENO;
+        return true;
+    }
+    if (_file.map(path))
+    {
+        return true;
+    }
+    // not mappable: an empty file, a named pipe, a device...
+    _fd = ::open(path.c_str(), O_RDONLY);
+    _ownsFd = _fd >= 0;
+    return _ownsFd;
+}
+
+int ImageStream::next(int maxRecords, const float *&records)
+{
+    return next(maxRecords, _buffer, records);
+}
+
+int ImageStream::next(int maxRecords, std::vector<float> &buffer, const float *&records)
+{
+    size_t want = (size_t) maxRecords * _recordBytes;
+    if (_file.getData() != nullptr)
+    {
+        size_t whole = (_file.getSize() - _offset) / _recordBytes * _recordBytes;
+        size_t bytes = std::min(want, whole);
+        records = reinterpret_cast<const float *>(
+                static_cast<const char *>(_file.getData()) + _offset);
+        _offset += bytes;
+        return (int) (bytes / _recordBytes);
+    }
+    if (_fd < 0 || want == 0)
+    {
+        return 0;
+    }
+
+    // start with the partial record the previous block ended with.
+    if (buffer.size() * sizeof(float) < want)
+    {
+        buffer.resize(want / sizeof(float));
+    }
+    char *bytes = reinterpret_cast<char *>(buffer.data());
+    size_t filled = _carry.size();
+    std::memcpy(bytes, _carry.data(), filled);
+    while (filled < want && !_eof)
+    {
+        ssize_t n = read(_fd, bytes + filled, want - filled);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            _failed = true;
+            return 0;
+        }
+        _eof = n == 0;
+        filled += (size_t) n;
+    }
+    size_t whole = filled / _recordBytes * _recordBytes;
+    _carry.assign(bytes + whole, bytes + filled);
+    records = buffer.data();
+    return (int) (whole / _recordBytes);
+}
+
+bool ImageStream::isMapped() const
+{
+    return _file.getData() != nullptr;
+}
+
+bool ImageStream::hasFailed() const
+{
+    return _failed;
+}
+
+size_t ImageStream::getTrailingBytes() const
+{
+    if (_file.getData() != nullptr)
+    {
+        return _file.getSize() - _offset;
+    }
+    return _carry.size();
+}
+
+void ImageStream::close()
+{
+    _file.unmap();
+    if (_ownsFd)
+    {
+        ::close(_fd);
+    }
+    _fd = -1;
+    _ownsFd = false;
+    _offset = 0;
+    _carry.clear();
+    _eof = false;
+    _failed = false;
+}
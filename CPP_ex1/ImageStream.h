@@ -0,0 +1,88 @@
+// ImageStream.h
+
+#ifndef IMAGESTREAM_H
+#define IMAGESTREAM_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "MappedFile.h"
+
+#define STREAM_STDIN "-"
+
+/**
+ * @class ImageStream
+ * @brief Sequential reader of fixed size float32 records (e.g. IMG_SIZE floats per image)
+ *        concatenated in one file or piped to stdin, handed out in blocks of whole records.
+ *        A regular file is memory mapped and its blocks point straight into the mapping;
+ *        stdin, pipes and anything else that can't be mapped are read with large read(2)
+ *        calls, into a buffer reused from block to block or into the caller's buffers, so
+ *        several blocks can be in flight at once.
+ */
+class ImageStream
+{
+private:
+    size_t _recordBytes;
+    MappedFile _file;
+    size_t _offset;
+    int _fd;
+    bool _ownsFd;
+    std::vector<float> _buffer;
+    std::vector<char> _carry;
+    bool _eof;
+    bool _failed;
+
+public:
+    /**
+     * @param recordFloats floats per record
+     */
+    explicit ImageStream(int recordFloats);
+    ImageStream(const ImageStream &other) = delete;
+    ImageStream& operator=(const ImageStream &other) = delete;
+    ~ImageStream();
+
+    /**
+     * Opens the stream, dropping any previous one.
+     * @param path file to read, or STREAM_STDIN
+     * @return boolean status
+     *          true - success
+     *          false - failure (missing or unreadable file)
+     */
+    bool open(const std::string &path);
+
+    /**
+     * Reads the next block of records. The block stays valid until the next call.
+     * @param maxRecords most records to return
+     * @param records set to the first record of the block
+     * @return number of records in the block, 0 at the end of the stream or on a read error
+     */
+    int next(int maxRecords, const float *&records);
+
+    /**
+     * Same, but reads into the given buffer (resized as needed) unless the stream is mapped.
+     * The block stays valid as long as buffer is left alone, whatever later calls do.
+     * @param buffer read target, not used (and the block points into the file's mapping)
+     *        for a mapped stream
+     */
+    int next(int maxRecords, std::vector<float> &buffer, const float *&records);
+
+    /**
+     * @return true if the stream is memory mapped.
+     */
+    bool isMapped() const;
+
+    /**
+     * @return true if a read failed.
+     */
+    bool hasFailed() const;
+
+    /**
+     * @return bytes left over after the last whole record, non zero for a truncated stream
+     *         once next() returned 0.
+     */
+    size_t getTrailingBytes() const;
+
+    void close();
+};
+
+#endif //IMAGESTREAM_H
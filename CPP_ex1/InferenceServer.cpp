@@ -0,0 +1,288 @@
+// InferenceServer.cpp
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+#include "InferenceServer.h"
+
+namespace
+{
+// written to by the stop signals' handler, polled by the accept loop.
+int stopPipe[2] = {-1, -1};
+
+void onStopSignal(int)
+{
+    char byte = 0;
+    ssize_t ignored = write(stopPipe[1], &byte, 1);
+    (void) ignored;
+}
+
+void closeStopPipe()
+{
+    close(stopPipe[0]);
+    close(stopPipe[1]);
+    stopPipe[0] = stopPipe[1] = -1;
+}
+
+/**
+ * Makes the socket path free to bind: nothing is there, or a socket no server listens on any
+ * more (a connect is refused), left by a server that didn't get to remove it, which is
+ * removed. Anything else is left alone: a regular file, or the socket of a running server.
+ * @return false if the path is taken
+ */
+bool clearStaleSocket(const sockaddr_un &address)
+{
+    struct stat status;
+    if (lstat(address.sun_path, &status) != 0)
+    {
+        return errno == ENOENT;
+    }
+    if (!S_ISSOCK(status.st_mode))
+    {
+        return false;
+    }
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe < 0)
+    {
+        return false;
+    }
+    bool refused = connect(probe, reinterpret_cast<const sockaddr *>(&address),
+                           sizeof(address)) != 0 && errno == ECONNREFUSED;
+    close(probe);
+    return refused && unlink(address.sun_path) == 0;
+}
+
+/**
+ * Removes the socket file the server bound, if it's still the one at the path: another
+ * server may have replaced it since.
+ * @param bound lstat of the path right after the bind
+ */
+void removeSocket(const char *path, const struct stat &bound)
+{
+    struct stat status;
+    if (lstat(path, &status) == 0 && S_ISSOCK(status.st_mode) &&
+        status.st_dev == bound.st_dev && status.st_ino == bound.st_ino)
+    {
+        unlink(path);
+    }
+}
+
+/**
+ * Reads exactly size bytes.
+ * @return false on end of file or error
+ */
+bool readFully(int fd, void *data, size_t size)
+{
+    char *bytes = static_cast<char *>(data);
+    while (size > 0)
+    {
+        ssize_t n = read(fd, bytes, size);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        bytes += n;
+        size -= (size_t) n;
+    }
+    return true;
+}
+
+/**
+ * Writes exactly size bytes, without a SIGPIPE if the peer is gone.
+ * @return false on error
+ */
+bool writeFully(int fd, const void *data, size_t size)
+{
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0)
+    {
+        ssize_t n = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            return false;
+        }
+        bytes += n;
+        size -= (size_t) n;
+    }
+    return true;
+}
+}
+
+InferenceServer::InferenceServer(const std::string &path, int imgSize,
+                                 BatchScheduler &scheduler, ResultCache *cache)
+: _path(path), _imgSize(imgSize), _scheduler(scheduler), _cache(cache), _listenFd(-1){}
+
+InferenceServer::~InferenceServer()
+{
+    if (_listenFd >= 0)
+    {
+        close(_listenFd);
+    }
+}
+
+bool InferenceServer::run()
+{
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (_path.size() >= sizeof(address.sun_path))
+    {
+        return false;
+    }
+    std::strcpy(address.sun_path, _path.c_str());
+    // the stop pipe first: once bound, a failure must remove the socket file, or the next run
+    // fails to bind it.
+    if (pipe2(stopPipe, O_CLOEXEC) != 0)
+    {
+        return false;
+    }
+    _listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (_listenFd < 0)
+    {
+        closeStopPipe();
+        return false;
+    }
+    struct stat bound;
+    if (!clearStaleSocket(address) ||
+        bind(_listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        lstat(address.sun_path, &bound) != 0)
+    {
+        closeStopPipe();
+        return false;
+    }
+    if (listen(_listenFd, SERVER_BACKLOG) != 0)
+    {
+        closeStopPipe();
+        removeSocket(address.sun_path, bound);
+        return false;
+    }
+    struct sigaction action;
+    struct sigaction previousInt;
+    struct sigaction previousTerm;
+    std::memset(&action, 0, sizeof(action));
+    action.sa_handler = onStopSignal;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGINT, &action, &previousInt);
+    sigaction(SIGTERM, &action, &previousTerm);
+
+    acceptLoop();
+    {
+        // wake the connections: their threads see the end of their stream, or fail to send
+        // the response of the request being classified, and return.
+        std::unique_lock<std::mutex> lock(_mutex);
+        for (int fd : _clients)
+        {
+            shutdown(fd, SHUT_RDWR);
+        }
+        _closed.wait(lock, [this]() { return _clients.empty(); });
+    }
+
+    sigaction(SIGINT, &previousInt, nullptr);
+    sigaction(SIGTERM, &previousTerm, nullptr);
+    closeStopPipe();
+    close(_listenFd);
+    _listenFd = -1;
+    removeSocket(address.sun_path, bound);
+    return true;
+}
+
+void InferenceServer::acceptLoop()
+{
+    pollfd fds[2] = {{_listenFd, POLLIN, 0}, {stopPipe[0], POLLIN, 0}};
+    while (true)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        if (fds[1].revents != 0)
+        {
+            return;
+        }
+        int fd = accept4(_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            continue; // the client gave up already, or out of descriptors for now
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        _clients.insert(fd);
+        std::thread(&InferenceServer::serveClient, this, fd).detach();
+    }
+}
+
+void InferenceServer::serveClient(int fd)
+{
+    std::vector<float> buffer;
+    std::vector<Matrix> images;
+    std::vector<Digit> results;
+    std::vector<char> response;
+    ResultCache::Scratch scratch;
+    uint32_t count;
+    while (readFully(fd, &count, SERVER_HEADER_BYTES) && count > 0 &&
+           count <= SERVER_MAX_REQUEST_IMAGES)
+    {
+        buffer.resize((size_t) count * _imgSize);
+        if (!readFully(fd, buffer.data(), buffer.size() * sizeof(float)))
+        {
+            break;
+        }
+        images.resize(count);
+        results.resize(count);
+        for (uint32_t j = 0; j < count; j++)
+        {
+            images[j] = Matrix(_imgSize, 1, buffer.data() + (size_t) j * _imgSize);
+        }
+        if (_cache != nullptr)
+        {
+            _cache->classify(images.data(), (int) count, results.data(), scratch,
+                             [this](const Matrix missing[], int n, Digit digits[])
+            {
+                _scheduler.classify(missing, n, digits);
+            });
+        }
+        else
+        {
+            _scheduler.classify(images.data(), (int) count, results.data());
+        }
+
+        response.resize(SERVER_HEADER_BYTES + (size_t) count * SERVER_RECORD_BYTES);
+        std::memcpy(response.data(), &count, SERVER_HEADER_BYTES);
+        char *record = response.data() + SERVER_HEADER_BYTES;
+        for (const Digit &digit : results)
+        {
+            record[0] = (char) digit.value;
+            std::memcpy(record + 1, &digit.probability, sizeof(float));
+            record += SERVER_RECORD_BYTES;
+        }
+        if (!writeFully(fd, response.data(), response.size()))
+        {
+            break;
+        }
+    }
+
+    // closed under the lock, so the stop doesn't shut down a descriptor number reused since.
+    std::lock_guard<std::mutex> lock(_mutex);
+    close(fd);
+    _clients.erase(fd);
+    _closed.notify_all();
+}
@@ -0,0 +1,91 @@
+// InferenceServer.h
+
+#ifndef INFERENCESERVER_H
+#define INFERENCESERVER_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include "BatchScheduler.h"
+#include "ResultCache.h"
+
+// a request or response starts with its image count, a native endian uint32: the clients of
+// a Unix socket run on the same host.
+#define SERVER_HEADER_BYTES sizeof(uint32_t)
+// result records: a uint8 digit followed by its native endian float32 probability, like
+// the --stream-binary output.
+#define SERVER_RECORD_BYTES (1 + sizeof(float))
+// a request of more images than this (or of none) is a protocol error.
+#define SERVER_MAX_REQUEST_IMAGES (1 << 16)
+#define SERVER_BACKLOG 64
+
+/**
+ * @class InferenceServer
+ * @brief Classifies images sent over a Unix domain socket, with the network loaded once for
+ *        the life of the process.
+ *        Every connection sends framed requests and gets one response per request, in order:
+ *            request  - uint32 count, then count images of imgSize float32 each
+ *            response - uint32 count, then count SERVER_RECORD_BYTES records
+ *        A malformed request closes its connection.
+ *        Every connection is served by a thread of its own, which reads the request and
+ *        hands it to a BatchScheduler: concurrent requests share a forward pass instead of
+ *        waiting for each other's. With a ResultCache, only the images missing from it are.
+ *        SIGINT and SIGTERM stop the server: it closes the socket and its connections, and
+ *        removes the socket file.
+ */
+class InferenceServer
+{
+public:
+    /**
+     * @param path socket file path. A socket left there by a server that's gone is replaced,
+     *        anything else fails run()
+     * @param imgSize floats per image
+     * @param scheduler batches the requests for the network, must outlive the server
+     * @param cache digits of the images seen before, nullptr for none. Must outlive the
+     *        server.
+     */
+    InferenceServer(const std::string &path, int imgSize, BatchScheduler &scheduler,
+                    ResultCache *cache = nullptr);
+    InferenceServer(const InferenceServer &other) = delete;
+    InferenceServer& operator=(const InferenceServer &other) = delete;
+    ~InferenceServer();
+
+    /**
+     * Serves until SIGINT or SIGTERM.
+     * @return boolean status
+     *          true - success
+     *          false - failure (unable to create, bind or listen on the socket, or the path is
+     *                  taken by a file or by a running server)
+     */
+    bool run();
+
+private:
+    std::string _path;
+    int _imgSize;
+    BatchScheduler &_scheduler;
+    ResultCache *_cache;
+    int _listenFd;
+    /**
+     * guards the members below.
+     */
+    std::mutex _mutex;
+    /**
+     * a connection was closed.
+     */
+    std::condition_variable _closed;
+    std::set<int> _clients;
+
+    /**
+     * Accepts connections until a stop signal, a thread each.
+     */
+    void acceptLoop();
+
+    /**
+     * Serves the requests of a connection until it's closed, then closes it.
+     */
+    void serveClient(int fd);
+};
+
+#endif //INFERENCESERVER_H
@@ -0,0 +1,200 @@
+// Instrument.cpp
+
+#include "Instrument.h"
+
+#ifdef MLP_INSTRUMENT
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+namespace
+{
+const char *const networkNames[INSTRUMENTED_NETWORKS] = {"float32", "int8"};
+
+/**
+ * Statistics of one layer, updated concurrently by every thread running the network.
+ */
+typedef struct LayerProfile
+{
+    std::atomic<int> rows;
+    std::atomic<int> cols;
+    std::atomic<long> calls;
+    std::atomic<long> nanos;
+    std::atomic<double> flops;
+    std::atomic<double> bytes;
+    std::atomic<long> allocations;
+    std::atomic<long> buckets[INSTRUMENT_BUCKETS];
+} LayerProfile;
+
+LayerProfile profiles[INSTRUMENTED_NETWORKS][INSTRUMENT_MAX_LAYERS];
+// passes of the layers past the table, counted only: the report says they're missing.
+std::atomic<long> unprofiledCalls[INSTRUMENTED_NETWORKS];
+std::atomic<bool> enabled(false);
+std::once_flag installed;
+volatile std::sig_atomic_t summaryRequested = 0;
+thread_local long allocations = 0;
+
+void addTo(std::atomic<double> &sum, double value)
+{
+    double current = sum.load(std::memory_order_relaxed);
+    while (!sum.compare_exchange_weak(current, current + value, std::memory_order_relaxed))
+    {
+    }
+}
+
+/**
+ * printInstrumentation isn't async signal safe, the handler only asks the next recorded
+ * pass to print it.
+ */
+void onSignal(int)
+{
+    summaryRequested = 1;
+}
+
+/**
+ * @return upper bound, in microseconds, of the bucket holding the given quantile of calls.
+ */
+double quantileMicros(const LayerProfile &p, long calls, double quantile)
+{
+    long seen = 0;
+    for (int b = 0; b < INSTRUMENT_BUCKETS; b++)
+    {
+        seen += p.buckets[b].load(std::memory_order_relaxed);
+        if (seen >= quantile * calls)
+        {
+            return (double) (2L << b) / 1e3;
+        }
+    }
+    return (double) (2L << (INSTRUMENT_BUCKETS - 1)) / 1e3;
+}
+
+/**
+ * Reads INSTRUMENT_ENV_VAR at startup.
+ */
+struct EnvInit
+{
+    EnvInit()
+    {
+        const char *env = std::getenv(INSTRUMENT_ENV_VAR);
+        if (env != nullptr && std::strcmp(env, "1") == 0)
+        {
+            setInstrumentation(true);
+        }
+    }
+} envInit;
+}
+
+void setInstrumentation(bool on)
+{
+    if (on)
+    {
+        std::call_once(installed, []()
+        {
+            std::signal(INSTRUMENT_SIGNAL, onSignal);
+            std::atexit(printInstrumentation);
+        });
+    }
+    enabled.store(on, std::memory_order_relaxed);
+}
+
+bool isInstrumentationEnabled()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void instrumentAllocation()
+{
+    allocations++;
+}
+
+long instrumentedAllocations()
+{
+    return allocations;
+}
+
+void recordLayer(InstrumentedNetwork network, int layer, int rows, int cols, long nanos,
+                 double flops, double bytes, long layerAllocations)
+{
+    if (layer < INSTRUMENT_MAX_LAYERS)
+    {
+        LayerProfile &p = profiles[network][layer];
+        p.rows.store(rows, std::memory_order_relaxed);
+        p.cols.store(cols, std::memory_order_relaxed);
+        p.calls.fetch_add(1, std::memory_order_relaxed);
+        p.nanos.fetch_add(nanos, std::memory_order_relaxed);
+        addTo(p.flops, flops);
+        addTo(p.bytes, bytes);
+        p.allocations.fetch_add(layerAllocations, std::memory_order_relaxed);
+        int bucket = 0;
+        while (bucket < INSTRUMENT_BUCKETS - 1 && (nanos >> (bucket + 1)) > 0)
+        {
+            bucket++;
+        }
+        p.buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        unprofiledCalls[network].fetch_add(1, std::memory_order_relaxed);
+    }
+    if (summaryRequested)
+    {
+        summaryRequested = 0;
+        printInstrumentation();
+    }
+}
+
+void printInstrumentation()
+{
+    for (int n = 0; n < INSTRUMENTED_NETWORKS; n++)
+    {
+        bool header = false;
+        for (int i = 0; i < INSTRUMENT_MAX_LAYERS; i++)
+        {
+            const LayerProfile &p = profiles[n][i];
+            long calls = p.calls.load(std::memory_order_relaxed);
+            if (calls == 0)
+            {
+                continue;
+            }
+            if (!header)
+            {
+                std::fprintf(stderr, "instrumentation of the %s network:\n"
+                             "%-6s %-10s %10s %10s %10s %10s %10s %10s %10s\n", networkNames[n],
+                             "layer", "shape", "calls", "mean us", "p50 us", "p99 us",
+                             "GFLOP/s", "GB/s", "allocs");
+                header = true;
+            }
+            double seconds = p.nanos.load(std::memory_order_relaxed) * 1e-9;
+            char shape[24];
+            std::snprintf(shape, sizeof(shape), "%dx%d", p.rows.load(), p.cols.load());
+            std::fprintf(stderr, "%-6d %-10s %10ld %10.2f %10.2f %10.2f %10.2f %10.2f %10ld\n",
+                         i, shape, calls, seconds * 1e6 / calls, quantileMicros(p, calls, 0.5),
+                         quantileMicros(p, calls, 0.99),
+                         seconds > 0 ? p.flops.load() / seconds * 1e-9 : 0.0,
+                         seconds > 0 ? p.bytes.load() / seconds * 1e-9 : 0.0,
+                         p.allocations.load());
+            // non empty buckets of the time histogram, as "<upper bound us>:calls".
+            std::fprintf(stderr, "       histogram:");
+            for (int b = 0; b < INSTRUMENT_BUCKETS; b++)
+            {
+                long count = p.buckets[b].load(std::memory_order_relaxed);
+                if (count > 0)
+                {
+                    std::fprintf(stderr, " <%gus:%ld", (double) (2L << b) / 1e3, count);
+                }
+            }
+            std::fprintf(stderr, "\n");
+        }
+        long unprofiled = unprofiledCalls[n].load(std::memory_order_relaxed);
+        if (unprofiled > 0)
+        {
+            std::fprintf(stderr, "layers %d and later of the %s network not profiled: %ld calls\n",
+                         INSTRUMENT_MAX_LAYERS, networkNames[n], unprofiled);
+        }
+    }
+}
+
+#endif //MLP_INSTRUMENT
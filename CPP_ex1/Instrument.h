@@ -0,0 +1,141 @@
+// Instrument.h
+
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+/**
+ * Hot path instrumentation of the networks' forward passes: per layer wall time histogram,
+ * FLOPs, bytes touched and Matrix allocations, summarized to stderr at exit and whenever
+ * the process gets INSTRUMENT_SIGNAL.
+ * Compiled in only when MLP_INSTRUMENT is defined (cmake -DMLP_INSTRUMENT=ON, or
+ * make INSTRUMENT=1): otherwise the INSTRUMENT_* macros expand to nothing and cost nothing.
+ * When compiled in, recording is off until the INSTRUMENT_ENV_VAR environment variable is
+ * set to 1 or setInstrumentation(true) is called, and then costs two clock reads per layer.
+ */
+
+#ifdef MLP_INSTRUMENT
+
+#include <chrono>
+#include <csignal>
+#include <cstddef>
+
+#define INSTRUMENT_ENV_VAR "MLP_INSTRUMENT"
+#define INSTRUMENT_SIGNAL SIGUSR1
+#define INSTRUMENT_MAX_LAYERS 16
+// time histogram buckets: bucket b counts the passes that took [2^b, 2^(b+1)) nanoseconds.
+#define INSTRUMENT_BUCKETS 40
+
+/**
+ * @enum InstrumentedNetwork
+ * @brief The networks whose layers are recorded separately.
+ */
+enum InstrumentedNetwork
+{
+    FloatNetwork,
+    Int8Network,
+    INSTRUMENTED_NETWORKS
+};
+
+/**
+ * Turns recording on or off. Turning it on installs the exit and signal summaries.
+ */
+void setInstrumentation(bool enabled);
+
+bool isInstrumentationEnabled();
+
+/**
+ * Counts a Matrix storage allocation of the calling thread.
+ */
+void instrumentAllocation();
+
+/**
+ * @return Matrix storage allocations of the calling thread so far.
+ */
+long instrumentedAllocations();
+
+/**
+ * Adds a forward pass of a layer to its statistics. The bytes touched are the weights, the
+ * bias, the inputs and the outputs. Layers from INSTRUMENT_MAX_LAYERS on are only counted,
+ * the summary says how many of their passes it leaves out.
+ * @param rows, cols - weights shape of the layer
+ * @param nanos wall time of the pass
+ * @param flops, bytes - arithmetic done and memory touched by the pass
+ * @param allocations Matrix allocations during the pass
+ */
+void recordLayer(InstrumentedNetwork network, int layer, int rows, int cols, long nanos,
+                 double flops, double bytes, long allocations);
+
+/**
+ * Writes the summary of every recorded layer to stderr.
+ */
+void printInstrumentation();
+
+/**
+ * @class LayerTimer
+ * @brief Scope guard recording one layer pass: from its construction to its destruction.
+ */
+class LayerTimer
+{
+private:
+    typedef std::chrono::steady_clock Clock;
+    bool _enabled;
+    InstrumentedNetwork _network;
+    int _layer;
+    int _rows;
+    int _cols;
+    double _flops;
+    double _bytes;
+    long _allocations;
+    Clock::time_point _start;
+
+public:
+    /**
+     * @param rows, cols - weights shape of the layer
+     * @param batch number of inputs
+     * @param weightSize bytes per weight
+     */
+    LayerTimer(InstrumentedNetwork network, int layer, int rows, int cols, int batch,
+               size_t weightSize)
+    : _enabled(isInstrumentationEnabled()), _network(network), _layer(layer), _rows(rows),
+      _cols(cols), _flops(2.0 * rows * cols * batch),
+      _bytes((double) weightSize * rows * cols +
+             sizeof(float) * (rows + (rows + cols) * (double) batch)),
+      _allocations(0)
+    {
+        if (_enabled)
+        {
+            _allocations = instrumentedAllocations();
+            _start = Clock::now();
+        }
+    }
+
+    LayerTimer(const LayerTimer &other) = delete;
+    LayerTimer& operator=(const LayerTimer &other) = delete;
+
+    ~LayerTimer()
+    {
+        if (_enabled)
+        {
+            long nanos = (long) std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    Clock::now() - _start).count();
+            recordLayer(_network, _layer, _rows, _cols, nanos, _flops, _bytes,
+                        instrumentedAllocations() - _allocations);
+        }
+    }
+};
+
+/**
+ * Records the rest of the enclosing scope as a pass of the given layer, see LayerTimer.
+ */
+#define INSTRUMENT_LAYER(network, layer, rows, cols, batch, weightSize) \
+    LayerTimer layerTimer((network), (layer), (rows), (cols), (batch), (weightSize))
+#define INSTRUMENT_ALLOCATION() instrumentAllocation()
+
+#else
+
+#define INSTRUMENT_LAYER(network, layer, rows, cols, batch, weightSize)
+#define INSTRUMENT_ALLOCATION()
+
+#endif //MLP_INSTRUMENT
+
+#endif //INSTRUMENT_H
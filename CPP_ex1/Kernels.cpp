@@ -0,0 +1,1555 @@
+// Kernels.cpp
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include "Kernels.h"
+
+#if defined(__x86_64__)
+#define KERNELS_X86
+#include <immintrin.h>
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx2,fma")))
+#endif
+
+// gemv computes GEMV_ROWS outputs at a time, each one with GEMV_LANES partial sums.
+#define GEMV_ROWS 4
+#define GEMV_LANES 8
+// gemmNr of the levels: the accumulators of GEMM_MR rows of one vector each, and the vector
+// of B, fit in the registers (13 of 16 ymm, 13 of 32 zmm), half of them for the portable
+// kernel's two xmm per row (14 of 16).
+#define GEMM_NR_SCALAR 8
+#define GEMM_NR_AVX2 8
+#define GEMM_NR_AVX512 16
+
+// Cephes expf constants: range reduction by ln(2) split in two parts, and a degree 5
+// polynomial for exp on [-ln(2)/2, ln(2)/2].
+#define EXP_HI 88.3762626647949f
+#define EXP_LO -88.3762626647949f
+#define EXP_LOG2E 1.44269504088896341f
+#define EXP_C1 0.693359375f
+#define EXP_C2 -2.12194440e-4f
+#define EXP_P0 1.9875691500E-4f
+#define EXP_P1 1.3981999507E-3f
+#define EXP_P2 8.3334519073E-3f
+#define EXP_P3 4.1665795894E-2f
+#define EXP_P4 1.6666665459E-1f
+#define EXP_P5 5.0000001201E-1f
+#define FLOAT_EXP_BIAS 127
+#define FLOAT_MANTISSA_BITS 23
+
+namespace
+{
+// ------------------------------ Scalar ------------------------------
+
+void addScalar(const float *a, const float *b, float *out, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        out[i] = a[i] + b[i];
+    }
+}
+
+void scaleScalar(const float *a, float c, float *out, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        out[i] = a[i] * c;
+    }
+}
+
+void reluScalar(const float *a, float *out, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        out[i] = a[i] < 0 ? 0 : a[i];
+    }
+}
+
+void expScalar(const float *a, float *out, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        out[i] = std::exp(a[i]);
+    }
+}
+
+float sumScalar(const float *a, int n)
+{
+    float sum = 0;
+    for (int i = 0; i < n; i++)
+    {
+        sum += a[i];
+    }
+    return sum;
+}
+
+float maxScalar(const float *a, int n)
+{
+    float max = a[0];
+    for (int i = 1; i < n; i++)
+    {
+        max = std::max(max, a[i]);
+    }
+    return max;
+}
+
+float expSumScalar(const float *a, float shift, float *out, int n)
+{
+    float sum = 0;
+    for (int i = 0; i < n; i++)
+    {
+        out[i] = std::exp(a[i] - shift);
+        sum += out[i];
+    }
+    return sum;
+}
+
+/**
+ * gemv epilogue: adds the row's bias and applies relu on a finished dot product.
+ */
+inline float epilogue(float sum, const float *bias, int row, bool relu)
+{
+    if (bias != nullptr)
+    {
+        sum += bias[row];
+    }
+    return (relu && sum < 0) ? 0.0f : sum;
+}
+
+/**
+ * Dot product of one row with x, kept in GEMV_LANES independent partial sums.
+ */
+float dotRowScalar(int k, const float *row, const float *x)
+{
+    float lanes[GEMV_LANES] = {};
+    int p = 0;
+    for (; p + GEMV_LANES <= k; p += GEMV_LANES)
+    {
+        for (int l = 0; l < GEMV_LANES; l++)
+        {
+            lanes[l] += row[p + l] * x[p + l];
+        }
+    }
+    float sum = sumScalar(lanes, GEMV_LANES);
+    for (; p < k; p++)
+    {
+        sum += row[p] * x[p];
+    }
+    return sum;
+}
+
+/**
+ * Portable gemv, written with fixed size partial sums so the compiler vectorizes it for the
+ * baseline instruction set.
+ */
+void gemvScalar(int m, int k, const float *a, int lda, const float *x,
+                const float *bias, bool relu, float *y)
+{
+    int i = 0;
+    // GEMV_ROWS rows share every load of x.
+    for (; i + GEMV_ROWS <= m; i += GEMV_ROWS)
+    {
+        float acc[GEMV_ROWS][GEMV_LANES] = {};
+        const float *rowBlock = a + i * lda;
+        int p = 0;
+        for (; p + GEMV_LANES <= k; p += GEMV_LANES)
+        {
+            for (int r = 0; r < GEMV_ROWS; r++)
+            {
+                for (int l = 0; l < GEMV_LANES; l++)
+                {
+                    acc[r][l] += rowBlock[r * lda + p + l] * x[p + l];
+                }
+            }
+        }
+        for (int r = 0; r < GEMV_ROWS; r++)
+        {
+            float sum = sumScalar(acc[r], GEMV_LANES);
+            for (int q = p; q < k; q++)
+            {
+                sum += rowBlock[r * lda + q] * x[q];
+            }
+            y[i + r] = epilogue(sum, bias, i + r, relu);
+        }
+    }
+    for (; i < m; i++)
+    {
+        y[i] = epilogue(dotRowScalar(k, a + i * lda, x), bias, i, relu);
+    }
+}
+
+/**
+ * int8 dot product of row[p..k) with x[p..k), the tail of the vectorized kernels.
+ */
+int32_t dotInt8Scalar(int p, int k, const int8_t *row, const uint8_t *x)
+{
+    int32_t acc = 0;
+    for (; p < k; p++)
+    {
+        acc += row[p] * x[p];
+    }
+    return acc;
+}
+
+void quantizeScalar(const float *a, float scale, uint8_t *out, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        float v = std::min(std::max(a[i] * scale, 0.0f), (float) QUANT_ACTIVATION_MAX);
+        out[i] = (uint8_t) (v + 0.5f);
+    }
+}
+
+/**
+ * y = bias, or 0 without one.
+ */
+void initOutput(int m, const float *bias, float *y)
+{
+    for (int i = 0; i < m; i++)
+    {
+        y[i] = (bias != nullptr) ? bias[i] : 0.0f;
+    }
+}
+
+/**
+ * y[row, row + rows) += xj * values[0, rows).
+ */
+inline void axpyBlockScalar(int rows, const float *values, float xj, float *y)
+{
+    for (int r = 0; r < rows; r++)
+    {
+        y[r] += values[r] * xj;
+    }
+}
+
+/**
+ * Portable sparse gemv, the full blocks are fixed size loops the compiler vectorizes.
+ */
+void gemvSparseScalar(int m, int n, const int *colStart, const int *blockRows,
+                      const float *values, const float *x, const float *bias, bool relu,
+                      float *y)
+{
+    initOutput(m, bias, y);
+    for (int j = 0; j < n; j++)
+    {
+        float xj = x[j];
+        if (xj == 0)
+        {
+            continue;
+        }
+        for (int b = colStart[j]; b < colStart[j + 1]; b++)
+        {
+            int row = blockRows[b];
+            const float *v = values + (size_t) b * SPARSE_BLOCK;
+            if (row + SPARSE_BLOCK <= m)
+            {
+                axpyBlockScalar(SPARSE_BLOCK, v, xj, y + row);
+            }
+            else
+            {
+                axpyBlockScalar(m - row, v, xj, y + row);
+            }
+        }
+    }
+    if (relu)
+    {
+        reluScalar(y, y, m);
+    }
+}
+
+/**
+ * Portable quantized gemv, the int32 loop is vectorized by the compiler.
+ */
+void gemvInt8Scalar(int m, int k, const int8_t *a, int lda, const uint8_t *x,
+                    const float *rowScale, float xScale, const float *bias, bool relu, float *y)
+{
+    for (int i = 0; i < m; i++)
+    {
+        int32_t acc = dotInt8Scalar(0, k, a + i * lda, x);
+        y[i] = epilogue(acc * (rowScale[i] * xScale), bias, i, relu);
+    }
+}
+
+/**
+ * Portable micro-kernel, the fixed size accumulator is kept in vector registers: half the
+ * rows of the tile at a time, the whole tile wouldn't fit in the 16 xmm registers of SSE2.
+ */
+void gemmTileScalar(int kc, const float *a, const float *b, float *c, int ldc, int rows,
+                    int cols, bool accumulate, const float *bias, bool relu)
+{
+    for (int half = 0; half < rows; half += GEMM_MR / 2)
+    {
+        float acc[GEMM_MR / 2][GEMM_NR_SCALAR] = {};
+        const float *panelA = a + half;
+        const float *panelB = b;
+        for (int p = 0; p < kc; p++)
+        {
+            for (int r = 0; r < GEMM_MR / 2; r++)
+            {
+                float av = panelA[r];
+                for (int q = 0; q < GEMM_NR_SCALAR; q++)
+                {
+                    acc[r][q] += av * panelB[q];
+                }
+            }
+            panelA += GEMM_MR;
+            panelB += GEMM_NR_SCALAR;
+        }
+        for (int r = half; r < std::min(half + GEMM_MR / 2, rows); r++)
+        {
+            float *row = c + r * ldc;
+            for (int q = 0; q < cols; q++)
+            {
+                row[q] = epilogue((accumulate ? row[q] : 0.0f) + acc[r - half][q], bias, r,
+                                  relu);
+            }
+        }
+    }
+}
+
+const Kernels scalarKernels = {Scalar, "scalar", addScalar, scaleScalar, reluScalar, expScalar,
+                               sumScalar, maxScalar, expSumScalar, gemvScalar, gemvSparseScalar,
+                               GEMM_NR_SCALAR, gemmTileScalar, gemvInt8Scalar, quantizeScalar};
+
+#ifdef KERNELS_X86
+// ------------------------------ SSE2 ------------------------------
+
+void addSse2(const float *a, const float *b, float *out, int n)
+{
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(out + i, _mm_add_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    addScalar(a + i, b + i, out + i, n - i);
+}
+
+void scaleSse2(const float *a, float c, float *out, int n)
+{
+    __m128 cv = _mm_set1_ps(c);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(out + i, _mm_mul_ps(_mm_loadu_ps(a + i), cv));
+    }
+    scaleScalar(a + i, c, out + i, n - i);
+}
+
+void reluSse2(const float *a, float *out, int n)
+{
+    __m128 zero = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(out + i, _mm_max_ps(_mm_loadu_ps(a + i), zero));
+    }
+    reluScalar(a + i, out + i, n - i);
+}
+
+/**
+ * exp of 4 floats, SSE2 has no floor so it's emulated by truncation and a correction.
+ */
+inline __m128 exp4(__m128 x)
+{
+    x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(EXP_LO)), _mm_set1_ps(EXP_HI));
+    __m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(EXP_LOG2E)), _mm_set1_ps(0.5f));
+    __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+    __m128 overshoot = _mm_and_ps(_mm_cmpgt_ps(truncated, fx), _mm_set1_ps(1.0f));
+    fx = _mm_sub_ps(truncated, overshoot);
+
+    x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(EXP_C1)));
+    x = _mm_sub_ps(x, _mm_mul_ps(fx, _mm_set1_ps(EXP_C2)));
+    __m128 x2 = _mm_mul_ps(x, x);
+    __m128 y = _mm_set1_ps(EXP_P0);
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P1));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P2));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P3));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P4));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P5));
+    y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, x2), x), _mm_set1_ps(1.0f));
+
+    __m128i pow2 = _mm_add_epi32(_mm_cvttps_epi32(fx), _mm_set1_epi32(FLOAT_EXP_BIAS));
+    pow2 = _mm_slli_epi32(pow2, FLOAT_MANTISSA_BITS);
+    return _mm_mul_ps(y, _mm_castsi128_ps(pow2));
+}
+
+void expSse2(const float *a, float *out, int n)
+{
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        _mm_storeu_ps(out + i, exp4(_mm_loadu_ps(a + i)));
+    }
+    if (i < n)
+    {
+        float tail[4] = {};
+        std::memcpy(tail, a + i, (n - i) * sizeof(float));
+        _mm_storeu_ps(tail, exp4(_mm_loadu_ps(tail)));
+        std::memcpy(out + i, tail, (n - i) * sizeof(float));
+    }
+}
+
+float sumSse2(const float *a, int n)
+{
+    __m128 acc = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        acc = _mm_add_ps(acc, _mm_loadu_ps(a + i));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sumScalar(a + i, n - i);
+}
+
+inline float hmax128(__m128 v)
+{
+    v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    v = _mm_max_ss(v, _mm_shuffle_ps(v, v, 1));
+    return _mm_cvtss_f32(v);
+}
+
+float maxSse2(const float *a, int n)
+{
+    __m128 acc = _mm_set1_ps(a[0]);
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        acc = _mm_max_ps(acc, _mm_loadu_ps(a + i));
+    }
+    float max = hmax128(acc);
+    for (; i < n; i++)
+    {
+        max = std::max(max, a[i]);
+    }
+    return max;
+}
+
+float expSumSse2(const float *a, float shift, float *out, int n)
+{
+    __m128 sv = _mm_set1_ps(shift);
+    __m128 acc = _mm_setzero_ps();
+    int i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 v = exp4(_mm_sub_ps(_mm_loadu_ps(a + i), sv));
+        _mm_storeu_ps(out + i, v);
+        acc = _mm_add_ps(acc, v);
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, acc);
+    float sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    if (i < n)
+    {
+        float tail[4] = {};
+        std::memcpy(tail, a + i, (n - i) * sizeof(float));
+        _mm_storeu_ps(tail, exp4(_mm_sub_ps(_mm_loadu_ps(tail), sv)));
+        std::memcpy(out + i, tail, (n - i) * sizeof(float));
+        sum += sumScalar(tail, n - i);
+    }
+    return sum;
+}
+
+/**
+ * Quantizes 4 floats to int32 in [0, QUANT_ACTIVATION_MAX], rounding to nearest.
+ */
+inline __m128i quantize4(const float *a, __m128 scale)
+{
+    __m128 v = _mm_mul_ps(_mm_loadu_ps(a), scale);
+    v = _mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(QUANT_ACTIVATION_MAX));
+    return _mm_cvttps_epi32(_mm_add_ps(v, _mm_set1_ps(0.5f)));
+}
+
+void quantizeSse2(const float *a, float scale, uint8_t *out, int n)
+{
+    __m128 sv = _mm_set1_ps(scale);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i lo = _mm_packs_epi32(quantize4(a + i, sv), quantize4(a + i + 4, sv));
+        __m128i hi = _mm_packs_epi32(quantize4(a + i + 8, sv), quantize4(a + i + 12, sv));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_packus_epi16(lo, hi));
+    }
+    quantizeScalar(a + i, scale, out + i, n - i);
+}
+
+/**
+ * 16 int8 weights times 16 activations: both are widened to int16 (SSE2 has no byte
+ * multiply), then vpmaddwd sums the products into 4 int32 lanes.
+ */
+inline __m128i dotInt8x16(const int8_t *a, __m128i xLo, __m128i xHi)
+{
+    __m128i av = _mm_loadu_si128(reinterpret_cast<const __m128i *>(a));
+    // sign extension: the byte lands in the high half of each int16, then shifts back down.
+    __m128i aLo = _mm_srai_epi16(_mm_unpacklo_epi8(av, av), 8);
+    __m128i aHi = _mm_srai_epi16(_mm_unpackhi_epi8(av, av), 8);
+    return _mm_add_epi32(_mm_madd_epi16(aLo, xLo), _mm_madd_epi16(aHi, xHi));
+}
+
+inline int32_t hsum128i(__m128i v)
+{
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4e));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xb1));
+    return _mm_cvtsi128_si32(v);
+}
+
+void gemvInt8Sse2(int m, int k, const int8_t *a, int lda, const uint8_t *x,
+                  const float *rowScale, float xScale, const float *bias, bool relu, float *y)
+{
+    __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + GEMV_ROWS <= m; i += GEMV_ROWS)
+    {
+        const int8_t *r0 = a + i * lda;
+        const int8_t *r1 = r0 + lda;
+        const int8_t *r2 = r1 + lda;
+        const int8_t *r3 = r2 + lda;
+        __m128i acc0 = _mm_setzero_si128();
+        __m128i acc1 = _mm_setzero_si128();
+        __m128i acc2 = _mm_setzero_si128();
+        __m128i acc3 = _mm_setzero_si128();
+        int p = 0;
+        for (; p + 16 <= k; p += 16)
+        {
+            __m128i xv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + p));
+            __m128i xLo = _mm_unpacklo_epi8(xv, zero);
+            __m128i xHi = _mm_unpackhi_epi8(xv, zero);
+            acc0 = _mm_add_epi32(acc0, dotInt8x16(r0 + p, xLo, xHi));
+            acc1 = _mm_add_epi32(acc1, dotInt8x16(r1 + p, xLo, xHi));
+            acc2 = _mm_add_epi32(acc2, dotInt8x16(r2 + p, xLo, xHi));
+            acc3 = _mm_add_epi32(acc3, dotInt8x16(r3 + p, xLo, xHi));
+        }
+        int32_t sums[GEMV_ROWS] = {hsum128i(acc0) + dotInt8Scalar(p, k, r0, x),
+                                   hsum128i(acc1) + dotInt8Scalar(p, k, r1, x),
+                                   hsum128i(acc2) + dotInt8Scalar(p, k, r2, x),
+                                   hsum128i(acc3) + dotInt8Scalar(p, k, r3, x)};
+        for (int r = 0; r < GEMV_ROWS; r++)
+        {
+            y[i + r] = epilogue(sums[r] * (rowScale[i + r] * xScale), bias, i + r, relu);
+        }
+    }
+    for (; i < m; i++)
+    {
+        const int8_t *row = a + i * lda;
+        __m128i acc = _mm_setzero_si128();
+        int p = 0;
+        for (; p + 16 <= k; p += 16)
+        {
+            __m128i xv = _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + p));
+            acc = _mm_add_epi32(acc, dotInt8x16(row + p, _mm_unpacklo_epi8(xv, zero),
+                                                _mm_unpackhi_epi8(xv, zero)));
+        }
+        int32_t sum = hsum128i(acc) + dotInt8Scalar(p, k, row, x);
+        y[i] = epilogue(sum * (rowScale[i] * xScale), bias, i, relu);
+    }
+}
+
+// the portable gemv and micro-kernel are vectorized by the compiler for SSE2 already.
+const Kernels sse2Kernels = {Sse2, "sse2", addSse2, scaleSse2, reluSse2, expSse2, sumSse2,
+                             maxSse2, expSumSse2, gemvScalar, gemvSparseScalar, GEMM_NR_SCALAR,
+                             gemmTileScalar, gemvInt8Sse2, quantizeSse2};
+
+// ------------------------------ AVX2 + FMA ------------------------------
+
+TARGET_AVX2 inline float hsum256(__m256 v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+    return _mm_cvtss_f32(s);
+}
+
+TARGET_AVX2 void addAvx2(const float *a, const float *b, float *out, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    addScalar(a + i, b + i, out + i, n - i);
+}
+
+TARGET_AVX2 void scaleAvx2(const float *a, float c, float *out, int n)
+{
+    __m256 cv = _mm256_set1_ps(c);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(out + i, _mm256_mul_ps(_mm256_loadu_ps(a + i), cv));
+    }
+    scaleScalar(a + i, c, out + i, n - i);
+}
+
+TARGET_AVX2 void reluAvx2(const float *a, float *out, int n)
+{
+    __m256 zero = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(out + i, _mm256_max_ps(_mm256_loadu_ps(a + i), zero));
+    }
+    reluScalar(a + i, out + i, n - i);
+}
+
+TARGET_AVX2 inline __m256 exp8(__m256 x)
+{
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(EXP_LO)), _mm256_set1_ps(EXP_HI));
+    __m256 fx = _mm256_fmadd_ps(x, _mm256_set1_ps(EXP_LOG2E), _mm256_set1_ps(0.5f));
+    fx = _mm256_floor_ps(fx);
+
+    x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(EXP_C1), x);
+    x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(EXP_C2), x);
+    __m256 x2 = _mm256_mul_ps(x, x);
+    __m256 y = _mm256_set1_ps(EXP_P0);
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P1));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P2));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P3));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P4));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P5));
+    y = _mm256_add_ps(_mm256_fmadd_ps(y, x2, x), _mm256_set1_ps(1.0f));
+
+    __m256i pow2 = _mm256_add_epi32(_mm256_cvttps_epi32(fx), _mm256_set1_epi32(FLOAT_EXP_BIAS));
+    pow2 = _mm256_slli_epi32(pow2, FLOAT_MANTISSA_BITS);
+    return _mm256_mul_ps(y, _mm256_castsi256_ps(pow2));
+}
+
+TARGET_AVX2 void expAvx2(const float *a, float *out, int n)
+{
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        _mm256_storeu_ps(out + i, exp8(_mm256_loadu_ps(a + i)));
+    }
+    if (i < n)
+    {
+        float tail[8] = {};
+        std::memcpy(tail, a + i, (n - i) * sizeof(float));
+        _mm256_storeu_ps(tail, exp8(_mm256_loadu_ps(tail)));
+        std::memcpy(out + i, tail, (n - i) * sizeof(float));
+    }
+}
+
+TARGET_AVX2 float sumAvx2(const float *a, int n)
+{
+    __m256 acc = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        acc = _mm256_add_ps(acc, _mm256_loadu_ps(a + i));
+    }
+    return hsum256(acc) + sumScalar(a + i, n - i);
+}
+
+TARGET_AVX2 float maxAvx2(const float *a, int n)
+{
+    __m256 acc = _mm256_set1_ps(a[0]);
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        acc = _mm256_max_ps(acc, _mm256_loadu_ps(a + i));
+    }
+    float max = hmax128(_mm_max_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1)));
+    for (; i < n; i++)
+    {
+        max = std::max(max, a[i]);
+    }
+    return max;
+}
+
+TARGET_AVX2 float expSumAvx2(const float *a, float shift, float *out, int n)
+{
+    __m256 sv = _mm256_set1_ps(shift);
+    __m256 acc = _mm256_setzero_ps();
+    int i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256 v = exp8(_mm256_sub_ps(_mm256_loadu_ps(a + i), sv));
+        _mm256_storeu_ps(out + i, v);
+        acc = _mm256_add_ps(acc, v);
+    }
+    float sum = hsum256(acc);
+    if (i < n)
+    {
+        float tail[8] = {};
+        std::memcpy(tail, a + i, (n - i) * sizeof(float));
+        _mm256_storeu_ps(tail, exp8(_mm256_sub_ps(_mm256_loadu_ps(tail), sv)));
+        std::memcpy(out + i, tail, (n - i) * sizeof(float));
+        sum += sumScalar(tail, n - i);
+    }
+    return sum;
+}
+
+TARGET_AVX2 void gemvSparseAvx2(int m, int n, const int *colStart, const int *blockRows,
+                                const float *values, const float *x, const float *bias,
+                                bool relu, float *y)
+{
+    initOutput(m, bias, y);
+    for (int j = 0; j < n; j++)
+    {
+        if (x[j] == 0)
+        {
+            continue;
+        }
+        __m256 xj = _mm256_set1_ps(x[j]);
+        for (int b = colStart[j]; b < colStart[j + 1]; b++)
+        {
+            int row = blockRows[b];
+            const float *v = values + (size_t) b * SPARSE_BLOCK;
+            if (row + SPARSE_BLOCK > m)
+            {
+                axpyBlockScalar(m - row, v, x[j], y + row);
+                continue;
+            }
+            for (int r = 0; r < SPARSE_BLOCK; r += 8)
+            {
+                _mm256_storeu_ps(y + row + r, _mm256_fmadd_ps(_mm256_loadu_ps(v + r), xj,
+                                                              _mm256_loadu_ps(y + row + r)));
+            }
+        }
+    }
+    if (relu)
+    {
+        reluAvx2(y, y, m);
+    }
+}
+
+TARGET_AVX2 void gemvAvx2(int m, int k, const float *a, int lda, const float *x,
+                          const float *bias, bool relu, float *y)
+{
+    int i = 0;
+    for (; i + GEMV_ROWS <= m; i += GEMV_ROWS)
+    {
+        const float *r0 = a + i * lda;
+        const float *r1 = r0 + lda;
+        const float *r2 = r1 + lda;
+        const float *r3 = r2 + lda;
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        __m256 acc2 = _mm256_setzero_ps();
+        __m256 acc3 = _mm256_setzero_ps();
+        int p = 0;
+        for (; p + 8 <= k; p += 8)
+        {
+            __m256 xv = _mm256_loadu_ps(x + p);
+            acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(r0 + p), xv, acc0);
+            acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(r1 + p), xv, acc1);
+            acc2 = _mm256_fmadd_ps(_mm256_loadu_ps(r2 + p), xv, acc2);
+            acc3 = _mm256_fmadd_ps(_mm256_loadu_ps(r3 + p), xv, acc3);
+        }
+        float sums[GEMV_ROWS] = {hsum256(acc0), hsum256(acc1), hsum256(acc2), hsum256(acc3)};
+        for (; p < k; p++)
+        {
+            sums[0] += r0[p] * x[p];
+            sums[1] += r1[p] * x[p];
+            sums[2] += r2[p] * x[p];
+            sums[3] += r3[p] * x[p];
+        }
+        for (int r = 0; r < GEMV_ROWS; r++)
+        {
+            y[i + r] = epilogue(sums[r], bias, i + r, relu);
+        }
+    }
+    for (; i < m; i++)
+    {
+        const float *row = a + i * lda;
+        __m256 acc = _mm256_setzero_ps();
+        int p = 0;
+        for (; p + 8 <= k; p += 8)
+        {
+            acc = _mm256_fmadd_ps(_mm256_loadu_ps(row + p), _mm256_loadu_ps(x + p), acc);
+        }
+        float sum = hsum256(acc);
+        for (; p < k; p++)
+        {
+            sum += row[p] * x[p];
+        }
+        y[i] = epilogue(sum, bias, i, relu);
+    }
+}
+
+/**
+ * One ymm accumulator per tile row. The edge tiles load and store the cols inside C through
+ * a mask.
+ */
+TARGET_AVX2 void gemmTileAvx2(int kc, const float *a, const float *b, float *c, int ldc,
+                              int rows, int cols, bool accumulate, const float *bias, bool relu)
+{
+    __m256 acc[GEMM_MR];
+    // unrolled at least GEMM_MR times, fully: the accumulators stay in registers.
+#pragma GCC unroll 16
+    for (int r = 0; r < GEMM_MR; r++)
+    {
+        acc[r] = _mm256_setzero_ps();
+    }
+    for (int p = 0; p < kc; p++)
+    {
+        __m256 bv = _mm256_loadu_ps(b);
+#pragma GCC unroll 16
+        for (int r = 0; r < GEMM_MR; r++)
+        {
+            acc[r] = _mm256_fmadd_ps(_mm256_broadcast_ss(a + r), bv, acc[r]);
+        }
+        a += GEMM_MR;
+        b += GEMM_NR_AVX2;
+    }
+    // lanes below cols are all ones.
+    __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(cols),
+                                      _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    __m256 zero = _mm256_setzero_ps();
+#pragma GCC unroll 16
+    for (int r = 0; r < GEMM_MR; r++)
+    {
+        if (r >= rows)
+        {
+            break;
+        }
+        float *row = c + r * ldc;
+        __m256 v = acc[r];
+        if (accumulate)
+        {
+            v = _mm256_add_ps(v, cols == GEMM_NR_AVX2 ? _mm256_loadu_ps(row) :
+                                 _mm256_maskload_ps(row, mask));
+        }
+        if (bias != nullptr)
+        {
+            v = _mm256_add_ps(v, _mm256_broadcast_ss(bias + r));
+        }
+        if (relu)
+        {
+            v = _mm256_max_ps(v, zero);
+        }
+        if (cols == GEMM_NR_AVX2)
+        {
+            _mm256_storeu_ps(row, v);
+        }
+        else
+        {
+            _mm256_maskstore_ps(row, mask, v);
+        }
+    }
+}
+
+TARGET_AVX2 inline int32_t hsum256i(__m256i v)
+{
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    return _mm_cvtsi128_si32(s);
+}
+
+/**
+ * Horizontal sums of 4 vectors at once, transposing as it adds.
+ * @return {sum(a0), sum(a1), sum(a2), sum(a3)}
+ */
+TARGET_AVX2 inline __m128i hsum4x256i(__m256i a0, __m256i a1, __m256i a2, __m256i a3)
+{
+    __m256i t0 = _mm256_add_epi32(_mm256_unpacklo_epi32(a0, a1), _mm256_unpackhi_epi32(a0, a1));
+    __m256i t1 = _mm256_add_epi32(_mm256_unpacklo_epi32(a2, a3), _mm256_unpackhi_epi32(a2, a3));
+    __m256i u = _mm256_add_epi32(_mm256_unpacklo_epi64(t0, t1), _mm256_unpackhi_epi64(t0, t1));
+    return _mm_add_epi32(_mm256_castsi256_si128(u), _mm256_extracti128_si256(u, 1));
+}
+
+/**
+ * Quantizes 8 floats to int32 in [0, QUANT_ACTIVATION_MAX], rounding to nearest.
+ */
+TARGET_AVX2 inline __m256i quantize8(const float *a, __m256 scale)
+{
+    __m256 v = _mm256_mul_ps(_mm256_loadu_ps(a), scale);
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()),
+                      _mm256_set1_ps(QUANT_ACTIVATION_MAX));
+    return _mm256_cvttps_epi32(_mm256_add_ps(v, _mm256_set1_ps(0.5f)));
+}
+
+/**
+ * Quantizes 32 floats to 32 bytes.
+ */
+TARGET_AVX2 inline void quantize32(const float *a, __m256 scale, uint8_t *out)
+{
+    __m256i lo = _mm256_packs_epi32(quantize8(a, scale), quantize8(a + 8, scale));
+    __m256i hi = _mm256_packs_epi32(quantize8(a + 16, scale), quantize8(a + 24, scale));
+    // packs work within 128 bit lanes, the permutation puts the 4 x 8 values back in order.
+    __m256i packed = _mm256_permutevar8x32_epi32(_mm256_packus_epi16(lo, hi),
+                                                 _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out), packed);
+}
+
+TARGET_AVX2 void quantizeAvx2(const float *a, float scale, uint8_t *out, int n)
+{
+    __m256 sv = _mm256_set1_ps(scale);
+    int i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        quantize32(a + i, sv, out + i);
+    }
+    // the tail is inlined rather than handed to quantizeScalar, which is compiled without
+    // VEX encoding and would pay for the AVX to SSE transition.
+    for (; i < n; i++)
+    {
+        float v = std::min(std::max(a[i] * scale, 0.0f), (float) QUANT_ACTIVATION_MAX);
+        out[i] = (uint8_t) (v + 0.5f);
+    }
+}
+
+/**
+ * 32 uint8 activations times 32 int8 weights: vpmaddubsw sums adjacent products to int16,
+ * which can't saturate since activations stop at QUANT_ACTIVATION_MAX, then vpmaddwd adds
+ * the int16 pairs into 8 int32 lanes.
+ */
+TARGET_AVX2 inline __m256i dotInt8x32(const int8_t *a, __m256i x, __m256i ones)
+{
+    __m256i av = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(a));
+    return _mm256_madd_epi16(_mm256_maddubs_epi16(x, av), ones);
+}
+
+/**
+ * Dot product of row[p..k) with x[p..k): 16 elements at a time widened to int16, then the
+ * scalar tail.
+ */
+TARGET_AVX2 inline int32_t dotInt8TailAvx2(int p, int k, const int8_t *row, const uint8_t *x)
+{
+    int32_t sum = 0;
+    for (; p + 16 <= k; p += 16)
+    {
+        __m256i a16 = _mm256_cvtepi8_epi16(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + p)));
+        __m256i x16 = _mm256_cvtepu8_epi16(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + p)));
+        sum += hsum256i(_mm256_madd_epi16(a16, x16));
+    }
+    return sum + dotInt8Scalar(p, k, row, x);
+}
+
+TARGET_AVX2 void gemvInt8Avx2(int m, int k, const int8_t *a, int lda, const uint8_t *x,
+                              const float *rowScale, float xScale, const float *bias, bool relu,
+                              float *y)
+{
+    __m256i ones = _mm256_set1_epi16(1);
+    int i = 0;
+    for (; i + GEMV_ROWS <= m; i += GEMV_ROWS)
+    {
+        const int8_t *r0 = a + i * lda;
+        const int8_t *r1 = r0 + lda;
+        const int8_t *r2 = r1 + lda;
+        const int8_t *r3 = r2 + lda;
+        __m256i acc0 = _mm256_setzero_si256();
+        __m256i acc1 = _mm256_setzero_si256();
+        __m256i acc2 = _mm256_setzero_si256();
+        __m256i acc3 = _mm256_setzero_si256();
+        int p = 0;
+        for (; p + 32 <= k; p += 32)
+        {
+            __m256i xv = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + p));
+            acc0 = _mm256_add_epi32(acc0, dotInt8x32(r0 + p, xv, ones));
+            acc1 = _mm256_add_epi32(acc1, dotInt8x32(r1 + p, xv, ones));
+            acc2 = _mm256_add_epi32(acc2, dotInt8x32(r2 + p, xv, ones));
+            acc3 = _mm256_add_epi32(acc3, dotInt8x32(r3 + p, xv, ones));
+        }
+        int32_t sums[GEMV_ROWS];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(sums), hsum4x256i(acc0, acc1, acc2, acc3));
+        if (p < k)
+        {
+            sums[0] += dotInt8TailAvx2(p, k, r0, x);
+            sums[1] += dotInt8TailAvx2(p, k, r1, x);
+            sums[2] += dotInt8TailAvx2(p, k, r2, x);
+            sums[3] += dotInt8TailAvx2(p, k, r3, x);
+        }
+        for (int r = 0; r < GEMV_ROWS; r++)
+        {
+            y[i + r] = epilogue(sums[r] * (rowScale[i + r] * xScale), bias, i + r, relu);
+        }
+    }
+    for (; i < m; i++)
+    {
+        const int8_t *row = a + i * lda;
+        __m256i acc = _mm256_setzero_si256();
+        int p = 0;
+        for (; p + 32 <= k; p += 32)
+        {
+            __m256i xv = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + p));
+            acc = _mm256_add_epi32(acc, dotInt8x32(row + p, xv, ones));
+        }
+        int32_t sum = hsum256i(acc) + dotInt8TailAvx2(p, k, row, x);
+        y[i] = epilogue(sum * (rowScale[i] * xScale), bias, i, relu);
+    }
+}
+
+const Kernels avx2Kernels = {Avx2, "avx2", addAvx2, scaleAvx2, reluAvx2, expAvx2, sumAvx2,
+                             maxAvx2, expSumAvx2, gemvAvx2, gemvSparseAvx2, GEMM_NR_AVX2,
+                             gemmTileAvx2, gemvInt8Avx2, quantizeAvx2};
+
+// ------------------------------ AVX-512 ------------------------------
+
+TARGET_AVX512 inline __mmask16 tailMask(int remaining)
+{
+    return (__mmask16) ((1u << remaining) - 1u);
+}
+
+// gcc 12's avx512 intrinsics below start from _mm512_undefined_*(), which trips its own
+// (maybe-)uninitialized warnings once inlined (gcc bug 105593, fixed in gcc 13). The kernels
+// only call them through these wrappers, the warnings are off for the wrappers alone.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+TARGET_AVX512 inline __m512 max512(__m512 a, __m512 b)
+{
+    return _mm512_max_ps(a, b);
+}
+
+TARGET_AVX512 inline __m512 min512(__m512 a, __m512 b)
+{
+    return _mm512_min_ps(a, b);
+}
+
+TARGET_AVX512 inline __m512 floor512(__m512 x)
+{
+    return _mm512_roundscale_ps(x, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+}
+
+/**
+ * @return x converted to int32, truncated.
+ */
+TARGET_AVX512 inline __m512i truncate512(__m512 x)
+{
+    return _mm512_cvttps_epi32(x);
+}
+
+/**
+ * @return the floats of the biased exponents e, 2^(e - FLOAT_EXP_BIAS).
+ */
+TARGET_AVX512 inline __m512 pow2Of512(__m512i e)
+{
+    return _mm512_castsi512_ps(_mm512_slli_epi32(e, FLOAT_MANTISSA_BITS));
+}
+
+/**
+ * @return the low bytes of the int32 lanes of v.
+ */
+TARGET_AVX512 inline __m128i narrow512(__m512i v)
+{
+    return _mm512_cvtepi32_epi8(v);
+}
+
+TARGET_AVX512 inline float hsum512(__m512 v)
+{
+    return _mm512_reduce_add_ps(v);
+}
+
+TARGET_AVX512 inline float hmax512(__m512 v)
+{
+    return _mm512_reduce_max_ps(v);
+}
+
+TARGET_AVX512 inline int32_t hsum512i(__m512i v)
+{
+    return _mm512_reduce_add_epi32(v);
+}
+
+/**
+ * Horizontal sums of 4 vectors at once, see hsum4x256i.
+ * @return {sum(a0), sum(a1), sum(a2), sum(a3)}
+ */
+TARGET_AVX512 inline __m128i hsum4x512i(__m512i a0, __m512i a1, __m512i a2, __m512i a3)
+{
+    __m512i t0 = _mm512_add_epi32(_mm512_unpacklo_epi32(a0, a1), _mm512_unpackhi_epi32(a0, a1));
+    __m512i t1 = _mm512_add_epi32(_mm512_unpacklo_epi32(a2, a3), _mm512_unpackhi_epi32(a2, a3));
+    __m512i u = _mm512_add_epi32(_mm512_unpacklo_epi64(t0, t1), _mm512_unpackhi_epi64(t0, t1));
+    __m256i h = _mm256_add_epi32(_mm512_castsi512_si256(u), _mm512_extracti64x4_epi64(u, 1));
+    return _mm_add_epi32(_mm256_castsi256_si128(h), _mm256_extracti128_si256(h, 1));
+}
+
+#pragma GCC diagnostic pop
+
+TARGET_AVX512 void addAvx512(const float *a, const float *b, float *out, int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        _mm512_storeu_ps(out + i, _mm512_add_ps(_mm512_loadu_ps(a + i), _mm512_loadu_ps(b + i)));
+    }
+    if (i < n)
+    {
+        __mmask16 mask = tailMask(n - i);
+        __m512 sum = _mm512_add_ps(_mm512_maskz_loadu_ps(mask, a + i),
+                                   _mm512_maskz_loadu_ps(mask, b + i));
+        _mm512_mask_storeu_ps(out + i, mask, sum);
+    }
+}
+
+TARGET_AVX512 void scaleAvx512(const float *a, float c, float *out, int n)
+{
+    __m512 cv = _mm512_set1_ps(c);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        _mm512_storeu_ps(out + i, _mm512_mul_ps(_mm512_loadu_ps(a + i), cv));
+    }
+    if (i < n)
+    {
+        __mmask16 mask = tailMask(n - i);
+        _mm512_mask_storeu_ps(out + i, mask,
+                              _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, a + i), cv));
+    }
+}
+
+TARGET_AVX512 void reluAvx512(const float *a, float *out, int n)
+{
+    __m512 zero = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        _mm512_storeu_ps(out + i, max512(_mm512_loadu_ps(a + i), zero));
+    }
+    if (i < n)
+    {
+        __mmask16 mask = tailMask(n - i);
+        _mm512_mask_storeu_ps(out + i, mask,
+                              max512(_mm512_maskz_loadu_ps(mask, a + i), zero));
+    }
+}
+
+TARGET_AVX512 inline __m512 exp16(__m512 x)
+{
+    x = min512(max512(x, _mm512_set1_ps(EXP_LO)), _mm512_set1_ps(EXP_HI));
+    __m512 fx = _mm512_fmadd_ps(x, _mm512_set1_ps(EXP_LOG2E), _mm512_set1_ps(0.5f));
+    fx = floor512(fx);
+
+    x = _mm512_fnmadd_ps(fx, _mm512_set1_ps(EXP_C1), x);
+    x = _mm512_fnmadd_ps(fx, _mm512_set1_ps(EXP_C2), x);
+    __m512 x2 = _mm512_mul_ps(x, x);
+    __m512 y = _mm512_set1_ps(EXP_P0);
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(EXP_P1));
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(EXP_P2));
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(EXP_P3));
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(EXP_P4));
+    y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(EXP_P5));
+    y = _mm512_add_ps(_mm512_fmadd_ps(y, x2, x), _mm512_set1_ps(1.0f));
+
+    __m512i pow2 = _mm512_add_epi32(truncate512(fx), _mm512_set1_epi32(FLOAT_EXP_BIAS));
+    return _mm512_mul_ps(y, pow2Of512(pow2));
+}
+
+TARGET_AVX512 void expAvx512(const float *a, float *out, int n)
+{
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        _mm512_storeu_ps(out + i, exp16(_mm512_loadu_ps(a + i)));
+    }
+    if (i < n)
+    {
+        __mmask16 mask = tailMask(n - i);
+        _mm512_mask_storeu_ps(out + i, mask, exp16(_mm512_maskz_loadu_ps(mask, a + i)));
+    }
+}
+
+TARGET_AVX512 float sumAvx512(const float *a, int n)
+{
+    __m512 acc = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        acc = _mm512_add_ps(acc, _mm512_loadu_ps(a + i));
+    }
+    if (i < n)
+    {
+        acc = _mm512_add_ps(acc, _mm512_maskz_loadu_ps(tailMask(n - i), a + i));
+    }
+    return hsum512(acc);
+}
+
+TARGET_AVX512 float maxAvx512(const float *a, int n)
+{
+    __m512 acc = _mm512_set1_ps(a[0]);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        acc = max512(acc, _mm512_loadu_ps(a + i));
+    }
+    if (i < n)
+    {
+        __mmask16 mask = tailMask(n - i);
+        acc = _mm512_mask_max_ps(acc, mask, acc, _mm512_maskz_loadu_ps(mask, a + i));
+    }
+    return hmax512(acc);
+}
+
+TARGET_AVX512 float expSumAvx512(const float *a, float shift, float *out, int n)
+{
+    __m512 sv = _mm512_set1_ps(shift);
+    __m512 acc = _mm512_setzero_ps();
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512 v = exp16(_mm512_sub_ps(_mm512_loadu_ps(a + i), sv));
+        _mm512_storeu_ps(out + i, v);
+        acc = _mm512_add_ps(acc, v);
+    }
+    if (i < n)
+    {
+        __mmask16 mask = tailMask(n - i);
+        __m512 v = exp16(_mm512_sub_ps(_mm512_maskz_loadu_ps(mask, a + i), sv));
+        _mm512_mask_storeu_ps(out + i, mask, v);
+        acc = _mm512_mask_add_ps(acc, mask, acc, v);
+    }
+    return hsum512(acc);
+}
+
+TARGET_AVX512 void gemvSparseAvx512(int m, int n, const int *colStart, const int *blockRows,
+                                  const float *values, const float *x, const float *bias,
+                                  bool relu, float *y)
+{
+    initOutput(m, bias, y);
+    for (int j = 0; j < n; j++)
+    {
+        if (x[j] == 0)
+        {
+            continue;
+        }
+        __m512 xj = _mm512_set1_ps(x[j]);
+        for (int b = colStart[j]; b < colStart[j + 1]; b++)
+        {
+            int row = blockRows[b];
+            __m512 v = _mm512_loadu_ps(values + (size_t) b * SPARSE_BLOCK);
+            if (row + SPARSE_BLOCK <= m)
+            {
+                _mm512_storeu_ps(y + row, _mm512_fmadd_ps(v, xj, _mm512_loadu_ps(y + row)));
+            }
+            else
+            {
+                __mmask16 mask = tailMask(m - row);
+                _mm512_mask_storeu_ps(y + row, mask, _mm512_fmadd_ps(
+                        v, xj, _mm512_maskz_loadu_ps(mask, y + row)));
+            }
+        }
+    }
+    if (relu)
+    {
+        reluAvx512(y, y, m);
+    }
+}
+
+TARGET_AVX512 void gemvAvx512(int m, int k, const float *a, int lda, const float *x,
+                              const float *bias, bool relu, float *y)
+{
+    int tail = k % 16;
+    __mmask16 mask = tailMask(tail);
+    int i = 0;
+    for (; i + GEMV_ROWS <= m; i += GEMV_ROWS)
+    {
+        const float *r0 = a + i * lda;
+        const float *r1 = r0 + lda;
+        const float *r2 = r1 + lda;
+        const float *r3 = r2 + lda;
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        __m512 acc2 = _mm512_setzero_ps();
+        __m512 acc3 = _mm512_setzero_ps();
+        int p = 0;
+        for (; p + 16 <= k; p += 16)
+        {
+            __m512 xv = _mm512_loadu_ps(x + p);
+            acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(r0 + p), xv, acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_loadu_ps(r1 + p), xv, acc1);
+            acc2 = _mm512_fmadd_ps(_mm512_loadu_ps(r2 + p), xv, acc2);
+            acc3 = _mm512_fmadd_ps(_mm512_loadu_ps(r3 + p), xv, acc3);
+        }
+        if (tail)
+        {
+            __m512 xv = _mm512_maskz_loadu_ps(mask, x + p);
+            acc0 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, r0 + p), xv, acc0);
+            acc1 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, r1 + p), xv, acc1);
+            acc2 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, r2 + p), xv, acc2);
+            acc3 = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, r3 + p), xv, acc3);
+        }
+        y[i] = epilogue(hsum512(acc0), bias, i, relu);
+        y[i + 1] = epilogue(hsum512(acc1), bias, i + 1, relu);
+        y[i + 2] = epilogue(hsum512(acc2), bias, i + 2, relu);
+        y[i + 3] = epilogue(hsum512(acc3), bias, i + 3, relu);
+    }
+    for (; i < m; i++)
+    {
+        const float *row = a + i * lda;
+        __m512 acc = _mm512_setzero_ps();
+        int p = 0;
+        for (; p + 16 <= k; p += 16)
+        {
+            acc = _mm512_fmadd_ps(_mm512_loadu_ps(row + p), _mm512_loadu_ps(x + p), acc);
+        }
+        if (tail)
+        {
+            acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, row + p),
+                                  _mm512_maskz_loadu_ps(mask, x + p), acc);
+        }
+        y[i] = epilogue(hsum512(acc), bias, i, relu);
+    }
+}
+
+TARGET_AVX512 void quantizeAvx512(const float *a, float scale, uint8_t *out, int n)
+{
+    __m512 sv = _mm512_set1_ps(scale);
+    __m512 zero = _mm512_setzero_ps();
+    __m512 maxv = _mm512_set1_ps(QUANT_ACTIVATION_MAX);
+    __m512 half = _mm512_set1_ps(0.5f);
+    int i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m512 v = _mm512_mul_ps(_mm512_loadu_ps(a + i), sv);
+        v = min512(max512(v, zero), maxv);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i),
+                         narrow512(truncate512(_mm512_add_ps(v, half))));
+    }
+    if (i < n)
+    {
+        __mmask16 mask = tailMask(n - i);
+        __m512 v = _mm512_mul_ps(_mm512_maskz_loadu_ps(mask, a + i), sv);
+        v = min512(max512(v, zero), maxv);
+        _mm512_mask_cvtepi32_storeu_epi8(out + i, mask,
+                                         truncate512(_mm512_add_ps(v, half)));
+    }
+}
+
+/**
+ * @return mask of the first remaining (< 64) bytes.
+ */
+TARGET_AVX512 inline __mmask64 byteTailMask(int remaining)
+{
+    return (__mmask64) ((1ull << remaining) - 1ull);
+}
+
+/**
+ * 64 uint8 activations times 64 int8 weights summed into 16 int32 lanes, see dotInt8x32.
+ */
+TARGET_AVX512 inline __m512i dotInt8x64(__m512i a, __m512i x, __m512i ones)
+{
+    return _mm512_madd_epi16(_mm512_maddubs_epi16(x, a), ones);
+}
+
+TARGET_AVX512 void gemvInt8Avx512(int m, int k, const int8_t *a, int lda, const uint8_t *x,
+                                  const float *rowScale, float xScale, const float *bias,
+                                  bool relu, float *y)
+{
+    __m512i ones = _mm512_set1_epi16(1);
+    int i = 0;
+    for (; i + GEMV_ROWS <= m; i += GEMV_ROWS)
+    {
+        const int8_t *r0 = a + i * lda;
+        const int8_t *r1 = r0 + lda;
+        const int8_t *r2 = r1 + lda;
+        const int8_t *r3 = r2 + lda;
+        __m512i acc0 = _mm512_setzero_si512();
+        __m512i acc1 = _mm512_setzero_si512();
+        __m512i acc2 = _mm512_setzero_si512();
+        __m512i acc3 = _mm512_setzero_si512();
+        int p = 0;
+        for (; p + 64 <= k; p += 64)
+        {
+            __m512i xv = _mm512_loadu_si512(x + p);
+            acc0 = _mm512_add_epi32(acc0, dotInt8x64(_mm512_loadu_si512(r0 + p), xv, ones));
+            acc1 = _mm512_add_epi32(acc1, dotInt8x64(_mm512_loadu_si512(r1 + p), xv, ones));
+            acc2 = _mm512_add_epi32(acc2, dotInt8x64(_mm512_loadu_si512(r2 + p), xv, ones));
+            acc3 = _mm512_add_epi32(acc3, dotInt8x64(_mm512_loadu_si512(r3 + p), xv, ones));
+        }
+        if (p < k)
+        {
+            __mmask64 mask = byteTailMask(k - p);
+            __m512i xv = _mm512_maskz_loadu_epi8(mask, x + p);
+            __m512i a0 = _mm512_maskz_loadu_epi8(mask, r0 + p);
+            __m512i a1 = _mm512_maskz_loadu_epi8(mask, r1 + p);
+            __m512i a2 = _mm512_maskz_loadu_epi8(mask, r2 + p);
+            __m512i a3 = _mm512_maskz_loadu_epi8(mask, r3 + p);
+            acc0 = _mm512_add_epi32(acc0, dotInt8x64(a0, xv, ones));
+            acc1 = _mm512_add_epi32(acc1, dotInt8x64(a1, xv, ones));
+            acc2 = _mm512_add_epi32(acc2, dotInt8x64(a2, xv, ones));
+            acc3 = _mm512_add_epi32(acc3, dotInt8x64(a3, xv, ones));
+        }
+        int32_t sums[GEMV_ROWS];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(sums), hsum4x512i(acc0, acc1, acc2, acc3));
+        for (int r = 0; r < GEMV_ROWS; r++)
+        {
+            y[i + r] = epilogue(sums[r] * (rowScale[i + r] * xScale), bias, i + r, relu);
+        }
+    }
+    for (; i < m; i++)
+    {
+        const int8_t *row = a + i * lda;
+        __m512i acc = _mm512_setzero_si512();
+        int p = 0;
+        for (; p + 64 <= k; p += 64)
+        {
+            acc = _mm512_add_epi32(acc, dotInt8x64(_mm512_loadu_si512(row + p),
+                                                   _mm512_loadu_si512(x + p), ones));
+        }
+        if (p < k)
+        {
+            __mmask64 mask = byteTailMask(k - p);
+            acc = _mm512_add_epi32(acc, dotInt8x64(_mm512_maskz_loadu_epi8(mask, row + p),
+                                                   _mm512_maskz_loadu_epi8(mask, x + p), ones));
+        }
+        y[i] = epilogue(hsum512i(acc) * (rowScale[i] * xScale), bias, i, relu);
+    }
+}
+
+/**
+ * One zmm accumulator per tile row, the A values are broadcast from memory by the fmas. The
+ * edge tiles load and store the cols inside C through a mask.
+ */
+TARGET_AVX512 void gemmTileAvx512(int kc, const float *a, const float *b, float *c, int ldc,
+                                  int rows, int cols, bool accumulate, const float *bias,
+                                  bool relu)
+{
+    __m512 acc[GEMM_MR];
+    // unrolled at least GEMM_MR times, fully: the accumulators stay in registers.
+#pragma GCC unroll 16
+    for (int r = 0; r < GEMM_MR; r++)
+    {
+        acc[r] = _mm512_setzero_ps();
+    }
+    for (int p = 0; p < kc; p++)
+    {
+        __m512 bv = _mm512_loadu_ps(b);
+#pragma GCC unroll 16
+        for (int r = 0; r < GEMM_MR; r++)
+        {
+            acc[r] = _mm512_fmadd_ps(_mm512_set1_ps(a[r]), bv, acc[r]);
+        }
+        a += GEMM_MR;
+        b += GEMM_NR_AVX512;
+    }
+    __mmask16 mask = cols == GEMM_NR_AVX512 ? (__mmask16) 0xFFFF : tailMask(cols);
+    __m512 zero = _mm512_setzero_ps();
+#pragma GCC unroll 16
+    for (int r = 0; r < GEMM_MR; r++)
+    {
+        if (r >= rows)
+        {
+            break;
+        }
+        float *row = c + r * ldc;
+        __m512 v = acc[r];
+        if (accumulate)
+        {
+            v = _mm512_add_ps(v, _mm512_maskz_loadu_ps(mask, row));
+        }
+        if (bias != nullptr)
+        {
+            v = _mm512_add_ps(v, _mm512_set1_ps(bias[r]));
+        }
+        if (relu)
+        {
+            v = max512(v, zero);
+        }
+        _mm512_mask_storeu_ps(row, mask, v);
+    }
+}
+
+const Kernels avx512Kernels = {Avx512, "avx512", addAvx512, scaleAvx512, reluAvx512, expAvx512,
+                               sumAvx512, maxAvx512, expSumAvx512, gemvAvx512,
+                               gemvSparseAvx512, GEMM_NR_AVX512, gemmTileAvx512,
+                               gemvInt8Avx512, quantizeAvx512};
+#endif
+
+/**
+ * @return true if the running cpu can execute the given level.
+ */
+bool cpuSupports(SimdLevel level)
+{
+#ifdef KERNELS_X86
+    __builtin_cpu_init();
+    switch (level)
+    {
+        case Scalar:
+            return true;
+        case Sse2:
+            return __builtin_cpu_supports("sse2");
+        case Avx2:
+            return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+        case Avx512:
+            return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+                   __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+    return false;
+#else
+    return level == Scalar;
+#endif
+}
+
+/**
+ * Picks the strongest supported table, capped by the MLP_SIMD environment variable.
+ */
+const Kernels &selectKernels()
+{
+    SimdLevel cap = Avx512;
+    const char *env = std::getenv(SIMD_ENV_VAR);
+    if (env != nullptr)
+    {
+        const Kernels *tables[] = {&scalarKernels,
+#ifdef KERNELS_X86
+                                   &sse2Kernels, &avx2Kernels, &avx512Kernels
+#endif
+        };
+        for (const Kernels *table : tables)
+        {
+            if (std::strcmp(env, table->name) == 0)
+            {
+                cap = table->level;
+            }
+        }
+    }
+    for (int level = cap; level > Scalar; level--)
+    {
+        const Kernels *table = kernelsFor((SimdLevel) level);
+        if (table != nullptr)
+        {
+            return *table;
+        }
+    }
+    return scalarKernels;
+}
+}
+
+const Kernels *kernelsFor(SimdLevel level)
+{
+    if (!cpuSupports(level))
+    {
+        return nullptr;
+    }
+    switch (level)
+    {
+        case Scalar:
+            return &scalarKernels;
+#ifdef KERNELS_X86
+        case Sse2:
+            return &sse2Kernels;
+        case Avx2:
+            return &avx2Kernels;
+        case Avx512:
+            return &avx512Kernels;
+#endif
+        default:
+            return nullptr;
+    }
+}
+
+const Kernels &kernels()
+{
+    static const Kernels &active = selectKernels();
+    return active;
+}
+
+const Kernels &kernelsForWidth(int n)
+{
+    // floats per vector of every SimdLevel.
+    static const int lanes[] = {1, 4, 8, 16};
+    for (int level = kernels().level; level > Scalar; level--)
+    {
+        const Kernels *table = kernelsFor((SimdLevel) level);
+        if (table != nullptr && lanes[level] <= n)
+        {
+            return *table;
+        }
+    }
+    return scalarKernels;
+}
@@ -0,0 +1,137 @@
+// Kernels.h
+
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstdint>
+
+// rows of A of the register tile of the gemm micro-kernels, which is GEMM_MR rows by the
+// gemmNr cols of B of the level's table. The same on every level, so that an A packed once
+// (see packGemmA) suits them all.
+#define GEMM_MR 12
+// rows of a block of a sparse matrix column (see SparseMatrix): one AVX-512 vector.
+#define SPARSE_BLOCK 16
+
+#define SIMD_ENV_VAR "MLP_SIMD"
+
+// relative error bound (two float ulps) of the exp kernels over the inputs a stable softmax
+// feeds them: the logits minus their max, down to where exp underflows. Checked for every
+// level by mlpbench.
+#define EXP_MAX_REL_ERROR 2.4e-7f
+#define EXP_MIN_INPUT -87.0f
+
+// int8 kernels: symmetric weights in [-127, 127] and unsigned activations in [0, 127].
+// Keeping activations to 7 bits lets the SIMD kernels multiply byte pairs with vpmaddubsw,
+// whose int16 pair sums would saturate with full 8 bit activations.
+#define QUANT_WEIGHT_MAX 127
+#define QUANT_ACTIVATION_MAX 127
+
+/**
+ * @enum SimdLevel
+ * @brief Instruction set a kernel table is compiled for, ordered from weakest to strongest.
+ */
+enum SimdLevel
+{
+    Scalar,
+    Sse2,
+    Avx2,
+    Avx512
+};
+
+/**
+ * @struct Kernels
+ * @brief Table of the low level float kernels used by Matrix, Activation and gemm.
+ *        One table exists per SimdLevel, the best one the cpu supports is picked once at
+ *        startup (see kernels()).
+ *        All kernels accept unaligned pointers, and out may alias the inputs.
+ */
+typedef struct Kernels
+{
+    SimdLevel level;
+    const char *name;
+    /** out[i] = a[i] + b[i] */
+    void (*add)(const float *a, const float *b, float *out, int n);
+    /** out[i] = a[i] * c */
+    void (*scale)(const float *a, float c, float *out, int n);
+    /** out[i] = max(a[i], 0) */
+    void (*relu)(const float *a, float *out, int n);
+    /**
+     * out[i] = exp(a[i]), std::exp on the Scalar level and a polynomial approximation on the
+     * SIMD ones, within EXP_MAX_REL_ERROR of std::exp for a[i] in [EXP_MIN_INPUT, 0]
+     */
+    void (*exp)(const float *a, float *out, int n);
+    /** sum of a[0..n) */
+    float (*sum)(const float *a, int n);
+    /** max of a[0..n), n > 0 */
+    float (*max)(const float *a, int n);
+    /**
+     * out[i] = exp(a[i] - shift), returns the sum of out. With shift = max(a) these are the
+     * softmax numerators of a: all in (0, 1], so no logit is large enough to overflow them.
+     */
+    float (*expSum)(const float *a, float shift, float *out, int n);
+    /**
+     * y[m] = A[m x k] * x[k] + bias[m], clamped at 0 if relu is set. bias may be nullptr.
+     * See gemv() in Gemm.h.
+     */
+    void (*gemv)(int m, int k, const float *a, int lda, const float *x, const float *bias,
+                 bool relu, float *y);
+    /**
+     * Sparse gemv: y[m] = A[m x n] * x[n] + bias[m], clamped at 0 if relu is set, with A in
+     * blocked compressed columns (see SparseMatrix): the blocks of column j are
+     * [colStart[j], colStart[j + 1]), block b covers the rows from blockRows[b] and its
+     * SPARSE_BLOCK values are at values + b * SPARSE_BLOCK. Columns whose x is 0 are skipped.
+     * bias may be nullptr.
+     */
+    void (*gemvSparse)(int m, int n, const int *colStart, const int *blockRows,
+                       const float *values, const float *x, const float *bias, bool relu,
+                       float *y);
+    /**
+     * cols of B of the gemmTile register tile, sized so its accumulators fit in the level's
+     * vector registers.
+     */
+    int gemmNr;
+    /**
+     * C[rows x cols] = (accumulate ? C : 0) + packed A panel (kc x GEMM_MR) * packed B panel
+     * (kc x gemmNr), + bias[r] and clamped at 0 if relu is set. The bias and relu are applied
+     * to the accumulators, and every element of C is loaded and stored at most once.
+     * rows <= GEMM_MR and cols <= gemmNr are the part of the tile inside C, the rest of the
+     * panels is zero padding. bias may be nullptr.
+     */
+    void (*gemmTile)(int kc, const float *a, const float *b, float *c, int ldc, int rows,
+                     int cols, bool accumulate, const float *bias, bool relu);
+    /**
+     * Quantized gemv: y[m] = (A[m x k] * x[k]) * rowScale[m] * xScale + bias[m], clamped at 0
+     * if relu is set. A holds int8 weights and x activations in [0, QUANT_ACTIVATION_MAX],
+     * the products are accumulated in int32 and rescaled to float once per output.
+     * bias may be nullptr.
+     */
+    void (*gemvInt8)(int m, int k, const int8_t *a, int lda, const uint8_t *x,
+                     const float *rowScale, float xScale, const float *bias, bool relu,
+                     float *y);
+    /** out[i] = round(a[i] * scale) clamped to [0, QUANT_ACTIVATION_MAX] */
+    void (*quantize)(const float *a, float scale, uint8_t *out, int n);
+} Kernels;
+
+/**
+ * @return the kernel table of the strongest SimdLevel supported by the running cpu.
+ *         The choice is made through CPUID on the first call, and may be lowered by
+ *         setting the MLP_SIMD environment variable to scalar/sse2/avx2/avx512.
+ */
+const Kernels &kernels();
+
+/**
+ * @param level requested instruction set
+ * @return the kernel table of the given level, or nullptr if it isn't compiled in or isn't
+ *         supported by the running cpu.
+ */
+const Kernels *kernelsFor(SimdLevel level);
+
+/**
+ * Kernel table for products whose rows hold n floats: the strongest level, up to the one of
+ * kernels(), whose vectors aren't wider than n, so that a narrow layer doesn't spend its
+ * dot products in masked tails. Layers pick theirs once, when they are built.
+ * @param n row length (cols of the weights)
+ */
+const Kernels &kernelsForWidth(int n);
+
+#endif //KERNELS_H
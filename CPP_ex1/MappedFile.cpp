@@ -0,0 +1,88 @@
+// MappedFile.cpp
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "MappedFile.h"
+
+MappedFile::MappedFile()
+: _data(nullptr), _size(0){}
+
+MappedFile::~MappedFile()
+{
+    unmap();
+}
+
+bool MappedFile::map(const std::string &path)
+{
+    unmap();
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return false;
+    }
+    void *data = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); // the mapping keeps its own reference to the file.
+    if (data == MAP_FAILED)
+    {
+        return false;
+    }
+    // the whole file is going to be read right away, start the read-ahead now.
+    madvise(data, (size_t) st.st_size, MADV_WILLNEED);
+    _data = data;
+    _size = (size_t) st.st_size;
+    return true;
+}
+
+void MappedFile::unmap()
+{
+    if (_data != nullptr)
+    {
+        munmap(_data, _size);
+        _data = nullptr;
+        _size = 0;
+    }
+}
+
+const void *MappedFile::getData() const
+{
+    return _data;
+}
+
+size_t MappedFile::getSize() const
+{
+    return _size;
+}
+
+bool mapFileToMatrix(const std::string &filePath, MappedFile &file, int rows, int cols,
+                     Matrix &mat)
+{
+    if (!file.map(filePath))
+    {
+        return false;
+    }
+    if (file.getSize() != (size_t) rows * cols * sizeof(float))
+    {
+        file.unmap();
+        return false;
+    }
+#ifdef MATRIX_BIG_ENDIAN_HOST
+    // the file's little endian floats can't be used in place: a swapped copy instead.
+    const float *data = static_cast<const float *>(file.getData());
+    mat = Matrix(rows, cols);
+    std::copy(data, data + (size_t) rows * cols, mat.getData());
+    swapFloatBytes(mat.getData(), (size_t) rows * cols);
+    file.unmap();
+#else
+    mat = Matrix(rows, cols, static_cast<const float *>(file.getData()));
+#endif
+    return true;
+}
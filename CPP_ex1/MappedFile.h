@@ -0,0 +1,61 @@
+// MappedFile.h
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+#include "Matrix.h"
+
+/**
+ * @class MappedFile
+ * @brief Read-only, shared memory mapping of a whole file.
+ *        The pages come from the page cache, so every process mapping the same file shares
+ *        one physical copy of it. The mapping is released when the object is destroyed.
+ */
+class MappedFile
+{
+private:
+    void *_data;
+    size_t _size;
+
+public:
+    MappedFile();
+    MappedFile(const MappedFile &other) = delete;
+    MappedFile& operator=(const MappedFile &other) = delete;
+    ~MappedFile();
+
+    /**
+     * Maps the file at the given path, dropping any previous mapping of this object.
+     * @param path file to map
+     * @return boolean status
+     *          true - success
+     *          false - failure (missing, unreadable or empty file)
+     */
+    bool map(const std::string &path);
+
+    /**
+     * Releases the mapping, if any.
+     */
+    void unmap();
+
+    const void *getData() const;
+    size_t getSize() const;
+};
+
+/**
+ * Maps a raw float32 file (see MATRIX_BIG_ENDIAN_HOST) and points a read-only matrix view at
+ * its pages, no copy is made but on a big endian host, where mat gets a byte swapped copy.
+ * The file must hold exactly rows * cols floats.
+ * @param filePath - path of the binary file to map
+ * @param file - mapping object, must outlive mat (and every copy of it)
+ * @param rows, cols - expected matrix dimensions
+ * @param mat - set to a view of the mapped data on success
+ * @return boolean status
+ *          true - success
+ *          false - failure
+ */
+bool mapFileToMatrix(const std::string &filePath, MappedFile &file, int rows, int cols,
+                     Matrix &mat);
+
+#endif //MAPPEDFILE_H
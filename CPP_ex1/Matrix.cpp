@@ -2,29 +2,87 @@
 // Created by Guy on 12/23/2019.
 //
 
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
+#include "Instrument.h"
 #include "Matrix.h"
+#include "Kernels.h"
+
+#define ALIGNMENT_FLOATS ((int) (MATRIX_ALIGNMENT / sizeof(float)))
+
+namespace
+{
+/**
+ * Allocates the storage of a matrix, with the slack needed to align it.
+ */
+float *allocate(int length)
+{
+    INSTRUMENT_ALLOCATION();
+    return new float[length + ALIGNMENT_FLOATS - 1];
+}
+
+bool isAligned(const float *p)
+{
+    return reinterpret_cast<uintptr_t>(p) % MATRIX_ALIGNMENT == 0;
+}
+}
+
+void Matrix::allocateStorage(int capacity)
+{
+    _storage = allocate(capacity);
+    uintptr_t address = reinterpret_cast<uintptr_t>(_storage);
+    address = (address + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+    _matrix = reinterpret_cast<float *>(address);
+    _capacity = capacity;
+}
 
 Matrix::Matrix(int rows, int cols)
-: _dims{rows, cols}, _matrix(new float[rows*cols]), _length(rows*cols){}
+: _length(rows*cols), _capacity(0), _dims{rows, cols}, _stride(cols), _storage(nullptr),
+  _matrix(nullptr), _isView(false)
+{
+    allocateStorage(rows*cols);
+}
+
+Matrix::Matrix(int rows, int cols, const float *data)
+: _length(rows*cols), _capacity(rows*cols), _dims{rows, cols}, _stride(cols),
+  _storage(nullptr), _matrix(const_cast<float *>(data)), _isView(true){}
 
 
 Matrix::Matrix()
 : Matrix(DEFAULT_SIZE, DEFAULT_SIZE){}
 
-Matrix::Matrix(const Matrix &m)// copy ctor.
-: Matrix(m._dims.rows, m._dims.cols)
+Matrix::Matrix(const Matrix &m)// copy ctor, keeps the row padding.
+: _length(m._length), _capacity(m._capacity), _dims(m._dims), _stride(m._stride),
+  _storage(nullptr), _matrix(m._matrix), _isView(m._isView), _packed(m._packed)
 {
-    for (int i = 0; i < _dims.rows * _dims.rows; i++)
+    if (_isView)
     {
-        _matrix[i] = m._matrix[i];
+        return;
     }
+    allocateStorage(_dims.rows * _stride);
+    std::copy(m._matrix, m._matrix + _capacity, _matrix);
+}
+
+Matrix::Matrix(Matrix &&m) noexcept// move ctor, m is left empty.
+: _length(m._length), _capacity(m._capacity), _dims(m._dims), _stride(m._stride),
+  _storage(m._storage), _matrix(m._matrix), _isView(m._isView), _packed(std::move(m._packed))
+{
+    m._length = 0;
+    m._capacity = 0;
+    m._dims = MatrixDims{0, 0};
+    m._stride = 0;
+    m._storage = nullptr;
+    m._matrix = nullptr;
+    m._isView = false;
 }
 
 Matrix::~Matrix()
 {
-    delete[] _matrix;
+    delete[] _storage;
     //todo: understand if handles deletion of heap allocated objs.
 }
 Matrix& Matrix::operator=(const Matrix &m)
@@ -33,19 +91,42 @@ Matrix& Matrix::operator=(const Matrix &m)
     {
         return *this;
     }
+    int size = m._dims.rows * m._stride;
+    if (!_isView && !m._isView && size <= _capacity)
+    {
+        // the current storage is big enough, copy in place.
+        _length = m._length;
+        _dims = m._dims;
+        _stride = m._stride;
+        _packed = m._packed;
+        std::copy(m._matrix, m._matrix + size, _matrix);
+        return *this;
+    }
     Matrix dumbMatrix (m); // copy ctor
     swap(*this, dumbMatrix);
     return *this;
 }
 
+Matrix& Matrix::operator=(Matrix &&m) noexcept
+{
+    swap(*this, m);
+    return *this;
+}
+
 // uses std::swap which calls the copy ctor in order to avoid code duplication when using operator=.
 //copy and swap idiom.
 // todo: change and consult meny.
 void swap(Matrix &oldMatrix, Matrix &newMatrix)
 {
+    std::swap(oldMatrix._length, newMatrix._length);
+    std::swap(oldMatrix._capacity, newMatrix._capacity);
     std::swap(oldMatrix._dims.rows, newMatrix._dims.rows);
     std::swap(oldMatrix._dims.cols, newMatrix._dims.cols);
+    std::swap(oldMatrix._stride, newMatrix._stride);
+    std::swap(oldMatrix._storage, newMatrix._storage);
     std::swap(oldMatrix._matrix, newMatrix._matrix);
+    std::swap(oldMatrix._isView, newMatrix._isView);
+    std::swap(oldMatrix._packed, newMatrix._packed);
 }
 
 int Matrix::getRows() const
@@ -58,27 +139,135 @@ int Matrix::getCols() const
     return _dims.cols;
 }
 
+const float *Matrix::getData() const
+{
+    return _matrix;
+}
+
+float *Matrix::getData()
+{
+    return _matrix;
+}
+
+int Matrix::getStride() const
+{
+    return _stride;
+}
+
+bool Matrix::isContiguous() const
+{
+    return _stride == _dims.cols;
+}
+
+bool Matrix::isView() const
+{
+    return _isView;
+}
+
+Matrix& Matrix::alignRows()
+{
+    int stride = (_dims.cols + ALIGNMENT_FLOATS - 1) / ALIGNMENT_FLOATS * ALIGNMENT_FLOATS;
+    if (isAligned(_matrix) && (_dims.rows <= 1 || _stride % ALIGNMENT_FLOATS == 0))
+    {
+        return *this;
+    }
+    Matrix padded(_dims.rows, stride);
+    padded._length = _length;
+    padded._dims.cols = _dims.cols;
+    padded._packed = _packed; // the packed layout doesn't depend on the stride.
+    for (int i = 0; i < _dims.rows; i++)
+    {
+        float *row = padded._matrix + i * stride;
+        std::copy(_matrix + i * _stride, _matrix + i * _stride + _dims.cols, row);
+        std::fill(row + _dims.cols, row + stride, 0.0f);
+    }
+    swap(*this, padded);
+    return *this;
+}
+
+Matrix& Matrix::prepack()
+{
+    _packed = std::make_shared<PackedCopy>();
+    return *this;
+}
+
+bool Matrix::isPrepacked() const
+{
+    return _packed != nullptr;
+}
+
 Matrix& Matrix::vectorize()
 {
+    if (!isContiguous())
+    {
+        for (int i = 1; i < _dims.rows; i++)
+        {
+            std::copy(_matrix + i * _stride, _matrix + i * _stride + _dims.cols,
+                      _matrix + i * _dims.cols);
+        }
+    }
     _dims.rows = _length;
     _dims.cols = 1;
+    _stride = 1;
+    _packed.reset();
+    return *this;
+}
+
+Matrix& Matrix::resize(int rows, int cols)
+{
+    int length = rows * cols;
+    if (_isView || length > _capacity)
+    {
+        Matrix storage(rows, cols);
+        swap(*this, storage);
+        return *this;
+    }
+    _length = length;
+    _dims = MatrixDims{rows, cols};
+    _stride = cols;
+    _packed.reset();
+    return *this;
+}
+
+Matrix& Matrix::assignProduct(const Matrix &a, const Matrix &b, GemmEpilogue epilogue,
+                              const Kernels *kern)
+{
+    if (a._dims.cols != b._dims.rows)
+    {
+        std::cerr << MATRICES_MULT_DIM_ERR << std::endl;
+        exit(1);
+    }
+    const float *packedA = nullptr;
+    if (a._packed != nullptr && b._dims.cols > 1)
+    {
+        PackedCopy &packed = *a._packed;
+        std::call_once(packed.once, [&a, &packed]()
+        {
+            packed.data.resize(packedGemmASize(a._dims.rows, a._dims.cols));
+            packGemmA(a._dims.rows, a._dims.cols, a._matrix, a._stride, packed.data.data());
+        });
+        packedA = packed.data.data();
+    }
+    resize(a._dims.rows, b._dims.cols);
+    gemm(a._dims.rows, b._dims.cols, a._dims.cols, a._matrix, a._stride, b._matrix, b._stride,
+         _matrix, _stride, epilogue, kern, packedA);
     return *this;
 }
 
 float& Matrix::operator()(int i, int j) const
 {
-    return (*this)(i,j); //todo: check if legal to call a non const enviroment function.
+    return _matrix[(i * _stride) + j];
 }
 
 float& Matrix::operator()(int i, int j)
 {
-    int realIdx = (i * _dims.cols) + j;
+    int realIdx = (i * _stride) + j;
     return (*this)[realIdx];
 }
 
 float& Matrix::operator[](int i) const
 {
-    return (*this)[i];
+    return _matrix[i];
 }
 float& Matrix::operator[](int i)
 {
@@ -87,50 +276,67 @@ float& Matrix::operator[](int i)
 
 Matrix Matrix::operator*(const Matrix &m) const
 {
-    if (_dims.cols == m._dims.rows)
+    Matrix res(_dims.rows, m._dims.cols);
+    res.assignProduct(*this, m);
+    return res;
+}
+
+Matrix Matrix::operator+(const Matrix &m) const
+{
+    if (_dims.rows == m._dims.rows && _dims.cols == m._dims.cols)
     {
-        Matrix res(_dims.rows, m._dims.cols);
+        Matrix res(_dims.rows, _dims.cols);
+        if (isContiguous() && m.isContiguous())
+        {
+            kernels().add(_matrix, m._matrix, res._matrix, _length);
+            return res;
+        }
         for (int i = 0; i < _dims.rows; i++)
         {
-            for (int j = 0; j < m._dims.cols; j++)
-            {
-                for (int k = 0; k <  res._length ; k++)
-                {
-                    res(i,j) = (*this)(i,k) * m(k,j);
-                }
-            }
+            kernels().add(&(*this)(i, 0), &m(i, 0), &res(i, 0), _dims.cols);
         }
         return res;
     }
-    std::cerr << MATRICES_MULT_DIM_ERR << std::endl;
+    std::cerr << ADD_DIM_ERR << std::endl;
     exit(1);
 }
 
-Matrix Matrix::operator+(const Matrix &m) const
+Matrix &Matrix::operator+=(const Matrix &m)
 {
+    if (_isView)
+    {
+        *this = *this + m; // a view is read-only, the sum gets storage of its own.
+        return *this;
+    }
     if (_dims.rows == m._dims.rows && _dims.cols == m._dims.cols)
     {
-        Matrix res(_dims.rows, _dims.cols);
-        for (int i = 0; i < _dims.rows * _dims.cols; i++)
+        _packed.reset();
+        if (isContiguous() && m.isContiguous())
         {
-            res[i] = _matrix[i] + m[i];
+            kernels().add(_matrix, m._matrix, _matrix, _length);
+            return *this;
         }
+        for (int i = 0; i < _dims.rows; i++)
+        {
+            kernels().add(&(*this)(i, 0), &m(i, 0), &(*this)(i, 0), _dims.cols);
+        }
+        return *this;
     }
     std::cerr << ADD_DIM_ERR << std::endl;
     exit(1);
 }
 
-Matrix &Matrix::operator+=(const Matrix &m)
-{
-    *this = *this + m;
-}
-
 Matrix Matrix::operator*(const float c) const
 {
-    Matrix res(*this);
-    for (int i = 0; i < _length; i++)
+    Matrix res(_dims.rows, _dims.cols);
+    if (isContiguous())
     {
-       res[i] *= c;
+        kernels().scale(_matrix, c, res._matrix, _length);
+        return res;
+    }
+    for (int i = 0; i < _dims.rows; i++)
+    {
+        kernels().scale(&(*this)(i, 0), c, &res(i, 0), _dims.cols);
     }
     return res;
 }
@@ -140,26 +346,89 @@ Matrix operator*(const float c, const Matrix &m)
     return m * c;
 }
 
-std::ifstream &operator>>(std::ifstream &is, Matrix &m)
+bool Matrix::readBinary(std::istream &is)
 {
+    if (_isView)
+    {
+        resize(_dims.rows, _dims.cols); // a view is read-only, the read gets storage of its own.
+    }
+    _packed.reset();
+    if (isContiguous())
+    {
+        is.read(reinterpret_cast<char *>(_matrix), (std::streamsize) _length * sizeof(float));
+    }
+    else
+    {
+        for (int i = 0; i < _dims.rows && is; i++)
+        {
+            is.read(reinterpret_cast<char *>(&(*this)(i, 0)),
+                    (std::streamsize) _dims.cols * sizeof(float));
+        }
+    }
+    if (!is)
+    {
+        return false;
+    }
+#ifdef MATRIX_BIG_ENDIAN_HOST
+    for (int i = 0; i < _dims.rows; i++)
+    {
+        swapFloatBytes(&(*this)(i, 0), _dims.cols);
+    }
+#endif
+    return true;
+}
 
-    for (int i = 0; i < m._length; i++)
+bool Matrix::writeBinary(std::ostream &os) const
+{
+#ifdef MATRIX_BIG_ENDIAN_HOST
+    std::vector<float> row(_dims.cols);
+    for (int i = 0; i < _dims.rows && os; i++)
+    {
+        std::copy(&(*this)(i, 0), &(*this)(i, 0) + _dims.cols, row.begin());
+        swapFloatBytes(row.data(), row.size());
+        os.write(reinterpret_cast<const char *>(row.data()),
+                 (std::streamsize) row.size() * sizeof(float));
+    }
+#else
+    if (isContiguous())
     {
-        if (is >> m[i])
+        os.write(reinterpret_cast<const char *>(_matrix),
+                 (std::streamsize) _length * sizeof(float));
+    }
+    else
+    {
+        for (int i = 0; i < _dims.rows && os; i++)
         {
-            continue;
+            os.write(reinterpret_cast<const char *>(&(*this)(i, 0)),
+                     (std::streamsize) _dims.cols * sizeof(float));
         }
-        break;
     }
-    if (is.eof())
+#endif
+    return os.good();
+}
+
+std::ifstream &operator>>(std::ifstream &is, Matrix &m)
+{
+    if (!m.readBinary(is))
+    {
+        std::cerr << READ_FILE_ERROR << std::endl;
+    }
+    return is;
+}
+
+void swapFloatBytes(float *data, size_t count)
+{
+    for (size_t i = 0; i < count; i++)
     {
-        return is;
+        uint32_t bits;
+        std::memcpy(&bits, data + i, sizeof(bits));
+        bits = __builtin_bswap32(bits);
+        std::memcpy(data + i, &bits, sizeof(bits));
     }
-    std::cerr << READ_FILE_ERROR<< std::endl;
 }
 
 
-std::ofstream &operator<<(std::ofstream &os, const Matrix &m)
+std::ostream &operator<<(std::ostream &os, const Matrix &m)
 {
     for (int i = 0; i < m._dims.rows; i++)
     {
@@ -177,8 +446,9 @@ std::ofstream &operator<<(std::ofstream &os, const Matrix &m)
             }
         }
         std::string row = stream.str();
-        std::cout << row << std::endl;
+        os << row << std::endl;
     }
+    return os;
 }
 
 void Matrix::plainPrint() const
@@ -5,11 +5,23 @@
 #define MATRIX_H
 
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Gemm.h"
 
 #define DEFAULT_SIZE 1
+// bytes the storage of a matrix, and the rows of an alignRows() matrix, are aligned to: a cache
+// line, and an AVX-512 register.
+#define MATRIX_ALIGNMENT 64
 #define MATRICES_MULT_DIM_ERR "Error: Matrices sizes are'nt as they should - add dimenson!!@!#!#!$!"
 #define ADD_DIM_ERR "Error: Mismatched dimension for addition operator"
 #define READ_FILE_ERROR "Error: Invalid file size or format according to matrix"
+// the raw parameter and image files hold little endian float32, row after row, no header:
+// mapped or read as is on little endian hosts, byte swapped on the others.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define MATRIX_BIG_ENDIAN_HOST
+#endif
 /**
  * @struct MatrixDims
  * @brief Matrix dimensions container
@@ -23,35 +35,152 @@ class Matrix
 {
 private:
     int _length;
+    /**
+     * number of floats available at _matrix, may exceed rows * stride after resize().
+     */
+    int _capacity;
     MatrixDims _dims;
+    /**
+     * distance in floats between two consecutive rows, cols unless padded by alignRows().
+     */
+    int _stride;
+    /**
+     * the allocation _matrix is carved from, nullptr for a view.
+     */
+    float *_storage;
+    /**
+     * MATRIX_ALIGNMENT aligned, unless a view of unaligned data.
+     */
     float *_matrix;
+    /**
+     * true if _matrix is borrowed (see the view ctor) and must not be freed or written.
+     */
+    bool _isView;
+    /**
+     * the contents in gemm's packed layout, filled by the first product that reads it.
+     */
+    struct PackedCopy
+    {
+        std::once_flag once;
+        std::vector<float> data;
+    };
+    /**
+     * the packed copy (see prepack), shared by the copies, or nullptr.
+     */
+    std::shared_ptr<PackedCopy> _packed;
+
+    /**
+     * Points _storage and _matrix to new aligned storage of capacity floats.
+     */
+    void allocateStorage(int capacity);
     friend void swap(Matrix &oldMatrix, Matrix &newMatrix);
 public:
     Matrix();
     Matrix(int rows, int cols);
+    /**
+     * Read-only view over rows * cols floats owned by someone else (e.g a mapped file).
+     * No copy is made, the data must outlive the matrix and every copy of it, since copies of a
+     * view are views of the same data as well.
+     */
+    Matrix(int rows, int cols, const float *data);
     Matrix(const Matrix &m);
+    Matrix(Matrix &&m) noexcept;
     ~Matrix();
 
     int getRows() const;
     int getCols() const;
+    const float *getData() const;
+    float *getData();
+    /**
+     * @return distance in floats between the starts of two consecutive rows in getData().
+     */
+    int getStride() const;
+    /**
+     * @return true if the rows follow each other without padding (stride == cols).
+     */
+    bool isContiguous() const;
+    bool isView() const;
+    /**
+     * Pads the rows so that each one starts MATRIX_ALIGNMENT aligned: the vector loads along a
+     * row never split a cache line. The padding is zeroed.
+     * Nothing changes if the rows are aligned already, e.g a view of an aligned model file
+     * whose rows are a multiple of the alignment.
+     */
+    Matrix& alignRows();
+    /**
+     * Keeps a copy of the contents in the panel layout gemm multiplies A in (see packGemmA),
+     * so that products with this matrix on the left skip packing it: worth it for a matrix
+     * multiplied many times and never written, like the weights of a layer. The copy is made
+     * by the first product of more than one column, the single column ones run on gemv,
+     * which reads the rows: a matrix only multiplied by vectors never pays for the second
+     * copy of its contents. Writing to the matrix through its accessors afterwards is an
+     * error, resize() or assignments drop the packed copy.
+     */
+    Matrix& prepack();
+    bool isPrepacked() const;
+    /**
+     * Removes the row padding, then makes the matrix a single column.
+     */
     Matrix& vectorize();
+    /**
+     * Changes the dims to rows x cols, reusing the current storage when it's big enough.
+     * The previous contents are discarded. A view always gets storage of its own.
+     */
+    Matrix& resize(int rows, int cols);
+    /**
+     * *this = a * b, computed in place: no allocation when the storage is big enough.
+     * this may not be a or b.
+     * @param epilogue bias / activation applied to the product while it's stored
+     * @param kern kernel table of the product, nullptr for kernels() (see gemm)
+     */
+    Matrix& assignProduct(const Matrix &a, const Matrix &b, GemmEpilogue epilogue = NO_EPILOGUE,
+                          const Kernels *kern = nullptr);
     void plainPrint() const;
+    /**
+     * Reads rows * cols floats of the raw file format (see MATRIX_BIG_ENDIAN_HOST) with a
+     * single read() when the matrix is contiguous, one per row otherwise. A view gets storage
+     * of its own first, the viewed data is never written.
+     * @return boolean status
+     *          true - success
+     *          false - failure (the stream ended or failed first)
+     */
+    bool readBinary(std::istream &is);
+    /**
+     * Writes the matrix in the raw file format, the inverse of readBinary.
+     * @return boolean status
+     *          true - success
+     *          false - failure (the stream failed)
+     */
+    bool writeBinary(std::ostream &os) const;
     Matrix& operator=(const Matrix &m);
+    Matrix& operator=(Matrix &&m) noexcept;
     Matrix operator*(const Matrix &m) const;
     Matrix operator+(const Matrix &m) const;
     Matrix& operator+=(const Matrix &m);
     float& operator()(int i, int j) const;
     float& operator()(int i, int j);
+    /**
+     * Linear indexing of getData(): element (i / cols, i % cols) of a contiguous matrix only.
+     */
     float& operator[](int i) const;
     float& operator[](int i);
     Matrix operator*(const float c) const;
 
 
     friend Matrix operator*(const float c, const Matrix &m);
+    /**
+     * Reads m from a raw file (see readBinary), printing READ_FILE_ERROR if it's too short.
+     */
     friend std::ifstream& operator>>(std::ifstream &is, Matrix &m);
-    friend std::ofstream& operator<<(std::ofstream &os, const Matrix &m);
+    friend std::ostream& operator<<(std::ostream &os, const Matrix &m);
 
 
 };
 
+/**
+ * Reverses the bytes of count floats in place: converts between the raw file format and the
+ * byte order of a big endian host.
+ */
+void swapFloatBytes(float *data, size_t count);
+
 #endif //MATRIX_H
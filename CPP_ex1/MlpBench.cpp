@@ -0,0 +1,1247 @@
+// MlpBench.cpp
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "BatchScheduler.h"
+#include "CascadeNetwork.h"
+#include "Kernels.h"
+#include "MappedFile.h"
+#include "Matrix.h"
+#include "MlpNetwork.h"
+#include "QuantizedNetwork.h"
+#include "ResultCache.h"
+#include "SparseMatrix.h"
+#include "StaticNetwork.h"
+#include "ThreadPool.h"
+#include "Workspace.h"
+
+#define BATCH_SIZES {1, 16, 128}
+// every measurement is BENCH_REPETITIONS samples of at least MIN_SAMPLE_SECONDS each, after
+// BENCH_WARMUP_CALLS untimed calls.
+#define BENCH_REPETITIONS 10
+#define MIN_SAMPLE_SECONDS 0.02
+#define BENCH_WARMUP_CALLS 3
+#define JSON_FLAG "--json"
+#define REPETITIONS_FLAG "--repetitions"
+#define BENCH_USAGE "Usage: ./mlpbench [--json report.json] [--repetitions n]"
+#define ERROR_WRITE_JSON "Error: failed to write benchmark report: "
+#define ERROR_LOAD_TEMP "Error: failed to write temporary parameters in: "
+#define MAX_ERROR_MSG "Error: multiplication results differ by "
+#define MAX_EXP_ERROR_MSG "Error: exp relative error above EXP_MAX_REL_ERROR on "
+#define KERNEL_LENGTHS {10, 128, 4096}
+#define ACTIVATION_BATCH_SIZES {1, 64}
+#define LOAD_TEMP_TEMPLATE "/tmp/mlpbench.XXXXXX"
+#define NETWORK_BATCH_SIZES {1, 8, 64, 256}
+// hidden layer widths of the benchmarked topologies, between IMG_SIZE inputs and
+// TOPOLOGY_CLASSES outputs.
+#define TOPOLOGY_HIDDEN_LAYERS {{}, {32}, {128, 64, 20}, {256, 128, 12}, {512, 256, 128, 64}}
+#define TOPOLOGY_CLASSES 10
+#define TOPOLOGY_BATCH 64
+#define STATIC_IMAGES 64
+#define QUANTIZED_IMAGES 64
+#define SCALING_IMAGES 4096
+#define SCALING_CHUNK 64
+#define LATENCY_SAMPLES 2000
+#define P99 0.99
+// block densities of the pruned first layer, and fractions of nonzero inputs: 1 and about
+// the share of the nonzero pixels of a digit.
+#define SPARSE_DENSITIES {1.0f, 0.6f, 0.4f, 0.3f, 0.2f, 0.1f}
+#define SPARSE_INPUT_DENSITIES {1.0f, 0.2f}
+// client threads sending single image requests, and requests each.
+#define SCHEDULER_CLIENTS 8
+#define SCHEDULER_REQUESTS 500
+#define SCHEDULER_WAITS_US {0, 50, 200}
+// distinct images cycled through by the cache benchmark, a cap that holds them all and one
+// that holds fewer of them, so the LRU order makes every lookup miss.
+#define CACHE_IMAGES 64
+#define CACHE_HIT_BYTES (1 << 20)
+#define CACHE_MISS_BYTES (16 << 10)
+#define ALLOC_CHECK_PASSES 100
+#define ALLOC_CHECK_BATCH 64
+#define ALLOC_ERROR_MSG "Error: steady state forward passes allocated "
+
+/**
+ * every heap allocation of the process, counted by the operator new below.
+ */
+std::atomic<long> heapAllocations(0);
+
+// gcc flags the free() below once it inlines these replacements into new/delete pairs.
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void *operator new(size_t size)
+{
+    heapAllocations++;
+    void *p = std::malloc(size ? size : 1);
+    if (p == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    std::free(p);
+}
+
+/**
+ * Reference product: the plain triple loop through operator() that Matrix::operator* used
+ * before the blocked kernel.
+ */
+Matrix naiveMultiply(const Matrix &a, const Matrix &b)
+{
+    Matrix res(a.getRows(), b.getCols());
+    for (int i = 0; i < a.getRows(); i++)
+    {
+        for (int j = 0; j < b.getCols(); j++)
+        {
+            float sum = 0;
+            for (int k = 0; k < a.getCols(); k++)
+            {
+                sum += a(i, k) * b(k, j);
+            }
+            res(i, j) = sum;
+        }
+    }
+    return res;
+}
+
+/**
+ * Fills a matrix with deterministic values in [-1, 1].
+ */
+void fill(Matrix &m, unsigned int seed)
+{
+    for (int i = 0; i < m.getRows() * m.getCols(); i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        m[i] = (float) ((seed >> 8) & 0xFFFF) / 32768.0f - 1.0f;
+    }
+}
+
+/**
+ * @struct Stats
+ * @brief Summary of repeated timings, in seconds.
+ */
+typedef struct Stats
+{
+    double median;
+    double mean;
+    double min;
+    double max;
+    double stddev;
+    double p99;
+} Stats;
+
+/**
+ * @struct BenchResult
+ * @brief One measurement of the JSON report.
+ * @var bench - what was measured, e.g. "gemm"
+ * @var config - its parameters, e.g. "128x784 batch 1"
+ * @var unit - what a unit of work is, e.g. "flop" or "img"
+ * @var work - units of work per timed call
+ * @var seconds - seconds per timed call
+ */
+typedef struct BenchResult
+{
+    std::string bench;
+    std::string config;
+    std::string unit;
+    double work;
+    Stats seconds;
+} BenchResult;
+
+int repetitions = BENCH_REPETITIONS;
+std::vector<BenchResult> report;
+
+/**
+ * @param samples timings, sorted in place
+ */
+Stats summarize(std::vector<double> &samples)
+{
+    std::sort(samples.begin(), samples.end());
+    size_t n = samples.size();
+    double sum = 0;
+    for (double s : samples)
+    {
+        sum += s;
+    }
+    double mean = sum / n;
+    double variance = 0;
+    for (double s : samples)
+    {
+        variance += (s - mean) * (s - mean);
+    }
+    Stats stats;
+    stats.median = (n % 2 == 1) ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+    stats.mean = mean;
+    stats.min = samples.front();
+    stats.max = samples.back();
+    stats.stddev = std::sqrt(variance / n);
+    stats.p99 = samples[std::min(n - 1, (size_t) (n * P99))];
+    return stats;
+}
+
+/**
+ * Adds a measurement to the JSON report.
+ */
+void record(const std::string &bench, const std::string &config, const std::string &unit,
+            double work, const Stats &seconds)
+{
+    report.push_back(BenchResult{bench, config, unit, work, seconds});
+}
+
+/**
+ * Runs func BENCH_WARMUP_CALLS times, then times repetitions samples of at least
+ * MIN_SAMPLE_SECONDS each.
+ * @return seconds per call of the samples.
+ */
+template <typename Func>
+Stats timeIt(Func func)
+{
+    typedef std::chrono::steady_clock Clock;
+    for (int i = 0; i < BENCH_WARMUP_CALLS; i++)
+    {
+        func();
+    }
+    std::vector<double> samples(repetitions);
+    for (double &sample : samples)
+    {
+        long iterations = 0;
+        Clock::time_point start = Clock::now();
+        double elapsed = 0;
+        while (elapsed < MIN_SAMPLE_SECONDS)
+        {
+            func();
+            iterations++;
+            elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        }
+        sample = elapsed / iterations;
+    }
+    return summarize(samples);
+}
+
+/**
+ * Multiplies every weightsDims[i] matrix by a (cols x batch) input with the naive loop and
+ * with Matrix::operator*, and prints GFLOP/s of both.
+ */
+void benchGemm()
+{
+    std::cout << std::left << std::setw(12) << "shape" << std::setw(8) << "batch"
+              << std::setw(14) << "naive GF/s" << std::setw(14) << "gemm GF/s"
+              << "speedup" << std::endl;
+    for (int i = 0; i < MLP_SIZE; i++)
+    {
+        for (int batch : BATCH_SIZES)
+        {
+            Matrix w(weightsDims[i].rows, weightsDims[i].cols);
+            Matrix x(weightsDims[i].cols, batch);
+            fill(w, i + 1);
+            fill(x, batch);
+
+            Matrix expected = naiveMultiply(w, x);
+            Matrix actual = w * x;
+            float maxErr = 0;
+            for (int j = 0; j < expected.getRows() * expected.getCols(); j++)
+            {
+                maxErr = std::fmax(maxErr, std::fabs(expected[j] - actual[j]));
+            }
+            if (maxErr > 1e-3)
+            {
+                std::cerr << MAX_ERROR_MSG << maxErr << std::endl;
+                exit(EXIT_FAILURE);
+            }
+
+            double flops = 2.0 * w.getRows() * w.getCols() * batch;
+            double naiveSec = timeIt([&]() { Matrix r = naiveMultiply(w, x); }).median;
+            Stats gemmStats = timeIt([&]() { Matrix r = w * x; });
+            double gemmSec = gemmStats.median;
+
+            std::string shape = std::to_string(w.getRows()) + "x" + std::to_string(w.getCols());
+            record("gemm", shape + " batch " + std::to_string(batch), "flop", flops, gemmStats);
+            std::cout << std::left << std::setw(12) << shape << std::setw(8) << batch
+                      << std::fixed << std::setprecision(2)
+                      << std::setw(14) << flops / naiveSec * 1e-9
+                      << std::setw(14) << flops / gemmSec * 1e-9
+                      << naiveSec / gemmSec << "x" << std::endl;
+        }
+    }
+}
+
+/**
+ * Multiplies every weightsDims[i] matrix by a (cols x batch) input in the weight layouts of
+ * Matrix: storage misaligned by a float (what plain new[] may return), aligned rows (see
+ * Matrix::alignRows) and aligned rows plus prepacked panels (see Matrix::prepack), and prints
+ * GFLOP/s of each.
+ */
+void benchLayout()
+{
+    std::cout << std::endl << std::left << std::setw(12) << "shape" << std::setw(8) << "batch"
+              << std::setw(16) << "unaligned GF/s" << std::setw(14) << "aligned GF/s"
+              << "prepacked GF/s" << std::endl;
+    for (int i = 0; i < MLP_SIZE; i++)
+    {
+        for (int batch : BATCH_SIZES)
+        {
+            int rows = weightsDims[i].rows;
+            int cols = weightsDims[i].cols;
+            Matrix w(rows, cols);
+            Matrix x(cols, batch);
+            Matrix out(rows, batch);
+            fill(w, i + 1);
+            fill(x, batch);
+            std::vector<float> misaligned((size_t) rows * cols + 1);
+            std::copy(w.getData(), w.getData() + (size_t) rows * cols, misaligned.data() + 1);
+            const Matrix unaligned(rows, cols, misaligned.data() + 1);
+            Matrix aligned(w);
+            aligned.alignRows();
+            Matrix prepacked(aligned);
+            prepacked.prepack();
+
+            double flops = 2.0 * rows * cols * batch;
+            Stats unalignedStats = timeIt([&]() { out.assignProduct(unaligned, x); });
+            Stats alignedStats = timeIt([&]() { out.assignProduct(aligned, x); });
+            Stats prepackedStats = timeIt([&]() { out.assignProduct(prepacked, x); });
+
+            std::string shape = std::to_string(rows) + "x" + std::to_string(cols);
+            std::string config = shape + " batch " + std::to_string(batch);
+            record("layout_unaligned", config, "flop", flops, unalignedStats);
+            record("layout_aligned", config, "flop", flops, alignedStats);
+            record("layout_prepacked", config, "flop", flops, prepackedStats);
+            std::cout << std::left << std::setw(12) << shape << std::setw(8) << batch
+                      << std::fixed << std::setprecision(2)
+                      << std::setw(16) << flops / unalignedStats.median * 1e-9
+                      << std::setw(14) << flops / alignedStats.median * 1e-9
+                      << flops / prepackedStats.median * 1e-9 << std::endl;
+        }
+    }
+}
+
+/**
+ * Times the elementwise kernels of every SimdLevel the cpu supports, and reports the worst
+ * relative error of the exp approximation against std::exp over the softmax inputs
+ * [EXP_MIN_INPUT, 0]. Exits (code == 1) if it's above EXP_MAX_REL_ERROR.
+ */
+void benchKernels()
+{
+    std::cout << std::endl << "active kernels: " << kernels().name << std::endl;
+    std::cout << std::left << std::setw(10) << "level" << std::setw(8) << "length"
+              << std::setw(14) << "add Gelem/s" << std::setw(14) << "relu Gelem/s"
+              << std::setw(14) << "exp Gelem/s" << "exp max rel err" << std::endl;
+    for (int level = Scalar; level <= Avx512; level++)
+    {
+        const Kernels *k = kernelsFor((SimdLevel) level);
+        if (k == nullptr)
+        {
+            continue;
+        }
+        for (int length : KERNEL_LENGTHS)
+        {
+            Matrix a(length, 1);
+            Matrix b(length, 1);
+            Matrix out(length, 1);
+            fill(a, length);
+            fill(b, length + 1);
+            for (int i = 0; i < length; i++)
+            {
+                a[i] = (a[i] + 1) / 2 * EXP_MIN_INPUT; // logits minus their max
+            }
+
+            k->exp(a.getData(), out.getData(), length);
+            double maxErr = 0;
+            for (int i = 0; i < length; i++)
+            {
+                double expected = std::exp((double) a[i]);
+                maxErr = std::fmax(maxErr, std::fabs(out[i] - expected) / expected);
+            }
+            if (maxErr > EXP_MAX_REL_ERROR)
+            {
+                std::cerr << MAX_EXP_ERROR_MSG << k->name << ": " << maxErr << std::endl;
+                exit(EXIT_FAILURE);
+            }
+
+            Stats add = timeIt([&]() { k->add(a.getData(), b.getData(), out.getData(),
+                                              length); });
+            Stats relu = timeIt([&]() { k->relu(a.getData(), out.getData(), length); });
+            Stats exp = timeIt([&]() { k->exp(a.getData(), out.getData(), length); });
+            std::string config = std::string(k->name) + " " + std::to_string(length);
+            record("kernel_add", config, "elem", length, add);
+            record("kernel_relu", config, "elem", length, relu);
+            record("kernel_exp", config, "elem", length, exp);
+            double addSec = add.median;
+            double reluSec = relu.median;
+            double expSec = exp.median;
+            std::cout << std::left << std::setw(10) << k->name << std::setw(8) << length
+                      << std::fixed << std::setprecision(2)
+                      << std::setw(14) << length / addSec * 1e-9
+                      << std::setw(14) << length / reluSec * 1e-9
+                      << std::setw(14) << length / expSec * 1e-9
+                      << std::scientific << maxErr << std::endl;
+        }
+    }
+}
+
+/**
+ * Applies ReLU and softmax in place to every layer's output shape, for a single image and
+ * a batch, and reports elements per second.
+ */
+void benchActivation()
+{
+    std::cout << std::endl << std::left << std::setw(12) << "shape" << std::setw(16)
+              << "relu Melem/s" << std::setw(18) << "softmax Melem/s" << "digits Melem/s"
+              << std::endl;
+    Activation relu(Relu);
+    Activation softmax(Softmax);
+    for (int i = 0; i < MLP_SIZE; i++)
+    {
+        for (int batch : ACTIVATION_BATCH_SIZES)
+        {
+            Matrix m(weightsDims[i].rows, batch);
+            fill(m, i + batch);
+            std::vector<Digit> digits(batch);
+            double elems = (double) m.getRows() * batch;
+            // all are idempotent enough to be applied over and over to the same matrix.
+            Stats reluStats = timeIt([&]() { relu.apply(m); });
+            Stats softmaxStats = timeIt([&]() { softmax.apply(m); });
+            Stats digitsStats = timeIt([&]() { Activation::softmaxDigits(m, digits.data()); });
+            std::string shape = std::to_string(m.getRows()) + "x" + std::to_string(batch);
+            record("activation_relu", shape, "elem", elems, reluStats);
+            record("activation_softmax", shape, "elem", elems, softmaxStats);
+            record("activation_softmax_digits", shape, "elem", elems, digitsStats);
+            std::cout << std::left << std::setw(12) << shape << std::fixed
+                      << std::setprecision(1) << std::setw(16)
+                      << elems / reluStats.median * 1e-6 << std::setw(18)
+                      << elems / softmaxStats.median * 1e-6
+                      << elems / digitsStats.median * 1e-6 << std::endl;
+        }
+    }
+}
+
+/**
+ * Writes random parameters to temporary files, then times loading them the way mlpnetwork
+ * does (memory mapped views) and by reading them into owned matrices (see
+ * Matrix::readBinary), both up to a
+ * constructed MlpNetwork.
+ */
+void benchLoad()
+{
+    char dir[] = LOAD_TEMP_TEMPLATE;
+    if (mkdtemp(dir) == nullptr)
+    {
+        std::cerr << ERROR_LOAD_TEMP << dir << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    std::string paths[2 * MLP_SIZE];
+    for (int i = 0; i < 2 * MLP_SIZE; i++)
+    {
+        bool bias = i >= MLP_SIZE;
+        MatrixDims dims = bias ? biasDims[i - MLP_SIZE] : weightsDims[i];
+        paths[i] = std::string(dir) + (bias ? "/b" : "/w") + std::to_string(i % MLP_SIZE + 1);
+        Matrix m(dims.rows, dims.cols);
+        fill(m, i + 1);
+        std::ofstream os(paths[i], std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!m.writeBinary(os))
+        {
+            std::cerr << ERROR_LOAD_TEMP << dir << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    Stats mapped = timeIt([&]()
+    {
+        MappedFile files[2 * MLP_SIZE];
+        Matrix params[2 * MLP_SIZE];
+        for (int i = 0; i < 2 * MLP_SIZE; i++)
+        {
+            MatrixDims dims = (i >= MLP_SIZE) ? biasDims[i - MLP_SIZE] : weightsDims[i];
+            mapFileToMatrix(paths[i], files[i], dims.rows, dims.cols, params[i]);
+        }
+        MlpNetwork mlp(params, params + MLP_SIZE);
+    });
+    Stats copied = timeIt([&]()
+    {
+        Matrix params[2 * MLP_SIZE];
+        for (int i = 0; i < 2 * MLP_SIZE; i++)
+        {
+            MatrixDims dims = (i >= MLP_SIZE) ? biasDims[i - MLP_SIZE] : weightsDims[i];
+            params[i] = Matrix(dims.rows, dims.cols);
+            std::ifstream is(paths[i], std::ios::in | std::ios::binary);
+            is >> params[i];
+        }
+        MlpNetwork mlp(params, params + MLP_SIZE);
+    });
+    for (const std::string &path : paths)
+    {
+        std::remove(path.c_str());
+    }
+    rmdir(dir);
+
+    record("load", "mapped", "load", 1, mapped);
+    record("load", "copied", "load", 1, copied);
+    std::cout << std::endl << std::left << std::setw(10) << "load" << "us" << std::endl
+              << std::fixed << std::setprecision(1) << std::setw(10) << "mapped"
+              << mapped.median * 1e6 << std::endl
+              << std::setw(10) << "copied" << copied.median * 1e6 << std::endl;
+}
+
+/**
+ * Classifies random images through a randomly initialized network, one at a time and in
+ * batches, and reports images per second.
+ */
+void benchNetwork()
+{
+    Matrix weights[MLP_SIZE];
+    Matrix biases[MLP_SIZE];
+    for (int i = 0; i < MLP_SIZE; i++)
+    {
+        weights[i] = Matrix(weightsDims[i].rows, weightsDims[i].cols);
+        biases[i] = Matrix(biasDims[i].rows, biasDims[i].cols);
+        fill(weights[i], 7 * i + 1);
+        fill(biases[i], 7 * i + 2);
+    }
+    MlpNetwork mlp(weights, biases);
+
+    std::cout << std::endl << std::left << std::setw(8) << "batch"
+              << std::setw(16) << "single img/s" << std::setw(16) << "batched img/s"
+              << "speedup" << std::endl;
+    for (int batch : NETWORK_BATCH_SIZES)
+    {
+        std::vector<Matrix> images(batch, Matrix(imgDims.rows, imgDims.cols));
+        for (int j = 0; j < batch; j++)
+        {
+            fill(images[j], j + 3);
+        }
+        Stats single = timeIt([&]()
+        {
+            for (const Matrix &img : images)
+            {
+                mlp(img);
+            }
+        });
+        Stats batched = timeIt([&]() { mlp.classifyBatch(images.data(), batch); });
+        record("network_single", "batch " + std::to_string(batch), "img", batch, single);
+        record("network_batched", "batch " + std::to_string(batch), "img", batch, batched);
+        double singleSec = single.median;
+        double batchSec = batched.median;
+        std::cout << std::left << std::setw(8) << batch << std::fixed << std::setprecision(0)
+                  << std::setw(16) << batch / singleSec << std::setw(16) << batch / batchSec
+                  << std::setprecision(2) << singleSec / batchSec << "x" << std::endl;
+    }
+}
+
+/**
+ * Builds randomly initialized networks of several depths and widths, and reports images per
+ * second one at a time and in TOPOLOGY_BATCH batches, with the kernels each layer picked.
+ */
+void benchTopology()
+{
+    const std::vector<std::vector<int>> topologies = TOPOLOGY_HIDDEN_LAYERS;
+    std::vector<Matrix> images(TOPOLOGY_BATCH, Matrix(imgDims.rows, imgDims.cols));
+    for (int j = 0; j < TOPOLOGY_BATCH; j++)
+    {
+        fill(images[j], j + 3);
+    }
+    std::cout << std::endl << std::left << std::setw(24) << "topology"
+              << std::setw(16) << "single img/s" << std::setw(16) << "batched img/s"
+              << "kernels" << std::endl;
+    for (const std::vector<int> &hidden : topologies)
+    {
+        std::vector<int> widths = {IMG_SIZE};
+        widths.insert(widths.end(), hidden.begin(), hidden.end());
+        widths.push_back(TOPOLOGY_CLASSES);
+        std::vector<Dense> layers;
+        std::string name = std::to_string(IMG_SIZE);
+        for (size_t i = 1; i < widths.size(); i++)
+        {
+            Matrix w(widths[i], widths[i - 1]);
+            Matrix b(widths[i], 1);
+            fill(w, 7 * i + 1);
+            fill(b, 7 * i + 2);
+            layers.emplace_back(w, b, (i == widths.size() - 1) ? Softmax : Relu);
+            name += "-" + std::to_string(widths[i]);
+        }
+        MlpNetwork mlp(layers);
+        std::string kernelNames;
+        for (const Dense &layer : mlp.getLayers())
+        {
+            kernelNames += std::string(kernelNames.empty() ? "" : ",") + layer.getKernels().name;
+        }
+
+        Stats single = timeIt([&]()
+        {
+            for (const Matrix &img : images)
+            {
+                mlp(img);
+            }
+        });
+        Stats batched = timeIt([&]() { mlp.classifyBatch(images.data(), TOPOLOGY_BATCH); });
+        record("topology_single", name, "img", TOPOLOGY_BATCH, single);
+        record("topology_batched", name, "img", TOPOLOGY_BATCH, batched);
+        std::cout << std::left << std::setw(24) << name << std::fixed << std::setprecision(0)
+                  << std::setw(16) << TOPOLOGY_BATCH / single.median
+                  << std::setw(16) << TOPOLOGY_BATCH / batched.median << kernelNames
+                  << std::endl;
+    }
+}
+
+/**
+ * Classifies random images one at a time with the dynamic network and its fixed-shape
+ * StaticMlp, and reports images per second.
+ */
+void benchStatic()
+{
+    Matrix weights[MLP_SIZE];
+    Matrix biases[MLP_SIZE];
+    for (int i = 0; i < MLP_SIZE; i++)
+    {
+        weights[i] = Matrix(weightsDims[i].rows, weightsDims[i].cols);
+        biases[i] = Matrix(biasDims[i].rows, biasDims[i].cols);
+        fill(weights[i], 7 * i + 1);
+        fill(biases[i], 7 * i + 2);
+    }
+    MlpNetwork mlp(weights, biases);
+    std::unique_ptr<DefaultStaticMlp> fixed(new DefaultStaticMlp(mlp));
+    std::vector<Matrix> images(STATIC_IMAGES, Matrix(imgDims.rows, imgDims.cols));
+    for (int j = 0; j < STATIC_IMAGES; j++)
+    {
+        fill(images[j], j + 3);
+    }
+
+    Stats dynamicStats = timeIt([&]()
+    {
+        for (const Matrix &img : images)
+        {
+            mlp(img);
+        }
+    });
+    Stats staticStats = timeIt([&]()
+    {
+        for (const Matrix &img : images)
+        {
+            (*fixed)(img);
+        }
+    });
+    record("network_shape", "dynamic", "img", STATIC_IMAGES, dynamicStats);
+    record("network_shape", "static", "img", STATIC_IMAGES, staticStats);
+    std::cout << std::endl << std::left << std::setw(10) << "network" << "img/s" << std::endl
+              << std::fixed << std::setprecision(0)
+              << std::setw(10) << "dynamic" << STATIC_IMAGES / dynamicStats.median << std::endl
+              << std::setw(10) << "static" << STATIC_IMAGES / staticStats.median << std::endl
+              << "static speedup: " << std::setprecision(2)
+              << dynamicStats.median / staticStats.median << "x" << std::endl;
+}
+
+/**
+ * Classifies random images one at a time with the float32 and the INT8 network, and reports
+ * images per second and weights size.
+ */
+void benchQuantized()
+{
+    Matrix weights[MLP_SIZE];
+    Matrix biases[MLP_SIZE];
+    for (int i = 0; i < MLP_SIZE; i++)
+    {
+        weights[i] = Matrix(weightsDims[i].rows, weightsDims[i].cols);
+        biases[i] = Matrix(biasDims[i].rows, biasDims[i].cols);
+        fill(weights[i], 7 * i + 1);
+        fill(biases[i], 7 * i + 2);
+    }
+    std::vector<Matrix> images(QUANTIZED_IMAGES, Matrix(imgDims.rows, imgDims.cols));
+    for (int j = 0; j < QUANTIZED_IMAGES; j++)
+    {
+        fill(images[j], j + 3);
+    }
+    MlpNetwork mlp(weights, biases);
+    float ranges[MLP_SIZE];
+    calibrateRanges(mlp, images.data(), QUANTIZED_IMAGES, ranges);
+    QuantizedNetwork quantized(mlp, ranges);
+
+    Stats floatStats = timeIt([&]()
+    {
+        for (const Matrix &img : images)
+        {
+            mlp(img);
+        }
+    });
+    Stats int8Stats = timeIt([&]()
+    {
+        for (const Matrix &img : images)
+        {
+            quantized(img);
+        }
+    });
+    record("network_precision", "float32", "img", QUANTIZED_IMAGES, floatStats);
+    record("network_precision", "int8", "img", QUANTIZED_IMAGES, int8Stats);
+    double floatSec = floatStats.median;
+    double int8Sec = int8Stats.median;
+    size_t floatBytes = 0;
+    for (const Matrix &w : weights)
+    {
+        floatBytes += (size_t) w.getRows() * w.getCols() * sizeof(float);
+    }
+    std::cout << std::endl << std::left << std::setw(10) << "path" << std::setw(16) << "img/s"
+              << "weights bytes" << std::endl << std::fixed << std::setprecision(0)
+              << std::setw(10) << "float32" << std::setw(16) << QUANTIZED_IMAGES / floatSec
+              << floatBytes << std::endl
+              << std::setw(10) << "int8" << std::setw(16) << QUANTIZED_IMAGES / int8Sec
+              << quantized.getWeightsBytes() << std::endl
+              << "int8 speedup: " << std::setprecision(2) << floatSec / int8Sec << "x"
+              << std::endl;
+}
+
+/**
+ * Classifies SCALING_IMAGES images in SCALING_CHUNK batches on a work-stealing pool of
+ * 1, 2, 4... threads up to defaultThreadCount(), and reports images per second and the
+ * parallel efficiency against one thread.
+ */
+void benchThreads()
+{
+    Matrix weights[MLP_SIZE];
+    Matrix biases[MLP_SIZE];
+    for (int i = 0; i < MLP_SIZE; i++)
+    {
+        weights[i] = Matrix(weightsDims[i].rows, weightsDims[i].cols);
+        biases[i] = Matrix(biasDims[i].rows, biasDims[i].cols);
+        fill(weights[i], 7 * i + 1);
+        fill(biases[i], 7 * i + 2);
+    }
+    MlpNetwork mlp(weights, biases);
+    std::vector<Matrix> images(SCALING_IMAGES, Matrix(imgDims.rows, imgDims.cols));
+    for (int j = 0; j < SCALING_IMAGES; j++)
+    {
+        fill(images[j], j + 3);
+    }
+    std::vector<Digit> results(SCALING_IMAGES);
+
+    std::cout << std::endl << std::left << std::setw(10) << "threads" << std::setw(16)
+              << "img/s" << "efficiency" << std::endl;
+    double singleRate = 0;
+    int maxThreads = defaultThreadCount();
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads))
+    {
+        // the calling thread is one of the workers.
+        ThreadPool pool(threads - 1);
+        std::vector<Workspace> workspaces(pool.getSlotCount(), Workspace(SCALING_CHUNK));
+        Stats stats = timeIt([&]()
+        {
+            pool.parallelFor(SCALING_IMAGES, SCALING_CHUNK, [&](int begin, int end, int slot)
+            {
+                mlp.classifyBatch(images.data() + begin, end - begin, results.data() + begin,
+                                  workspaces[slot]);
+            });
+        });
+        record("threads", std::to_string(threads) + " threads", "img", SCALING_IMAGES, stats);
+        double sec = stats.median;
+        double rate = SCALING_IMAGES / sec;
+        singleRate = (threads == 1) ? rate : singleRate;
+        std::cout << std::left << std::setw(10) << threads << std::fixed << std::setprecision(0)
+                  << std::setw(16) << rate << std::setprecision(2)
+                  << rate / (singleRate * threads) << std::endl;
+        if (threads == maxThreads)
+        {
+            break;
+        }
+    }
+}
+
+/**
+ * Classifies a single image LATENCY_SAMPLES times with the products split across 1, 2, 4...
+ * intra-op threads up to defaultThreadCount(), and reports the median and p99 latency.
+ */
+void benchIntraOp()
+{
+    Matrix weights[MLP_SIZE];
+    Matrix biases[MLP_SIZE];
+    for (int i = 0; i < MLP_SIZE; i++)
+    {
+        weights[i] = Matrix(weightsDims[i].rows, weightsDims[i].cols);
+        biases[i] = Matrix(biasDims[i].rows, biasDims[i].cols);
+        fill(weights[i], 7 * i + 1);
+        fill(biases[i], 7 * i + 2);
+    }
+    MlpNetwork mlp(weights, biases);
+    Matrix img(imgDims.rows, imgDims.cols);
+    fill(img, 3);
+
+    typedef std::chrono::steady_clock Clock;
+    std::cout << std::endl << std::left << std::setw(14) << "gemm threads" << std::setw(12)
+              << "p50 us" << "p99 us" << std::endl;
+    int previous = getGemmThreads();
+    int maxThreads = defaultThreadCount();
+    std::vector<double> samples(LATENCY_SAMPLES);
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads))
+    {
+        setGemmThreads(threads);
+        for (int i = 0; i < BENCH_WARMUP_CALLS; i++)
+        {
+            mlp(img);
+        }
+        for (double &sample : samples)
+        {
+            Clock::time_point start = Clock::now();
+            mlp(img);
+            sample = std::chrono::duration<double>(Clock::now() - start).count();
+        }
+        Stats stats = summarize(samples);
+        record("latency", std::to_string(threads) + " gemm threads", "img", 1, stats);
+        std::cout << std::left << std::setw(14) << threads << std::fixed << std::setprecision(1)
+                  << std::setw(12) << stats.median * 1e6 << stats.p99 * 1e6 << std::endl;
+        if (threads == maxThreads)
+        {
+            break;
+        }
+    }
+    setGemmThreads(previous);
+}
+
+/**
+ * Runs SCHEDULER_CLIENTS threads sending SCHEDULER_REQUESTS single image requests each to
+ * classify, all at once.
+ * @param latencies set to the latency of every request
+ * @return seconds until all of them are done
+ */
+template <typename Classify>
+double runClients(const std::vector<Matrix> &images, Classify classify,
+                  std::vector<double> &latencies)
+{
+    typedef std::chrono::steady_clock Clock;
+    latencies.resize(SCHEDULER_CLIENTS * SCHEDULER_REQUESTS);
+    Clock::time_point start = Clock::now();
+    std::vector<std::thread> clients;
+    for (int c = 0; c < SCHEDULER_CLIENTS; c++)
+    {
+        clients.emplace_back([&, c]()
+        {
+            for (int r = 0; r < SCHEDULER_REQUESTS; r++)
+            {
+                const Matrix &img = images[(c * SCHEDULER_REQUESTS + r) % images.size()];
+                Clock::time_point sent = Clock::now();
+                classify(img);
+                latencies[c * SCHEDULER_REQUESTS + r] =
+                        std::chrono::duration<double>(Clock::now() - sent).count();
+            }
+        });
+    }
+    for (std::thread &client : clients)
+    {
+        client.join();
+    }
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/**
+ * Serves concurrent single image requests one at a time (each takes a lock around its own
+ * forward pass, like independent callers sharing a network would) and through a
+ * BatchScheduler with several maxWait, and reports images per second, the mean batch and the
+ * median and p99 latency of a request.
+ */
+void benchScheduler()
+{
+    Matrix weights[MLP_SIZE];
+    Matrix biases[MLP_SIZE];
+    for (int i = 0; i < MLP_SIZE; i++)
+    {
+        weights[i] = Matrix(weightsDims[i].rows, weightsDims[i].cols);
+        biases[i] = Matrix(biasDims[i].rows, biasDims[i].cols);
+        fill(weights[i], 7 * i + 1);
+        fill(biases[i], 7 * i + 2);
+    }
+    MlpNetwork mlp(weights, biases);
+    std::vector<Matrix> images(STATIC_IMAGES, Matrix(IMG_SIZE, 1));
+    for (int j = 0; j < STATIC_IMAGES; j++)
+    {
+        fill(images[j], j + 3);
+    }
+    const int total = SCHEDULER_CLIENTS * SCHEDULER_REQUESTS;
+    std::vector<double> latencies;
+
+    std::cout << std::endl << std::left << std::setw(16) << "scheduling" << std::setw(12)
+              << "img/s" << std::setw(12) << "mean batch" << std::setw(10) << "p50 us"
+              << "p99 us" << std::endl;
+    Workspace ws = mlp.makeWorkspace(1);
+    std::mutex lock;
+    double seconds = runClients(images, [&](const Matrix &img)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        mlp(img, ws);
+    }, latencies);
+    Stats stats = summarize(latencies);
+    record("scheduler", "one at a time", "img", 1, stats);
+    std::cout << std::left << std::setw(16) << "one at a time" << std::fixed
+              << std::setprecision(0) << std::setw(12) << total / seconds << std::setw(12)
+              << 1 << std::setprecision(1) << std::setw(10) << stats.median * 1e6
+              << stats.p99 * 1e6 << std::endl;
+
+    Workspace batchWs = mlp.makeWorkspace(DEFAULT_BATCH_MAX);
+    for (int wait : SCHEDULER_WAITS_US)
+    {
+        BatchScheduler scheduler([&](const Matrix batch[], int count, Digit results[])
+        {
+            mlp.classifyBatch(batch, count, results, batchWs);
+        }, DEFAULT_BATCH_MAX, std::chrono::microseconds(wait));
+        seconds = runClients(images, [&](const Matrix &img)
+        {
+            Digit digit;
+            scheduler.classify(&img, 1, &digit);
+        }, latencies);
+        stats = summarize(latencies);
+        std::string config = "wait " + std::to_string(wait) + " us";
+        record("scheduler", config, "img", 1, stats);
+        std::cout << std::left << std::setw(16) << config << std::fixed << std::setprecision(0)
+                  << std::setw(12) << total / seconds << std::setprecision(1) << std::setw(12)
+                  << (double) scheduler.getImageCount() / scheduler.getBatchCount()
+                  << std::setw(10) << stats.median * 1e6 << stats.p99 * 1e6 << std::endl;
+    }
+}
+
+/**
+ * Classifies single images cycling through CACHE_IMAGES distinct ones without a cache,
+ * through a ResultCache holding them all (every lookup hits) and through one too small for
+ * them (every lookup misses, and replaces the least recently used entry), and reports images
+ * per second.
+ */
+void benchCache()
+{
+    Matrix weights[MLP_SIZE];
+    Matrix biases[MLP_SIZE];
+    for (int i = 0; i < MLP_SIZE; i++)
+    {
+        weights[i] = Matrix(weightsDims[i].rows, weightsDims[i].cols);
+        biases[i] = Matrix(biasDims[i].rows, biasDims[i].cols);
+        fill(weights[i], 7 * i + 1);
+        fill(biases[i], 7 * i + 2);
+    }
+    MlpNetwork mlp(weights, biases);
+    std::vector<Matrix> images(CACHE_IMAGES, Matrix(IMG_SIZE, 1));
+    for (int j = 0; j < CACHE_IMAGES; j++)
+    {
+        fill(images[j], j + 3);
+    }
+    Workspace ws = mlp.makeWorkspace(1);
+    ResultCache::Scratch scratch;
+    auto classify = [&](const Matrix missing[], int, Digit digits[])
+    {
+        digits[0] = mlp(missing[0], ws);
+    };
+    ResultCache hits(IMG_SIZE, CACHE_HIT_BYTES);
+    ResultCache misses(IMG_SIZE, CACHE_MISS_BYTES);
+
+    std::cout << std::endl << std::left << std::setw(12) << "cache" << std::setw(12) << "img/s"
+              << "hit rate" << std::endl;
+    for (int mode = 0; mode < 3; mode++)
+    {
+        ResultCache *cache = mode == 1 ? &hits : mode == 2 ? &misses : nullptr;
+        const char *name = mode == 1 ? "hits" : mode == 2 ? "misses" : "none";
+        Stats stats = timeIt([&]()
+        {
+            for (const Matrix &img : images)
+            {
+                Digit digit;
+                if (cache != nullptr)
+                {
+                    cache->classify(&img, 1, &digit, scratch, classify);
+                }
+                else
+                {
+                    digit = mlp(img, ws);
+                }
+            }
+        });
+        record("cache", name, "img", CACHE_IMAGES, stats);
+        double hitRate = cache != nullptr ?
+                         (double) cache->getHits() / (cache->getHits() + cache->getMisses()) : 0;
+        std::cout << std::left << std::setw(12) << name << std::fixed << std::setprecision(0)
+                  << std::setw(12) << CACHE_IMAGES / stats.median << std::setprecision(2)
+                  << hitRate << std::endl;
+    }
+}
+
+/**
+ * Zeroes the given fraction of the SPARSE_BLOCK row blocks of every column of m, at
+ * deterministic positions.
+ */
+void zeroBlocks(Matrix &m, float fraction, unsigned int seed)
+{
+    for (int j = 0; j < m.getCols(); j++)
+    {
+        for (int row = 0; row < m.getRows(); row += SPARSE_BLOCK)
+        {
+            seed = seed * 1103515245u + 12345u;
+            if ((float) ((seed >> 8) & 0xFFFF) / 65536.0f >= fraction)
+            {
+                continue;
+            }
+            for (int i = row; i < std::min(row + SPARSE_BLOCK, m.getRows()); i++)
+            {
+                m(i, j) = 0;
+            }
+        }
+    }
+}
+
+/**
+ * Multiplies the first layer's weights, pruned to several block densities, by a single
+ * input with all and with a digit's share of nonzero pixels, as a dense gemv (what Dense runs
+ * unless SparseMatrix::beatsDense) and as a SparseMatrix product with every SimdLevel, and
+ * prints the speedup of the sparse product. Exits (code == 1) if the products differ.
+ */
+void benchSparse()
+{
+    int rows = weightsDims[0].rows;
+    int cols = weightsDims[0].cols;
+    std::cout << std::endl << std::left << std::setw(10) << "density" << std::setw(8) << "input"
+              << std::setw(10) << "level" << std::setw(14) << "dense GF/s" << std::setw(14)
+              << "sparse GF/s" << "speedup" << std::endl;
+    for (float density : SPARSE_DENSITIES)
+    {
+        Matrix w(rows, cols);
+        fill(w, 1);
+        zeroBlocks(w, 1 - density, 2);
+        w.alignRows().prepack();
+        SparseMatrix sparse(w);
+        Matrix bias(rows, 1);
+        fill(bias, 3);
+        GemmEpilogue epilogue{bias.getData(), true};
+        for (float inputDensity : SPARSE_INPUT_DENSITIES)
+        {
+            Matrix x(cols, 1);
+            fill(x, 4);
+            zeroBlocks(x, 1 - inputDensity, 5); // runs of SPARSE_BLOCK pixels, like the blank rows
+            Matrix expected(rows, 1);
+            Matrix actual(rows, 1);
+            expected.assignProduct(w, x, epilogue);
+            for (int level = Scalar; level <= Avx512; level++)
+            {
+                const Kernels *k = kernelsFor((SimdLevel) level);
+                if (k == nullptr)
+                {
+                    continue;
+                }
+                sparse.gemv(x.getData(), actual.getData(), epilogue, k);
+                float maxErr = 0;
+                for (int i = 0; i < rows; i++)
+                {
+                    maxErr = std::fmax(maxErr, std::fabs(expected[i] - actual[i]));
+                }
+                if (maxErr > 1e-3)
+                {
+                    std::cerr << MAX_ERROR_MSG << maxErr << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+
+                double flops = 2.0 * rows * cols;
+                Stats denseStats = timeIt([&]() { expected.assignProduct(w, x, epilogue, k); });
+                Stats sparseStats = timeIt([&]() { sparse.gemv(x.getData(), actual.getData(),
+                                                               epilogue, k); });
+                std::ostringstream config;
+                config << std::fixed << std::setprecision(1) << "density " << density
+                       << " input " << inputDensity << " " << k->name;
+                record("sparse_dense", config.str(), "flop", flops, denseStats);
+                record("sparse_sparse", config.str(), "flop", flops, sparseStats);
+                std::cout << std::left << std::fixed << std::setprecision(1)
+                          << std::setw(10) << density << std::setw(8) << inputDensity
+                          << std::setw(10) << k->name << std::setprecision(2)
+                          << std::setw(14) << flops / denseStats.median * 1e-9
+                          << std::setw(14) << flops / sparseStats.median * 1e-9
+                          << denseStats.median / sparseStats.median << "x" << std::endl;
+            }
+        }
+    }
+}
+
+/**
+ * Runs warm-up passes, then counts the heap allocations of ALLOC_CHECK_PASSES single image
+ * (serial, split across all intra-op threads and on the sparse weights), batched, INT8,
+ * StaticMlp and CascadeNetwork (single and batched, half of the images leaving early) forward
+ * passes.
+ * Exits (code == 1) if there is any.
+ */
+void checkAllocations()
+{
+    Matrix weights[MLP_SIZE];
+    Matrix biases[MLP_SIZE];
+    for (int i = 0; i < MLP_SIZE; i++)
+    {
+        weights[i] = Matrix(weightsDims[i].rows, weightsDims[i].cols);
+        biases[i] = Matrix(biasDims[i].rows, biasDims[i].cols);
+        fill(weights[i], i + 1);
+        fill(biases[i], i + 2);
+    }
+    zeroBlocks(weights[0], 0.6f, 7); // pruned, for the first layer to get a sparse copy
+    MlpNetwork mlp(weights, biases);
+    Matrix img(imgDims.rows, imgDims.cols);
+    Matrix batch(IMG_SIZE, ALLOC_CHECK_BATCH);
+    std::vector<Digit> results(ALLOC_CHECK_BATCH);
+    fill(img, 1);
+    fill(batch, 2);
+    Matrix digit(img);
+    zeroBlocks(digit, 0.8f, 3); // mostly zero pixels: the first layer runs sparse
+    float ranges[MLP_SIZE];
+    calibrateRanges(mlp, &img, 1, ranges);
+    QuantizedNetwork quantized(mlp, ranges);
+    std::unique_ptr<DefaultStaticMlp> fixed(new DefaultStaticMlp(mlp));
+    Matrix headWeights(weightsDims[MLP_SIZE - 1].rows, IMG_SIZE);
+    Matrix headBias(weightsDims[MLP_SIZE - 1].rows, 1);
+    fill(headWeights, 5);
+    fill(headBias, 6);
+    Dense head(headWeights, headBias, Softmax);
+    std::vector<Matrix> images(ALLOC_CHECK_BATCH, Matrix(IMG_SIZE, 1));
+    for (int j = 0; j < ALLOC_CHECK_BATCH; j++)
+    {
+        fill(images[j], j + 3);
+    }
+    // the median probability of the head's digits as the threshold: half the images leave.
+    CascadeNetwork always(mlp, head, 0, 0);
+    Workspace cascadeWs = always.makeWorkspace(ALLOC_CHECK_BATCH);
+    always.classifyBatch(images.data(), ALLOC_CHECK_BATCH, results.data(), cascadeWs);
+    std::vector<float> probabilities;
+    for (const Digit &d : results)
+    {
+        probabilities.push_back(d.probability);
+    }
+    std::nth_element(probabilities.begin(), probabilities.begin() + ALLOC_CHECK_BATCH / 2,
+                     probabilities.end());
+    CascadeNetwork cascade(mlp, head, 0, probabilities[ALLOC_CHECK_BATCH / 2]);
+
+    int previous = getGemmThreads();
+    setGemmThreads(0);
+    mlp(img);
+    setGemmThreads(previous);
+    mlp(img);
+    mlp(digit);
+    mlp.classifyBatch(batch, results.data());
+    quantized(img);
+    (*fixed)(img);
+    cascade(img);
+    cascade.classifyBatch(images.data(), ALLOC_CHECK_BATCH, results.data(), cascadeWs);
+    long before = heapAllocations;
+    for (int i = 0; i < ALLOC_CHECK_PASSES; i++)
+    {
+        setGemmThreads(0);
+        mlp(img);
+        setGemmThreads(previous);
+        mlp(img);
+        mlp(digit);
+        mlp.classifyBatch(batch, results.data());
+        quantized(img);
+        (*fixed)(img);
+        cascade(img);
+        cascade.classifyBatch(images.data(), ALLOC_CHECK_BATCH, results.data(), cascadeWs);
+    }
+    long allocations = heapAllocations - before;
+    std::cout << std::endl << "heap allocations in " << ALLOC_CHECK_PASSES
+              << " single (serial + intra-op + sparse) + batched + int8 + static + cascade "
+              << "forward passes after warm-up: " << allocations << std::endl;
+    std::cout << "cascade early exits: " << cascade.getExitCount() << "/"
+              << cascade.getImageCount() << std::endl;
+    if (allocations != 0)
+    {
+        std::cerr << ALLOC_ERROR_MSG << allocations << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Writes the report as JSON: the active kernels, the repetitions and one result per line
+ * (so two reports diff line by line), with the rate in units of work per second at the
+ * median and the seconds per call statistics.
+ * @return boolean status
+ *          true - success
+ *          false - failure (unwritable file)
+ */
+bool writeJson(const std::string &path)
+{
+    std::ofstream os(path, std::ios::out | std::ios::trunc);
+    if (!os.is_open())
+    {
+        return false;
+    }
+    os << "{" << std::endl
+       << "  \"kernels\": \"" << kernels().name << "\"," << std::endl
+       << "  \"repetitions\": " << repetitions << "," << std::endl
+       << "  \"results\": [" << std::endl;
+    os << std::setprecision(6);
+    for (size_t i = 0; i < report.size(); i++)
+    {
+        const BenchResult &r = report[i];
+        os << "    {\"bench\": \"" << r.bench << "\", \"config\": \"" << r.config
+           << "\", \"unit\": \"" << r.unit << "\", \"rate\": " << r.work / r.seconds.median
+           << ", \"median_s\": " << r.seconds.median << ", \"mean_s\": " << r.seconds.mean
+           << ", \"min_s\": " << r.seconds.min << ", \"max_s\": " << r.seconds.max
+           << ", \"stddev_s\": " << r.seconds.stddev << ", \"p99_s\": " << r.seconds.p99
+           << "}" << (i + 1 < report.size() ? "," : "") << std::endl;
+    }
+    os << "  ]" << std::endl << "}" << std::endl;
+    return os.good();
+}
+
+/**
+ * Benchmark's main
+ * @param argc count of args
+ * @param argv args values: optional --json report path and --repetitions count
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    const char *jsonPath = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (i + 1 < argc && std::strcmp(argv[i], JSON_FLAG) == 0)
+        {
+            jsonPath = argv[++i];
+        }
+        else if (i + 1 < argc && std::strcmp(argv[i], REPETITIONS_FLAG) == 0 &&
+                 std::atoi(argv[i + 1]) > 0)
+        {
+            repetitions = std::atoi(argv[++i]);
+        }
+        else
+        {
+            std::cout << BENCH_USAGE << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    benchGemm();
+    benchLayout();
+    benchKernels();
+    benchActivation();
+    benchLoad();
+    benchNetwork();
+    benchTopology();
+    benchStatic();
+    benchQuantized();
+    benchThreads();
+    benchIntraOp();
+    benchSparse();
+    benchScheduler();
+    benchCache();
+    checkAllocations();
+    if (jsonPath != nullptr && !writeJson(jsonPath))
+    {
+        std::cerr << ERROR_WRITE_JSON << jsonPath << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
@@ -2,3 +2,248 @@
 // Created by Guy on 12/23/2019.
 //
 
+#include <algorithm>
+#include <iostream>
+#include <utility>
+#include "Instrument.h"
+#include "MlpNetwork.h"
+
+#define GATHER_BLOCK 16
+
+namespace
+{
+std::vector<Dense> defaultLayers(const Matrix weights[MLP_SIZE], const Matrix biases[MLP_SIZE])
+{
+    std::vector<Dense> layers;
+    layers.reserve(MLP_SIZE);
+    for (int i = 0; i < MLP_SIZE; i++)
+    {
+        layers.emplace_back(weights[i], biases[i], (i == MLP_SIZE - 1) ? Softmax : Relu);
+    }
+    return layers;
+}
+
+std::vector<Dense> modelLayers(const ModelFile &model)
+{
+    std::vector<Dense> layers;
+    layers.reserve(model.getLayerCount());
+    for (int i = 0; i < model.getLayerCount(); i++)
+    {
+        layers.emplace_back(model.getWeights(i), model.getBias(i), model.getActivation(i));
+    }
+    return layers;
+}
+
+/**
+ * Exits (code == 1) unless layers form a chain, see MlpNetwork(layers).
+ * @return layers
+ */
+std::vector<Dense>& checkChain(std::vector<Dense> &layers)
+{
+    bool chained = !layers.empty();
+    for (size_t i = 1; chained && i < layers.size(); i++)
+    {
+        chained = layers[i].getWeights().getCols() == layers[i - 1].getWeights().getRows();
+    }
+    if (!chained)
+    {
+        std::cerr << LAYERS_DIM_ERR << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    return layers;
+}
+}
+
+MlpNetwork::MlpNetwork(const Matrix weights[MLP_SIZE], const Matrix biases[MLP_SIZE])
+: MlpNetwork(defaultLayers(weights, biases))
+{
+}
+
+MlpNetwork::MlpNetwork(const ModelFile &model)
+: MlpNetwork(modelLayers(model))
+{
+}
+
+MlpNetwork::MlpNetwork(std::vector<Dense> layers)
+: _layers(std::move(checkChain(layers))), _inputSize(_layers[0].getWeights().getCols()),
+  _workspace(getLayerDims(), DEFAULT_MAX_BATCH)
+{
+}
+
+int MlpNetwork::getLayerCount() const
+{
+    return (int) _layers.size();
+}
+
+const std::vector<Dense>& MlpNetwork::getLayers() const
+{
+    return _layers;
+}
+
+bool MlpNetwork::hasPrunedLayers() const
+{
+    for (const Dense &layer : _layers)
+    {
+        if (layer.getSparseWeights() != nullptr)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int MlpNetwork::getInputSize() const
+{
+    return _inputSize;
+}
+
+int MlpNetwork::getOutputSize() const
+{
+    return _layers.back().getWeights().getRows();
+}
+
+std::vector<MatrixDims> MlpNetwork::getLayerDims() const
+{
+    std::vector<MatrixDims> dims;
+    for (const Dense &layer : _layers)
+    {
+        dims.push_back(MatrixDims{layer.getWeights().getRows(), layer.getWeights().getCols()});
+    }
+    return dims;
+}
+
+Workspace MlpNetwork::makeWorkspace(int maxBatch) const
+{
+    return Workspace(getLayerDims(), maxBatch);
+}
+
+Digit MlpNetwork::toDigit(const Matrix &probabilities, int col)
+{
+    Digit digit = {0, probabilities(0, col)};
+    for (int i = 1; i < probabilities.getRows(); i++)
+    {
+        if (probabilities(i, col) > digit.probability)
+        {
+            digit.value = i;
+            digit.probability = probabilities(i, col);
+        }
+    }
+    return digit;
+}
+
+const Matrix& MlpNetwork::forwardLayers(const Matrix &input, int begin, int end,
+                                        Workspace &ws) const
+{
+    const Matrix *activations = &input;
+    for (int i = begin; i < end; i++)
+    {
+        Matrix &output = ws.layerOutput(i);
+        {
+            INSTRUMENT_LAYER(FloatNetwork, i, _layers[i].getWeights().getRows(),
+                             _layers[i].getWeights().getCols(), activations->getCols(),
+                             sizeof(float));
+            _layers[i].forwardLogits(*activations, output);
+        }
+        activations = &output;
+    }
+    return *activations;
+}
+
+void MlpNetwork::toDigits(Matrix &output, Digit results[]) const
+{
+    if (_layers.back().getActivation().getType() == Softmax)
+    {
+        Activation::softmaxDigits(output, results);
+        return;
+    }
+    for (int j = 0; j < output.getCols(); j++)
+    {
+        results[j] = toDigit(output, j);
+    }
+}
+
+Digit MlpNetwork::operator()(const Matrix &img) const
+{
+    return (*this)(img, _workspace);
+}
+
+Digit MlpNetwork::operator()(const Matrix &img, Workspace &ws) const
+{
+    if (img.getRows() * img.getCols() != _inputSize)
+    {
+        std::cerr << BATCH_DIM_ERR << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    Matrix vec(_inputSize, 1, img.getData()); // view, no copy
+    Digit digit;
+    forwardLayers(vec, 0, getLayerCount(), ws);
+    toDigits(ws.layerOutput(getLayerCount() - 1), &digit);
+    return digit;
+}
+
+void MlpNetwork::classifyBatch(const Matrix &batch, Digit results[]) const
+{
+    classifyBatch(batch, results, _workspace);
+}
+
+void MlpNetwork::classifyBatch(const Matrix &batch, Digit results[], Workspace &ws) const
+{
+    if (batch.getRows() != _inputSize)
+    {
+        std::cerr << BATCH_DIM_ERR << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    forwardLayers(batch, 0, getLayerCount(), ws);
+    toDigits(ws.layerOutput(getLayerCount() - 1), results);
+}
+
+std::vector<Digit> MlpNetwork::classifyBatch(const Matrix &batch) const
+{
+    std::vector<Digit> digits(batch.getCols());
+    classifyBatch(batch, digits.data());
+    return digits;
+}
+
+std::vector<Digit> MlpNetwork::classifyBatch(const Matrix images[], int count) const
+{
+    std::vector<Digit> digits(count);
+    classifyBatch(images, count, digits.data(), _workspace);
+    return digits;
+}
+
+void MlpNetwork::classifyBatch(const Matrix images[], int count, Digit results[],
+                               Workspace &ws) const
+{
+    classifyBatch(gather(images, count, ws), results, ws);
+}
+
+Matrix& MlpNetwork::gather(const Matrix images[], int count, Workspace &ws) const
+{
+    for (int j = 0; j < count; j++)
+    {
+        if (images[j].getRows() * images[j].getCols() != _inputSize)
+        {
+            std::cerr << BATCH_DIM_ERR << std::endl;
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // images become the columns of the batch, the transpose is done in blocks of
+    // GATHER_BLOCK pixels so both the reads and the writes stay within a few cache lines.
+    Matrix &batch = ws.batchInput();
+    batch.resize(_inputSize, count);
+    float *data = batch.getData();
+    for (int p0 = 0; p0 < _inputSize; p0 += GATHER_BLOCK)
+    {
+        int p1 = std::min(p0 + GATHER_BLOCK, _inputSize);
+        for (int j = 0; j < count; j++)
+        {
+            const float *img = images[j].getData();
+            for (int p = p0; p < p1; p++)
+            {
+                data[p * count + j] = img[p];
+            }
+        }
+    }
+    return batch;
+}
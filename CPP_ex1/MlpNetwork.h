@@ -3,7 +3,12 @@
 #ifndef MLPNETWORK_H
 #define MLPNETWORK_H
 
+#include <vector>
 #include "Matrix.h"
+#include "Dense.h"
+#include "Digit.h"
+#include "ModelFile.h"
+#include "Workspace.h"
 
 #define MLP_SIZE 4
 
@@ -11,6 +16,144 @@ const MatrixDims imgDims = {28, 28};
 const MatrixDims weightsDims[] = {{128, 784}, {64, 128}, {20, 64}, {10, 20}};
 const MatrixDims biasDims[]    = {{128, 1}, {64, 1}, {20, 1},  {10, 1}};
 
-// Insert MlpNetwork class here...
+#define IMG_SIZE (imgDims.rows * imgDims.cols)
+#define BATCH_DIM_ERR "Error: batch rows must match the network input size"
+#define LAYERS_DIM_ERR "Error: every layer's input size must match the previous layer's output"
+
+/**
+ * @class MlpNetwork
+ * @brief Multi layer perceptron classifying digit images: a chain of Dense layers, of any
+ *        depth and widths, usually Relu on all of them but the last one which is Softmax.
+ *        The topology comes from a ModelFile, or is the default MLP_SIZE layers of
+ *        weightsDims for the loose parameter files. Per layer decisions (kernel table,
+ *        workspace buffer sizes) are made once, when the network is built.
+ *        The intermediate activations live in a Workspace, so once it reached its size a
+ *        forward pass makes no heap allocation. Every method has a variant taking the
+ *        workspace to use, which makes the network shareable between threads as long as each
+ *        thread brings its own workspace. The variants without one use the network's own
+ *        workspace and are therefore not thread safe.
+ */
+class MlpNetwork
+{
+private:
+    std::vector<Dense> _layers;
+    int _inputSize;
+    mutable Workspace _workspace;
+
+public:
+    /**
+     * Picks the most probable digit of a column.
+     * @param probabilities softmax output, classes x N
+     * @param col column (sample) index
+     */
+    static Digit toDigit(const Matrix &probabilities, int col);
+
+    /**
+     * Default topology: MLP_SIZE layers, the last one Softmax and the others Relu.
+     * @param weights weights[i] is the i'th layer weights matrix (weightsDims[i])
+     * @param biases biases[i] is the i'th layer bias vector (biasDims[i])
+     */
+    MlpNetwork(const Matrix weights[MLP_SIZE], const Matrix biases[MLP_SIZE]);
+
+    /**
+     * Builds one Dense layer per layer of a loaded model, with its activation.
+     */
+    explicit MlpNetwork(const ModelFile &model);
+
+    /**
+     * Exits (code == 1) if layers is empty or a layer's cols don't match the previous
+     * layer's rows.
+     * @param layers the layers, from the input to the output
+     */
+    explicit MlpNetwork(std::vector<Dense> layers);
+
+    int getLayerCount() const;
+    const std::vector<Dense>& getLayers() const;
+
+    /**
+     * @return true if a layer's weights are pruned enough to have a sparse copy (see
+     *         SparseMatrix::worthBuilding), whose zero blocks the single image products skip.
+     */
+    bool hasPrunedLayers() const;
+
+    /**
+     * @return length of an input image: the cols of the first layer.
+     */
+    int getInputSize() const;
+
+    /**
+     * @return number of classes: the rows of the last layer.
+     */
+    int getOutputSize() const;
+
+    /**
+     * @return weights dims of every layer, in order.
+     */
+    std::vector<MatrixDims> getLayerDims() const;
+
+    /**
+     * @param maxBatch largest number of images a forward pass is expected to hold.
+     * @return a workspace sized for this network's layers.
+     */
+    Workspace makeWorkspace(int maxBatch) const;
+
+    /**
+     * Classifies a single image.
+     * @param img image of getInputSize() pixels, in any shape.
+     */
+    Digit operator()(const Matrix &img) const;
+    Digit operator()(const Matrix &img, Workspace &ws) const;
+
+    /**
+     * Classifies a batch of images in one forward pass, every layer runs once as a GEMM.
+     * @param batch getInputSize() x N matrix, column j holds the j'th image.
+     * @return the N identified digits, in column order.
+     */
+    std::vector<Digit> classifyBatch(const Matrix &batch) const;
+
+    /**
+     * Allocation free variant of classifyBatch.
+     * @param batch getInputSize() x N matrix, column j holds the j'th image.
+     * @param results array of N digits, results[j] is set to the j'th image's digit.
+     */
+    void classifyBatch(const Matrix &batch, Digit results[]) const;
+    void classifyBatch(const Matrix &batch, Digit results[], Workspace &ws) const;
+
+    /**
+     * Classifies count images in one forward pass.
+     * @param images array of count images of getInputSize() pixels.
+     * @return the identified digits, in input order.
+     */
+    std::vector<Digit> classifyBatch(const Matrix images[], int count) const;
+
+    /**
+     * Allocation free variant of classifyBatch, for count up to ws.getMaxBatch().
+     * @param images array of count images of getInputSize() pixels.
+     * @param results array of count digits, results[j] is set to the j'th image's digit.
+     */
+    void classifyBatch(const Matrix images[], int count, Digit results[], Workspace &ws) const;
+
+    /**
+     * Copies count images into ws.batchInput(), as its columns.
+     * @param images array of count images of getInputSize() pixels.
+     * @return the batch, getInputSize() x count.
+     */
+    Matrix& gather(const Matrix images[], int count, Workspace &ws) const;
+
+    /**
+     * Runs the layers [begin, end) on input, but the softmax of a Softmax last layer (see
+     * Dense::forwardLogits), which toDigits fuses with picking the digits. Layer i writes
+     * ws.layerOutput(i).
+     * @param input the input of layer begin, one column per image
+     * @return the output of layer end - 1, stored in ws, or input if there's no layer to run.
+     */
+    const Matrix& forwardLayers(const Matrix &input, int begin, int end, Workspace &ws) const;
+
+    /**
+     * The digits of every column of the last layer's output, see forwardLayers.
+     * @param output overwritten
+     */
+    void toDigits(Matrix &output, Digit results[]) const;
+};
 
 #endif // MLPNETWORK_H
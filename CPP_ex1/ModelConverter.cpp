@@ -0,0 +1,85 @@
+// ModelConverter.cpp
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+#include "ModelFile.h"
+
+#define ERROR_INAVLID_PARAMETER "Error: invalid Parameters file for layer: "
+#define ERROR_INVALID_DIMS "Error: invalid input dims: "
+#define ERROR_WRITE_MODEL "Error: failed to write model file: "
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlpconvert rows cols w1 b1 [w2 b2 ...] model\n" \
+                  "\trows, cols - dims of the input image\n" \
+                  "\twi - the i'th layer's weights, as many rows as bi and as many cols as " \
+                  "the previous layer's rows (the image's pixels for the first one)\n" \
+                  "\tbi - the i'th layer's biases, one per row\n" \
+                  "\tmodel - output packed model file, the last layer Softmax and the others " \
+                  "Relu"
+
+#define ARGS_START_IDX 1
+#define ROWS_IDX ARGS_START_IDX
+#define COLS_IDX (ARGS_START_IDX + 1)
+#define LAYERS_START_IDX (ARGS_START_IDX + 2)
+// the program name, the input dims, at least one layer and the output.
+#define MIN_ARGS_COUNT (LAYERS_START_IDX + 3)
+
+/**
+ * Converts loose parameter files, a weights and a bias file per layer, to a single packed
+ * model file. The layers' shapes come from the files: the rows from the bias size, the cols
+ * from the rows before (the input's pixels for the first layer), so any depth and widths can
+ * be packed, e.g the default topology's parameters/ files:
+ * ./mlpconvert 28 28 w1 b1 w2 b2 w3 b3 w4 b4 model.mlp
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    if (argc < MIN_ARGS_COUNT || (argc - LAYERS_START_IDX - 1) % 2 != 0)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        return EXIT_FAILURE;
+    }
+    MatrixDims inputDims{std::atoi(argv[ROWS_IDX]), std::atoi(argv[COLS_IDX])};
+    if (inputDims.rows <= 0 || inputDims.cols <= 0)
+    {
+        std::cerr << ERROR_INVALID_DIMS << argv[ROWS_IDX] << " " << argv[COLS_IDX] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int layerCount = (argc - LAYERS_START_IDX - 1) / 2;
+    const char *outputPath = argv[argc - 1];
+    std::vector<MappedFile> files(2 * layerCount);
+    std::vector<Matrix> weights(layerCount);
+    std::vector<Matrix> biases(layerCount);
+    std::vector<ActivationType> activations(layerCount);
+    int cols = inputDims.rows * inputDims.cols;
+    for (int i = 0; i < layerCount; i++)
+    {
+        const char *weightsPath = argv[LAYERS_START_IDX + 2 * i];
+        const char *biasPath = argv[LAYERS_START_IDX + 2 * i + 1];
+        MappedFile &biasFile = files[2 * i + 1];
+        bool valid = biasFile.map(biasPath) && biasFile.getSize() % sizeof(float) == 0;
+        int rows = valid ? (int) (biasFile.getSize() / sizeof(float)) : 0;
+        if (!(valid && mapFileToMatrix(biasPath, biasFile, rows, 1, biases[i]) &&
+              mapFileToMatrix(weightsPath, files[2 * i], rows, cols, weights[i])))
+        {
+            std::cerr << ERROR_INAVLID_PARAMETER << (i + 1) << std::endl;
+            return EXIT_FAILURE;
+        }
+        activations[i] = (i == layerCount - 1) ? Softmax : Relu;
+        cols = rows;
+    }
+
+    if (!ModelFile::write(outputPath, inputDims, weights.data(), biases.data(),
+                          activations.data(), layerCount))
+    {
+        std::cerr << ERROR_WRITE_MODEL << outputPath << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
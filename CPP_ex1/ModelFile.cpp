@@ -0,0 +1,194 @@
+// ModelFile.cpp
+
+#include <cstring>
+#include <fstream>
+#include "ModelFile.h"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+namespace
+{
+/**
+ * FNV-1a 64 bit hash of size bytes.
+ */
+uint64_t checksum(const uint8_t *data, size_t size)
+{
+    uint64_t hash = FNV_OFFSET_BASIS;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/**
+ * @return offset rounded up to the next multiple of MODEL_ALIGNMENT.
+ */
+uint64_t align(uint64_t offset)
+{
+    return (offset + MODEL_ALIGNMENT - 1) / MODEL_ALIGNMENT * MODEL_ALIGNMENT;
+}
+
+/**
+ * @return true if count floats starting at offset are inside a file of fileSize bytes, and
+ *         offset is properly aligned.
+ */
+bool validPayload(uint64_t offset, uint64_t count, uint64_t fileSize)
+{
+    return offset % MODEL_ALIGNMENT == 0 && offset <= fileSize &&
+           count <= (fileSize - offset) / sizeof(float);
+}
+}
+
+ModelFile::ModelFile()
+: _inputDims{0, 0}, _inputLayer(0){}
+
+bool ModelFile::load(const std::string &path)
+{
+    _weights.clear();
+    _biases.clear();
+    _activations.clear();
+    if (!_file.map(path))
+    {
+        return false;
+    }
+
+    const uint8_t *base = static_cast<const uint8_t *>(_file.getData());
+    uint64_t size = _file.getSize();
+    ModelHeader header;
+    if (size < sizeof(header))
+    {
+        return false;
+    }
+    std::memcpy(&header, base, sizeof(header));
+    if (std::memcmp(header.magic, MODEL_MAGIC, MODEL_MAGIC_SIZE) != 0 ||
+        header.version != MODEL_VERSION || header.byteOrder != MODEL_BYTE_ORDER ||
+        header.fileSize != size || header.layerCount == 0 ||
+        header.layerCount > (size - sizeof(header)) / sizeof(LayerRecord))
+    {
+        return false;
+    }
+    if (checksum(base + sizeof(header), size - sizeof(header)) != header.checksum)
+    {
+        return false;
+    }
+
+    const LayerRecord *records = reinterpret_cast<const LayerRecord *>(base + sizeof(header));
+    uint32_t expectedCols = header.inputRows * header.inputCols;
+    for (uint32_t i = 0; i < header.layerCount; i++)
+    {
+        const LayerRecord &rec = records[i];
+        if (rec.cols != expectedCols || rec.rows == 0 || rec.activation > Softmax ||
+            !validPayload(rec.weightsOffset, (uint64_t) rec.rows * rec.cols, size) ||
+            !validPayload(rec.biasOffset, rec.rows, size))
+        {
+            return false;
+        }
+        const float *weights = reinterpret_cast<const float *>(base + rec.weightsOffset);
+        const float *bias = reinterpret_cast<const float *>(base + rec.biasOffset);
+        _weights.emplace_back(rec.rows, rec.cols, weights);
+        _biases.emplace_back(rec.rows, 1, bias);
+        _activations.push_back((ActivationType) rec.activation);
+        expectedCols = rec.rows;
+    }
+    _inputDims = MatrixDims{(int) header.inputRows, (int) header.inputCols};
+    _inputLayer = (int) header.inputLayer;
+    return true;
+}
+
+int ModelFile::getLayerCount() const
+{
+    return (int) _weights.size();
+}
+
+MatrixDims ModelFile::getInputDims() const
+{
+    return _inputDims;
+}
+
+int ModelFile::getInputLayer() const
+{
+    return _inputLayer;
+}
+
+const Matrix& ModelFile::getWeights(int layer) const
+{
+    return _weights[layer];
+}
+
+const Matrix& ModelFile::getBias(int layer) const
+{
+    return _biases[layer];
+}
+
+ActivationType ModelFile::getActivation(int layer) const
+{
+    return _activations[layer];
+}
+
+bool ModelFile::write(const std::string &path, MatrixDims inputDims, const Matrix weights[],
+                      const Matrix biases[], const ActivationType activations[],
+                      int layerCount, int inputLayer)
+{
+    // lay out the layer table and the payloads first, the checksum covers all of it.
+    std::vector<LayerRecord> records(layerCount);
+    uint64_t offset = align(sizeof(ModelHeader) + layerCount * sizeof(LayerRecord));
+    int expectedCols = inputDims.rows * inputDims.cols;
+    for (int i = 0; i < layerCount; i++)
+    {
+        int rows = weights[i].getRows();
+        if (weights[i].getCols() != expectedCols ||
+            biases[i].getRows() * biases[i].getCols() != rows)
+        {
+            return false;
+        }
+        LayerRecord &rec = records[i];
+        rec.rows = rows;
+        rec.cols = weights[i].getCols();
+        rec.activation = activations[i];
+        rec.reserved = 0;
+        rec.weightsOffset = offset;
+        offset = align(offset + (uint64_t) rows * rec.cols * sizeof(float));
+        rec.biasOffset = offset;
+        offset = align(offset + rows * sizeof(float));
+        expectedCols = rows;
+    }
+
+    std::vector<uint8_t> buffer(offset, 0);
+    std::memcpy(buffer.data() + sizeof(ModelHeader), records.data(),
+                records.size() * sizeof(LayerRecord));
+    for (int i = 0; i < layerCount; i++)
+    {
+        for (int r = 0; r < weights[i].getRows(); r++)
+        {
+            std::memcpy(buffer.data() + records[i].weightsOffset +
+                        (size_t) r * records[i].cols * sizeof(float), &weights[i](r, 0),
+                        records[i].cols * sizeof(float));
+        }
+        std::memcpy(buffer.data() + records[i].biasOffset, biases[i].getData(),
+                    records[i].rows * sizeof(float));
+    }
+
+    ModelHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, MODEL_MAGIC, MODEL_MAGIC_SIZE);
+    header.version = MODEL_VERSION;
+    header.byteOrder = MODEL_BYTE_ORDER;
+    header.layerCount = layerCount;
+    header.inputRows = inputDims.rows;
+    header.inputCols = inputDims.cols;
+    header.inputLayer = inputLayer;
+    header.fileSize = offset;
+    header.checksum = checksum(buffer.data() + sizeof(header), offset - sizeof(header));
+    std::memcpy(buffer.data(), &header, sizeof(header));
+
+    std::ofstream os(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!os.is_open())
+    {
+        return false;
+    }
+    os.write(reinterpret_cast<const char *>(buffer.data()), buffer.size());
+    return os.good();
+}
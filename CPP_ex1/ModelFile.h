@@ -0,0 +1,122 @@
+// ModelFile.h
+
+#ifndef MODELFILE_H
+#define MODELFILE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Activation.h"
+#include "MappedFile.h"
+#include "Matrix.h"
+
+#define MODEL_MAGIC "MLPMODEL"
+#define MODEL_MAGIC_SIZE 8
+#define MODEL_VERSION 1
+#define MODEL_BYTE_ORDER 0x01020304u
+#define MODEL_ALIGNMENT 64
+
+/**
+ * @struct ModelHeader
+ * @brief First MODEL_ALIGNMENT bytes of a packed model file.
+ * @var magic - MODEL_MAGIC
+ * @var version - MODEL_VERSION
+ * @var byteOrder - MODEL_BYTE_ORDER as written by the producer, a loader on a host of the
+ *      other endianness reads it swapped and rejects the file.
+ * @var layerCount - number of LayerRecord entries following the header
+ * @var inputRows, inputCols - dims of the input image
+ * @var inputLayer - layer of another model whose input this one reads, 0 for that model's own
+ *      input: the tap of an exit head (see CascadeNetwork), 0 for a whole network
+ * @var fileSize - total file size in bytes
+ * @var checksum - FNV-1a 64 of every byte after the header
+ */
+typedef struct ModelHeader
+{
+    char magic[MODEL_MAGIC_SIZE];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint32_t layerCount;
+    uint32_t inputRows;
+    uint32_t inputCols;
+    uint32_t inputLayer;
+    uint64_t fileSize;
+    uint64_t checksum;
+    uint8_t padding[16];
+} ModelHeader;
+
+/**
+ * @struct LayerRecord
+ * @brief Description of one Dense layer in a packed model file.
+ * @var rows, cols - weights dims, the bias is a rows x 1 vector
+ * @var activation - ActivationType of the layer
+ * @var weightsOffset, biasOffset - file offsets of the float32 payloads, both multiples of
+ *      MODEL_ALIGNMENT
+ */
+typedef struct LayerRecord
+{
+    uint32_t rows;
+    uint32_t cols;
+    uint32_t activation;
+    uint32_t reserved;
+    uint64_t weightsOffset;
+    uint64_t biasOffset;
+} LayerRecord;
+
+static_assert(sizeof(ModelHeader) == MODEL_ALIGNMENT, "ModelHeader must fill one alignment unit");
+static_assert(sizeof(LayerRecord) == 32, "LayerRecord layout must not depend on the compiler");
+
+/**
+ * @class ModelFile
+ * @brief Single file container of a whole Mlp model: layer count, shapes, activation types
+ *        and 64 byte aligned tensor payloads protected by a checksum.
+ *        Loading maps the file once, and the layers' matrices are read-only views of it.
+ */
+class ModelFile
+{
+private:
+    MappedFile _file;
+    MatrixDims _inputDims;
+    int _inputLayer;
+    std::vector<Matrix> _weights;
+    std::vector<Matrix> _biases;
+    std::vector<ActivationType> _activations;
+
+public:
+    ModelFile();
+
+    /**
+     * Maps and validates a packed model file.
+     * @param path model file path
+     * @return boolean status
+     *          true - success
+     *          false - failure (unreadable file, bad magic/version/byte order, truncated or
+     *                  misaligned payload, or checksum mismatch)
+     */
+    bool load(const std::string &path);
+
+    int getLayerCount() const;
+    MatrixDims getInputDims() const;
+    /**
+     * @return the layer of another model whose input this one reads, see ModelHeader.
+     */
+    int getInputLayer() const;
+    const Matrix& getWeights(int layer) const;
+    const Matrix& getBias(int layer) const;
+    ActivationType getActivation(int layer) const;
+
+    /**
+     * Packs the given layers into a model file.
+     * @param path output file path
+     * @param inputDims dims of the input image
+     * @param weights, biases, activations - layerCount entries each, layer by layer
+     * @param inputLayer layer of another model whose input this one reads, see ModelHeader
+     * @return boolean status
+     *          true - success
+     *          false - failure (mismatched shapes or unwritable file)
+     */
+    static bool write(const std::string &path, MatrixDims inputDims, const Matrix weights[],
+                      const Matrix biases[], const ActivationType activations[],
+                      int layerCount, int inputLayer = 0);
+};
+
+#endif //MODELFILE_H
@@ -0,0 +1,196 @@
+// ModelPruner.cpp
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ImageList.h"
+#include "MappedFile.h"
+#include "MlpNetwork.h"
+#include "ModelFile.h"
+#include "SparseMatrix.h"
+
+#define ERROR_INVALID_MODEL "Error: invalid model file: "
+#define ERROR_INVALID_SPARSITY "Error: sparsity must be in [0, 1): "
+#define ERROR_INVALID_DIR "Error: unable to read images directory or list: "
+#define ERROR_INVALID_IMG "Error: invalid image path or size: "
+#define ERROR_WRITE_MODEL "Error: failed to write model file: "
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlpprune model sparsity pruned [images]\n" \
+                  "\tmodel - packed model file (see mlpconvert)\n" \
+                  "\tsparsity - fraction of the weight blocks to zero in every layer but the " \
+                  "last one, e.g 0.5\n" \
+                  "\tpruned - output packed model file\n" \
+                  "\timages - directory or list file of raw float32 images to compare the " \
+                  "pruned model's digits with the original's on"
+
+#define ARGS_START_IDX 1
+#define MODEL_PATH_IDX ARGS_START_IDX
+#define SPARSITY_IDX (MODEL_PATH_IDX + 1)
+#define OUTPUT_IDX (SPARSITY_IDX + 1)
+#define IMAGES_IDX (OUTPUT_IDX + 1)
+#define ARGS_COUNT (OUTPUT_IDX + 1)
+#define IMAGES_ARGS_COUNT (IMAGES_IDX + 1)
+
+namespace
+{
+/**
+ * Magnitude pruning at the granularity SparseMatrix skips: zeroes the given fraction of the
+ * blocks of SPARSE_BLOCK rows of a column with the smallest L2 norms.
+ * @param weights owned matrix, pruned in place
+ */
+void pruneBlocks(Matrix &weights, float sparsity)
+{
+    int rows = weights.getRows();
+    int cols = weights.getCols();
+    int blocksPerCol = (rows + SPARSE_BLOCK - 1) / SPARSE_BLOCK;
+    std::vector<float> norms;
+    for (int j = 0; j < cols; j++)
+    {
+        for (int row = 0; row < rows; row += SPARSE_BLOCK)
+        {
+            float norm = 0;
+            for (int i = row; i < std::min(row + SPARSE_BLOCK, rows); i++)
+            {
+                norm += weights(i, j) * weights(i, j);
+            }
+            norms.push_back(norm);
+        }
+    }
+    size_t pruned = (size_t) (sparsity * norms.size());
+    if (pruned == 0)
+    {
+        return;
+    }
+    std::vector<float> sorted(norms);
+    std::nth_element(sorted.begin(), sorted.begin() + (pruned - 1), sorted.end());
+    float threshold = sorted[pruned - 1];
+    // the blocks under the threshold first, then the ties at it in column order until the
+    // count is reached.
+    size_t remaining = pruned;
+    for (int ties = 0; ties < 2; ties++)
+    {
+        for (size_t b = 0; b < norms.size() && remaining > 0; b++)
+        {
+            if (ties ? norms[b] != threshold : norms[b] >= threshold)
+            {
+                continue;
+            }
+            int j = (int) (b / blocksPerCol);
+            int row = (int) (b % blocksPerCol) * SPARSE_BLOCK;
+            for (int i = row; i < std::min(row + SPARSE_BLOCK, rows); i++)
+            {
+                weights(i, j) = 0;
+            }
+            remaining--;
+        }
+    }
+}
+}
+
+/**
+ * Prunes a model for the sparse product: every layer but the last one (the classifier, whose
+ * blocks each hold a whole input feature) loses the requested fraction of its weight blocks,
+ * smallest first. Reports the block density of every layer and whether it runs sparse, and
+ * optionally how many digits of a set of images the pruning changed.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    if (argc != ARGS_COUNT && argc != IMAGES_ARGS_COUNT)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        return EXIT_FAILURE;
+    }
+    ModelFile model;
+    if (!model.load(argv[MODEL_PATH_IDX]))
+    {
+        std::cerr << ERROR_INVALID_MODEL << argv[MODEL_PATH_IDX] << std::endl;
+        return EXIT_FAILURE;
+    }
+    char *end = nullptr;
+    float sparsity = std::strtof(argv[SPARSITY_IDX], &end);
+    if (*end != '\0' || !(sparsity >= 0 && sparsity < 1))
+    {
+        std::cerr << ERROR_INVALID_SPARSITY << argv[SPARSITY_IDX] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int layerCount = model.getLayerCount();
+    std::vector<Matrix> weights;
+    std::vector<Matrix> biases;
+    std::vector<ActivationType> activations;
+    std::vector<Dense> layers;
+    std::cout << std::left << std::setw(8) << "layer" << std::setw(12) << "shape"
+              << std::setw(16) << "block density" << "dense inputs" << std::endl;
+    for (int i = 0; i < layerCount; i++)
+    {
+        const Matrix &original = model.getWeights(i);
+        Matrix w(original.getRows(), original.getCols()); // owned, the model's are read-only
+        for (int r = 0; r < w.getRows(); r++)
+        {
+            for (int c = 0; c < w.getCols(); c++)
+            {
+                w(r, c) = original(r, c);
+            }
+        }
+        if (i < layerCount - 1)
+        {
+            pruneBlocks(w, sparsity);
+        }
+        float density = SparseMatrix::blockDensity(w);
+        std::cout << std::left << std::setw(8) << i << std::setw(12)
+                  << std::to_string(w.getRows()) + "x" + std::to_string(w.getCols())
+                  << std::fixed << std::setprecision(3) << std::setw(16) << density
+                  << (density < SPARSE_WORK_THRESHOLD ? "sparse" : "dense") << std::endl;
+        weights.push_back(w);
+        biases.push_back(model.getBias(i));
+        activations.push_back(model.getActivation(i));
+        layers.emplace_back(w, model.getBias(i), model.getActivation(i));
+    }
+    if (!ModelFile::write(argv[OUTPUT_IDX], model.getInputDims(), weights.data(), biases.data(),
+                          activations.data(), layerCount))
+    {
+        std::cerr << ERROR_WRITE_MODEL << argv[OUTPUT_IDX] << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (argc != IMAGES_ARGS_COUNT)
+    {
+        return EXIT_SUCCESS;
+    }
+
+    std::vector<std::string> paths;
+    if (!listImages(argv[IMAGES_IDX], paths))
+    {
+        std::cerr << ERROR_INVALID_DIR << argv[IMAGES_IDX] << std::endl;
+        return EXIT_FAILURE;
+    }
+    MlpNetwork mlp(model);
+    MlpNetwork pruned(layers);
+    MatrixDims inputDims = model.getInputDims();
+    int agree = 0;
+    float maxDrift = 0;
+    for (const std::string &path : paths)
+    {
+        MappedFile file;
+        Matrix img;
+        if (!mapFileToMatrix(path, file, inputDims.rows, inputDims.cols, img))
+        {
+            std::cerr << ERROR_INVALID_IMG << path << std::endl;
+            return EXIT_FAILURE;
+        }
+        Digit before = mlp(img);
+        Digit after = pruned(img);
+        agree += before.value == after.value;
+        maxDrift = std::max(maxDrift, std::fabs(before.probability - after.probability));
+    }
+    std::cout << std::endl << "top-1 agreement: " << agree << "/" << paths.size()
+              << ", max probability drift: " << maxDrift << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,156 @@
+// QuantCalibrator.cpp
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "ImageList.h"
+#include "MappedFile.h"
+#include "MlpNetwork.h"
+#include "ModelFile.h"
+#include "QuantizedNetwork.h"
+
+#define ERROR_INAVLID_PARAMETER "Error: invalid Parameters file for layer: "
+#define ERROR_INVALID_DIR "Error: unable to read images directory or list: "
+#define ERROR_INVALID_IMG "Error: invalid image path or size: "
+#define ERROR_NO_IMAGES "Error: no images to calibrate on in: "
+#define ERROR_INVALID_MODEL "Error: invalid model file: "
+#define ERROR_WRITE_CALIBRATION "Error: failed to write calibration file: "
+#define USAGE_MSG "Usage:\n" \
+                  "\t./mlpcalibrate w1 w2 w3 w4 b1 b2 b3 b4 images calibration\n" \
+                  "\t./mlpcalibrate model images calibration\n" \
+                  "\twi - the i'th layer's weights\n" \
+                  "\tbi - the i'th layer's biases\n" \
+                  "\tmodel - packed model file (see mlpconvert)\n" \
+                  "\timages - directory or list file of raw float32 images\n" \
+                  "\tcalibration - output file of the quantized layers' input ranges"
+
+#define ARGS_START_IDX 1
+#define WEIGHTS_START_IDX ARGS_START_IDX
+#define BIAS_START_IDX (ARGS_START_IDX + MLP_SIZE)
+#define IMAGES_IDX (ARGS_START_IDX + (MLP_SIZE * 2))
+#define OUTPUT_IDX (IMAGES_IDX + 1)
+#define ARGS_COUNT (OUTPUT_IDX + 1)
+// the model form: model images calibration.
+#define MODEL_PATH_IDX ARGS_START_IDX
+#define MODEL_IMAGES_IDX (MODEL_PATH_IDX + 1)
+#define MODEL_ARGS_COUNT (MODEL_IMAGES_IDX + 2)
+
+/**
+ * Calibrates the INT8 path on a directory of images: records every layer's input range on
+ * the float network, writes them to the calibration file, then classifies every image with
+ * both networks and reports the drift of the quantized one.
+ * @param argc count of args
+ * @param argv args values
+ * @return program exit status code
+ */
+int main(int argc, char **argv)
+{
+    if (argc != ARGS_COUNT && argc != MODEL_ARGS_COUNT)
+    {
+        std::cout << USAGE_MSG << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    MappedFile files[2 * MLP_SIZE];
+    ModelFile model;
+    Matrix weights[MLP_SIZE];
+    Matrix biases[MLP_SIZE];
+    MatrixDims inputDims = imgDims;
+    bool modelForm = argc == MODEL_ARGS_COUNT;
+    if (modelForm)
+    {
+        if (!model.load(argv[MODEL_PATH_IDX]))
+        {
+            std::cerr << ERROR_INVALID_MODEL << argv[MODEL_PATH_IDX] << std::endl;
+            return EXIT_FAILURE;
+        }
+        inputDims = model.getInputDims();
+    }
+    for (int i = 0; !modelForm && i < MLP_SIZE; i++)
+    {
+        if (!(mapFileToMatrix(argv[WEIGHTS_START_IDX + i], files[i], weightsDims[i].rows,
+                              weightsDims[i].cols, weights[i]) &&
+              mapFileToMatrix(argv[BIAS_START_IDX + i], files[MLP_SIZE + i], biasDims[i].rows,
+                              biasDims[i].cols, biases[i])))
+        {
+            std::cerr << ERROR_INAVLID_PARAMETER << (i + 1) << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    MlpNetwork mlp = modelForm ? MlpNetwork(model) : MlpNetwork(weights, biases);
+    int imagesIdx = modelForm ? MODEL_IMAGES_IDX : IMAGES_IDX;
+    const char *output = argv[imagesIdx + 1];
+
+    std::string dir(argv[imagesIdx]);
+    std::vector<std::string> paths;
+    if (!listImages(dir, paths))
+    {
+        std::cerr << ERROR_INVALID_DIR << dir << std::endl;
+        return EXIT_FAILURE;
+    }
+    if (paths.empty())
+    {
+        std::cerr << ERROR_NO_IMAGES << dir << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<MappedFile> imageFiles(paths.size());
+    std::vector<Matrix> images(paths.size());
+    for (size_t j = 0; j < paths.size(); j++)
+    {
+        if (!mapFileToMatrix(paths[j], imageFiles[j], inputDims.rows, inputDims.cols,
+                             images[j]))
+        {
+            std::cerr << ERROR_INVALID_IMG << paths[j] << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<float> ranges(mlp.getLayerCount());
+    calibrateRanges(mlp, images.data(), (int) images.size(), ranges.data());
+    if (!writeCalibration(output, ranges.data(), mlp.getLayerCount()))
+    {
+        std::cerr << ERROR_WRITE_CALIBRATION << output << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << "input ranges:";
+    for (float range : ranges)
+    {
+        std::cout << " " << range;
+    }
+    std::cout << std::endl << std::endl;
+
+    QuantizedNetwork quantized(mlp, ranges.data());
+    int agree = 0;
+    float maxDrift = 0;
+    std::cout << std::left << std::setw(16) << "image" << std::setw(20) << "float32"
+              << std::setw(20) << "int8" << "drift" << std::endl;
+    for (size_t j = 0; j < images.size(); j++)
+    {
+        Digit f = mlp(images[j]);
+        Digit q = quantized(images[j]);
+        float drift = std::fabs(f.probability - q.probability);
+        agree += f.value == q.value;
+        maxDrift = std::max(maxDrift, drift);
+        std::cout << std::left << std::setw(16) << paths[j] << std::fixed
+                  << std::setprecision(4) << f.value << " @ " << std::setw(16) << f.probability
+                  << q.value << " @ " << std::setw(16) << q.probability
+                  << (f.value == q.value ? "" : "MISMATCH ") << drift << std::endl;
+    }
+
+    size_t floatBytes = 0;
+    for (const Dense &layer : mlp.getLayers())
+    {
+        floatBytes += (size_t) layer.getWeights().getRows() * layer.getWeights().getCols() *
+                      sizeof(float);
+    }
+    std::cout << std::endl << "top-1 agreement: " << agree << "/" << images.size()
+              << ", max probability drift: " << maxDrift << std::endl
+              << "weights: " << floatBytes << " bytes float32, " << quantized.getWeightsBytes()
+              << " bytes int8" << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,217 @@
+// QuantizedNetwork.cpp
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include "Instrument.h"
+#include "Kernels.h"
+#include "QuantizedNetwork.h"
+
+QuantizedDense::QuantizedDense(const Dense &layer, float inputRange)
+: _rows(layer.getWeights().getRows()), _cols(layer.getWeights().getCols()),
+  _weights((size_t) _rows * _cols), _rowScales(_rows), _bias(layer.getBias()),
+  _inputScale(inputRange > 0 ? inputRange / QUANT_ACTIVATION_MAX : 1.0f),
+  _activation(layer.getActivation())
+{
+    const Matrix &w = layer.getWeights();
+    for (int i = 0; i < _rows; i++)
+    {
+        const float *row = &w(i, 0);
+        float maxAbs = 0;
+        for (int p = 0; p < _cols; p++)
+        {
+            maxAbs = std::max(maxAbs, std::fabs(row[p]));
+        }
+        float scale = maxAbs > 0 ? maxAbs / QUANT_WEIGHT_MAX : 1.0f;
+        _rowScales[i] = scale;
+        int8_t *q = _weights.data() + (size_t) i * _cols;
+        for (int p = 0; p < _cols; p++)
+        {
+            q[p] = (int8_t) std::lround(row[p] / scale);
+        }
+    }
+}
+
+int QuantizedDense::getRows() const
+{
+    return _rows;
+}
+
+int QuantizedDense::getCols() const
+{
+    return _cols;
+}
+
+const Activation& QuantizedDense::getActivation() const
+{
+    return _activation;
+}
+
+size_t QuantizedDense::getWeightsBytes() const
+{
+    return _weights.size() * sizeof(int8_t);
+}
+
+void QuantizedDense::forward(const Matrix &input, Matrix &output, uint8_t *scratch) const
+{
+    forwardLogits(input, output, scratch);
+    if (_activation.getType() != Relu)
+    {
+        _activation.apply(output);
+    }
+}
+
+void QuantizedDense::forwardLogits(const Matrix &input, Matrix &output, uint8_t *scratch) const
+{
+    kernels().quantize(input.getData(), 1.0f / _inputScale, scratch, _cols);
+    output.resize(_rows, 1);
+    bool relu = _activation.getType() == Relu;
+    kernels().gemvInt8(_rows, _cols, _weights.data(), _cols, scratch, _rowScales.data(),
+                       _inputScale, _bias.getData(), relu, output.getData());
+}
+
+QuantizedNetwork::QuantizedNetwork(const MlpNetwork &network, const float inputRanges[])
+: _inputSize(network.getInputSize()), _workspace(network.makeWorkspace(DEFAULT_MAX_BATCH))
+{
+    _layers.reserve(network.getLayerCount());
+    for (int i = 0; i < network.getLayerCount(); i++)
+    {
+        _layers.emplace_back(network.getLayers()[i], inputRanges[i]);
+    }
+}
+
+Workspace QuantizedNetwork::makeWorkspace(int maxBatch) const
+{
+    std::vector<MatrixDims> dims;
+    for (const QuantizedDense &layer : _layers)
+    {
+        dims.push_back(MatrixDims{layer.getRows(), layer.getCols()});
+    }
+    return Workspace(dims, maxBatch);
+}
+
+size_t QuantizedNetwork::getWeightsBytes() const
+{
+    size_t bytes = 0;
+    for (const QuantizedDense &layer : _layers)
+    {
+        bytes += layer.getWeightsBytes();
+    }
+    return bytes;
+}
+
+Digit QuantizedNetwork::operator()(const Matrix &img) const
+{
+    return (*this)(img, _workspace);
+}
+
+Digit QuantizedNetwork::operator()(const Matrix &img, Workspace &ws) const
+{
+    if (img.getRows() * img.getCols() != _inputSize)
+    {
+        std::cerr << BATCH_DIM_ERR << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    const Matrix vec(_inputSize, 1, img.getData()); // view, no copy
+    const Matrix *activations = &vec;
+    for (size_t i = 0; i < _layers.size(); i++)
+    {
+        Matrix &output = ws.layerOutput(i);
+        {
+            INSTRUMENT_LAYER(Int8Network, (int) i, _layers[i].getRows(), _layers[i].getCols(), 1,
+                             sizeof(int8_t));
+            _layers[i].forwardLogits(*activations, output,
+                                     ws.quantizedInput(_layers[i].getCols()));
+        }
+        activations = &output;
+    }
+    Matrix &output = ws.layerOutput(_layers.size() - 1);
+    if (_layers.back().getActivation().getType() == Softmax)
+    {
+        return Activation::softmaxDigit(output.getData(), output.getRows());
+    }
+    return MlpNetwork::toDigit(output, 0);
+}
+
+void QuantizedNetwork::classifyBatch(const Matrix images[], int count, Digit results[],
+                                     Workspace &ws) const
+{
+    for (int j = 0; j < count; j++)
+    {
+        results[j] = (*this)(images[j], ws);
+    }
+}
+
+void calibrateRanges(const MlpNetwork &network, const Matrix images[], int count,
+                     float inputRanges[])
+{
+    const std::vector<Dense> &layers = network.getLayers();
+    for (int i = 0; i < network.getLayerCount(); i++)
+    {
+        inputRanges[i] = 0;
+    }
+    Workspace ws = network.makeWorkspace(DEFAULT_MAX_BATCH);
+    for (int j = 0; j < count; j++)
+    {
+        const Matrix vec(network.getInputSize(), 1, images[j].getData());
+        const Matrix *activations = &vec;
+        for (int i = 0; i < network.getLayerCount(); i++)
+        {
+            const float *x = activations->getData();
+            for (int p = 0; p < activations->getRows(); p++)
+            {
+                inputRanges[i] = std::max(inputRanges[i], x[p]);
+            }
+            Matrix &output = ws.layerOutput(i);
+            layers[i].forward(*activations, output);
+            activations = &output;
+        }
+    }
+}
+
+bool writeCalibration(const std::string &path, const float inputRanges[], int count)
+{
+    std::ofstream os(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!os.is_open())
+    {
+        return false;
+    }
+    uint32_t n = count;
+    os.write(CALIBRATION_MAGIC, CALIBRATION_MAGIC_SIZE);
+    os.write(reinterpret_cast<const char *>(&n), sizeof(n));
+    os.write(reinterpret_cast<const char *>(inputRanges), count * sizeof(float));
+    return os.good();
+}
+
+bool readCalibration(const std::string &path, float inputRanges[], int count)
+{
+    std::ifstream is(path, std::ios::in | std::ios::binary);
+    if (!is.is_open())
+    {
+        return false;
+    }
+    char magic[CALIBRATION_MAGIC_SIZE];
+    uint32_t n = 0;
+    is.read(magic, CALIBRATION_MAGIC_SIZE);
+    is.read(reinterpret_cast<char *>(&n), sizeof(n));
+    if (!is.good() || std::memcmp(magic, CALIBRATION_MAGIC, CALIBRATION_MAGIC_SIZE) != 0 ||
+        n != (uint32_t) count)
+    {
+        return false;
+    }
+    is.read(reinterpret_cast<char *>(inputRanges), count * sizeof(float));
+    if (!is.good() || is.peek() != std::ifstream::traits_type::eof())
+    {
+        return false;
+    }
+    for (int i = 0; i < count; i++)
+    {
+        if (!(inputRanges[i] > 0) || std::isinf(inputRanges[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
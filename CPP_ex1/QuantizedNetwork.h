@@ -0,0 +1,148 @@
+// QuantizedNetwork.h
+
+#ifndef QUANTIZEDNETWORK_H
+#define QUANTIZEDNETWORK_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Activation.h"
+#include "Dense.h"
+#include "Digit.h"
+#include "Matrix.h"
+#include "MlpNetwork.h"
+#include "Workspace.h"
+
+#define CALIBRATION_MAGIC "MLPCALIB"
+#define CALIBRATION_MAGIC_SIZE 8
+
+/**
+ * @class QuantizedDense
+ * @brief INT8 version of a Dense layer.
+ *        Weights are quantized symmetrically per row: w ~= q * rowScale, q in [-127, 127].
+ *        Inputs are quantized with a calibrated range: x ~= q * range / 127, q in [0, 127],
+ *        which fits the network since every layer input (pixels, relu outputs) is non
+ *        negative; inputs above the range saturate.
+ *        The dot products accumulate in int32 and are rescaled to float once per output,
+ *        together with the bias and relu.
+ */
+class QuantizedDense
+{
+private:
+    int _rows;
+    int _cols;
+    std::vector<int8_t> _weights;
+    std::vector<float> _rowScales;
+    Matrix _bias;
+    float _inputScale;
+    Activation _activation;
+
+public:
+    /**
+     * @param layer float layer to quantize
+     * @param inputRange largest input value expected by the layer (see calibrateRanges)
+     */
+    QuantizedDense(const Dense &layer, float inputRange);
+
+    int getRows() const;
+    int getCols() const;
+    const Activation& getActivation() const;
+
+    /**
+     * @return size of the quantized weights in bytes.
+     */
+    size_t getWeightsBytes() const;
+
+    /**
+     * output = activation(weights * input + bias) for a single input column.
+     * @param input cols x 1 float vector
+     * @param output resized to rows x 1
+     * @param scratch at least cols bytes, receives the quantized input
+     */
+    void forward(const Matrix &input, Matrix &output, uint8_t *scratch) const;
+
+    /**
+     * forward without the softmax of a Softmax layer, see Dense::forwardLogits.
+     */
+    void forwardLogits(const Matrix &input, Matrix &output, uint8_t *scratch) const;
+};
+
+/**
+ * @class QuantizedNetwork
+ * @brief MlpNetwork running on QuantizedDense layers, built from the float network, of any
+ *        topology, and the per layer input ranges found by calibration.
+ *        The first layer's weights shrink 4x (128 x 784 floats to 100KB of int8), so the
+ *        weights of the whole network stay in L2.
+ *        Like MlpNetwork, the variants taking a Workspace are safe to call from several
+ *        threads with one workspace each.
+ */
+class QuantizedNetwork
+{
+private:
+    std::vector<QuantizedDense> _layers;
+    int _inputSize;
+    mutable Workspace _workspace;
+
+public:
+    /**
+     * @param network float network to quantize
+     * @param inputRanges inputRanges[i] is the largest input value of the i'th layer, one
+     *        per layer of network
+     */
+    QuantizedNetwork(const MlpNetwork &network, const float inputRanges[]);
+
+    /**
+     * @param maxBatch largest number of images a forward pass is expected to hold.
+     * @return a workspace sized for this network's layers.
+     */
+    Workspace makeWorkspace(int maxBatch) const;
+
+    /**
+     * @return size of all the quantized weights in bytes.
+     */
+    size_t getWeightsBytes() const;
+
+    /**
+     * Classifies a single image.
+     * @param img image of the network input size, in any shape.
+     */
+    Digit operator()(const Matrix &img) const;
+    Digit operator()(const Matrix &img, Workspace &ws) const;
+
+    /**
+     * Classifies count images, one forward pass each: the int8 kernels are gemv only.
+     * @param images array of count images of the network input size.
+     * @param results array of count digits, results[j] is set to the j'th image's digit.
+     */
+    void classifyBatch(const Matrix images[], int count, Digit results[], Workspace &ws) const;
+};
+
+/**
+ * Calibration: runs the float network on the given images and records the largest input
+ * value every layer sees.
+ * @param network float network
+ * @param images count images of the network input size
+ * @param inputRanges output, inputRanges[i] is the range of the i'th layer input, one per
+ *        layer of network
+ */
+void calibrateRanges(const MlpNetwork &network, const Matrix images[], int count,
+                     float inputRanges[]);
+
+/**
+ * Writes calibrated input ranges to a file: CALIBRATION_MAGIC, a uint32 count, then count
+ * native endian floats.
+ * @return boolean status
+ *          true - success
+ *          false - failure (unwritable file)
+ */
+bool writeCalibration(const std::string &path, const float inputRanges[], int count);
+
+/**
+ * Reads a file written by writeCalibration.
+ * @return boolean status
+ *          true - success
+ *          false - failure (unreadable file, bad magic, other count or invalid range)
+ */
+bool readCalibration(const std::string &path, float inputRanges[], int count);
+
+#endif //QUANTIZEDNETWORK_H
@@ -0,0 +1,187 @@
+// ResultCache.cpp
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "ResultCache.h"
+
+// multiplier of the mix, 2^64 / golden ratio: an odd constant with well spread bits.
+#define HASH_MULTIPLIER 0x9E3779B97F4A7C15ull
+// the mix runs on this many independent 64-bit lanes: each lane's multiply waits for its
+// previous one, four of them keep the multiplier busy.
+#define HASH_LANES 4
+
+namespace
+{
+uint64_t mix(uint64_t h)
+{
+    h *= HASH_MULTIPLIER;
+    return h ^ (h >> 29);
+}
+}
+
+ResultCache::ResultCache(int imgSize, size_t maxBytes)
+: _imgSize(imgSize), _hits(0), _misses(0)
+{
+    size_t entryBytes = imgSize * sizeof(float) + sizeof(Entry) + CACHE_ENTRY_OVERHEAD_BYTES;
+    _capacity = (int) std::min(maxBytes / entryBytes, (size_t) INT32_MAX);
+    _index.reserve(_capacity);
+}
+
+uint64_t ResultCache::hash(const float *image, int size)
+{
+    const char *bytes = reinterpret_cast<const char *>(image);
+    size_t length = size * sizeof(float);
+    uint64_t lanes[HASH_LANES];
+    for (int l = 0; l < HASH_LANES; l++)
+    {
+        lanes[l] = mix(length + l);
+    }
+    size_t i = 0;
+    for (; i + HASH_LANES * sizeof(uint64_t) <= length; i += HASH_LANES * sizeof(uint64_t))
+    {
+        for (int l = 0; l < HASH_LANES; l++)
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes + i + l * sizeof(uint64_t), sizeof(word));
+            lanes[l] = mix(lanes[l] ^ word);
+        }
+    }
+    // the tail, zero padded: the length is mixed in already.
+    for (int l = 0; i < length; l++, i += sizeof(uint64_t))
+    {
+        uint64_t word = 0;
+        std::memcpy(&word, bytes + i, std::min(sizeof(word), length - i));
+        lanes[l] = mix(lanes[l] ^ word);
+    }
+    uint64_t h = 0;
+    for (int l = 0; l < HASH_LANES; l++)
+    {
+        h = mix(h ^ lanes[l]);
+    }
+    return h;
+}
+
+long ResultCache::getHits() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _hits;
+}
+
+long ResultCache::getMisses() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _misses;
+}
+
+int ResultCache::getEntryCount() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return (int) _index.size();
+}
+
+int ResultCache::getCapacity() const
+{
+    return _capacity;
+}
+
+int ResultCache::lookup(const Matrix images[], int count, Digit results[], Scratch &scratch)
+{
+    // hashed before taking the lock, it's most of the work.
+    scratch.positions.clear();
+    scratch.hashes.resize(count);
+    uint64_t *hashes = scratch.hashes.data();
+    for (int j = 0; j < count; j++)
+    {
+        hashes[j] = hash(images[j].getData(), _imgSize);
+    }
+
+    int missing = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (int j = 0; j < count; j++)
+        {
+            auto found = _index.find(hashes[j]);
+            if (found != _index.end() &&
+                std::memcmp(found->second->image.data(), images[j].getData(),
+                            _imgSize * sizeof(float)) == 0)
+            {
+                results[j] = found->second->digit;
+                _entries.splice(_entries.begin(), _entries, found->second);
+                continue;
+            }
+            hashes[missing] = hashes[j];
+            scratch.positions.push_back(j);
+            missing++;
+        }
+        _hits += count - missing;
+        _misses += missing;
+    }
+    // only ever grown: a default Matrix allocates, a view doesn't.
+    if ((int) scratch.images.size() < missing)
+    {
+        scratch.images.resize(missing);
+        scratch.results.resize(missing);
+    }
+    for (int i = 0; i < missing; i++)
+    {
+        const Matrix &img = images[scratch.positions[i]];
+        scratch.images[i] = Matrix(img.getRows(), img.getCols(), img.getData());
+    }
+    return missing;
+}
+
+void ResultCache::insert(Digit results[], const Scratch &scratch)
+{
+    int missing = (int) scratch.positions.size();
+    for (int i = 0; i < missing; i++)
+    {
+        results[scratch.positions[i]] = scratch.results[i];
+    }
+    if (_capacity == 0)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (int i = 0; i < missing; i++)
+    {
+        uint64_t h = scratch.hashes[i];
+        auto found = _index.find(h);
+        std::list<Entry>::iterator entry;
+        if (found != _index.end())
+        {
+            // the same image twice in a batch, or a collision: the newest wins.
+            entry = found->second;
+        }
+        else if ((int) _index.size() < _capacity)
+        {
+            _entries.push_front(Entry{h, std::vector<float>(_imgSize), Digit()});
+            entry = _entries.begin();
+            _index.emplace(h, entry);
+        }
+        else
+        {
+            // full: the least recently used entry is recycled, image buffer and all.
+            entry = std::prev(_entries.end());
+            _index.erase(entry->hash);
+            _index.emplace(h, entry);
+        }
+        entry->hash = h;
+        std::copy(scratch.images[i].getData(), scratch.images[i].getData() + _imgSize,
+                  entry->image.begin());
+        entry->digit = scratch.results[i];
+        _entries.splice(_entries.begin(), _entries, entry);
+    }
+}
+
+size_t defaultCacheBytes()
+{
+    const char *env = std::getenv(CACHE_MB_ENV_VAR);
+    char *end = nullptr;
+    long megabytes = env != nullptr ? std::strtol(env, &end, 10) : -1;
+    if (env != nullptr && *env != '\0' && *end == '\0' && megabytes >= 0)
+    {
+        return (size_t) megabytes << 20;
+    }
+    return (size_t) DEFAULT_CACHE_MB << 20;
+}
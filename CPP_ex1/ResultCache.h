@@ -0,0 +1,141 @@
+// ResultCache.h
+
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "Digit.h"
+#include "Matrix.h"
+
+#define CACHE_MB_ENV_VAR "MLP_CACHE_MB"
+// no cache by default: every miss pays a hash of its image and a copy of it into the cache.
+#define DEFAULT_CACHE_MB 0
+// heap bytes of an entry besides its image and the Entry itself: the list node's links, the
+// hash map's node and bucket, and the allocator's headers.
+#define CACHE_ENTRY_OVERHEAD_BYTES 96
+#define CACHE_STATS_MSG "Cache: hits, misses, entries: "
+
+/**
+ * @class ResultCache
+ * @brief Bounded LRU cache of the digits of images, in front of a network: an image seen
+ *        before gets its digit back without a forward pass, for the price of a hash of its
+ *        bytes and a compare with the cached copy.
+ *        Entries are keyed by a 64-bit hash of the image, and hold a copy of it: a hit is
+ *        only an image of the exact same bytes, never a hash collision. Their count is
+ *        bounded by a memory cap, past which the least recently used entry is replaced.
+ *        Thread safe.
+ */
+class ResultCache
+{
+public:
+    /**
+     * Per caller buffers of classify, reused across calls so a call doesn't allocate.
+     * @var positions - index of every missing image in the call's images
+     * @var hashes - hashes of the missing images, in its first positions.size()
+     * @var images - views of the missing images, likewise
+     * @var results - digits of the missing images, likewise
+     */
+    typedef struct Scratch
+    {
+        std::vector<int> positions;
+        std::vector<uint64_t> hashes;
+        std::vector<Matrix> images;
+        std::vector<Digit> results;
+    } Scratch;
+
+    /**
+     * @param imgSize floats per image
+     * @param maxBytes memory cap, the images plus the bookkeeping of the entries
+     */
+    ResultCache(int imgSize, size_t maxBytes);
+    ResultCache(const ResultCache &other) = delete;
+    ResultCache& operator=(const ResultCache &other) = delete;
+
+    /**
+     * @return 64-bit hash of the bytes of size floats.
+     */
+    static uint64_t hash(const float *image, int size);
+
+    /**
+     * Sets results[j] to the digit of images[j], from the cache if it holds it, and from
+     * classify(missing, missingCount, missingResults) otherwise, called at most once with all
+     * the missing images. The missing images are cached afterwards.
+     * Thread safe, as long as every thread uses its own scratch.
+     * @param images array of count contiguous images of imgSize floats
+     * @param results array of count digits
+     * @param scratch buffers of the calling thread
+     * @param classify the network's batched forward pass
+     */
+    template <typename Classify>
+    void classify(const Matrix images[], int count, Digit results[], Scratch &scratch,
+                  Classify classify)
+    {
+        if (lookup(images, count, results, scratch) > 0)
+        {
+            classify(scratch.images.data(), (int) scratch.positions.size(),
+                     scratch.results.data());
+            insert(results, scratch);
+        }
+    }
+
+    long getHits() const;
+    long getMisses() const;
+    int getEntryCount() const;
+    /**
+     * @return entries the memory cap holds.
+     */
+    int getCapacity() const;
+
+private:
+    /**
+     * A cached image.
+     * @var hash - hash of image
+     * @var image - copy of the image
+     * @var digit - its digit
+     */
+    typedef struct Entry
+    {
+        uint64_t hash;
+        std::vector<float> image;
+        Digit digit;
+    } Entry;
+
+    int _imgSize;
+    int _capacity;
+    /**
+     * guards the members below.
+     */
+    mutable std::mutex _mutex;
+    /**
+     * most recently used first.
+     */
+    std::list<Entry> _entries;
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> _index;
+    long _hits;
+    long _misses;
+
+    /**
+     * Sets the digits of the cached images, and fills scratch with the missing ones.
+     * @return number of missing images.
+     */
+    int lookup(const Matrix images[], int count, Digit results[], Scratch &scratch);
+
+    /**
+     * Copies the digits of the missing images to results and caches them, replacing the
+     * least recently used entries once the cache is full.
+     */
+    void insert(Digit results[], const Scratch &scratch);
+};
+
+/**
+ * @return the memory cap to use, in bytes: the MLP_CACHE_MB environment variable if set to a
+ *         non negative number of megabytes, DEFAULT_CACHE_MB otherwise. 0 means no cache.
+ */
+size_t defaultCacheBytes();
+
+#endif //RESULTCACHE_H
@@ -0,0 +1,114 @@
+// SparseMatrix.cpp
+
+#include <algorithm>
+#include "SparseMatrix.h"
+
+namespace
+{
+/**
+ * @return true if the block of column j starting at row holds a nonzero.
+ */
+bool isNonzeroBlock(const Matrix &m, int row, int j)
+{
+    int end = std::min(row + SPARSE_BLOCK, m.getRows());
+    for (int i = row; i < end; i++)
+    {
+        if (m(i, j) != 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+}
+
+SparseMatrix::SparseMatrix(const Matrix &m)
+: _rows(m.getRows()), _cols(m.getCols()), _colStart(m.getCols() + 1, 0)
+{
+    for (int j = 0; j < _cols; j++)
+    {
+        _colStart[j] = (int) _blockRows.size();
+        for (int row = 0; row < _rows; row += SPARSE_BLOCK)
+        {
+            if (!isNonzeroBlock(m, row, j))
+            {
+                continue;
+            }
+            _blockRows.push_back(row);
+            for (int r = 0; r < SPARSE_BLOCK; r++)
+            {
+                _values.push_back((row + r < _rows) ? m(row + r, j) : 0.0f);
+            }
+        }
+    }
+    _colStart[_cols] = (int) _blockRows.size();
+}
+
+float SparseMatrix::blockDensity(const Matrix &m)
+{
+    int blocksPerCol = (m.getRows() + SPARSE_BLOCK - 1) / SPARSE_BLOCK;
+    if (blocksPerCol == 0 || m.getCols() == 0)
+    {
+        return 1.0f;
+    }
+    long nonzero = 0;
+    for (int j = 0; j < m.getCols(); j++)
+    {
+        for (int row = 0; row < m.getRows(); row += SPARSE_BLOCK)
+        {
+            nonzero += isNonzeroBlock(m, row, j);
+        }
+    }
+    return (float) nonzero / ((float) blocksPerCol * m.getCols());
+}
+
+bool SparseMatrix::worthBuilding(const Matrix &m)
+{
+    return blockDensity(m) <= SPARSE_BUILD_DENSITY;
+}
+
+int SparseMatrix::getRows() const
+{
+    return _rows;
+}
+
+int SparseMatrix::getCols() const
+{
+    return _cols;
+}
+
+int SparseMatrix::getBlockCount() const
+{
+    return (int) _blockRows.size();
+}
+
+float SparseMatrix::getBlockDensity() const
+{
+    int blocksPerCol = (_rows + SPARSE_BLOCK - 1) / SPARSE_BLOCK;
+    if (blocksPerCol == 0 || _cols == 0)
+    {
+        return 1.0f;
+    }
+    return (float) getBlockCount() / ((float) blocksPerCol * _cols);
+}
+
+bool SparseMatrix::beatsDense(const float *x) const
+{
+    int nonzero = 0;
+    for (int j = 0; j < _cols; j++)
+    {
+        nonzero += x[j] != 0;
+    }
+    return getBlockDensity() * (float) nonzero < SPARSE_WORK_THRESHOLD * (float) _cols;
+}
+
+void SparseMatrix::gemv(const float *x, float *y, GemmEpilogue epilogue,
+                        const Kernels *kern) const
+{
+    if (kern == nullptr)
+    {
+        kern = &kernels();
+    }
+    kern->gemvSparse(_rows, _cols, _colStart.data(), _blockRows.data(), _values.data(), x,
+                     epilogue.bias, epilogue.relu, y);
+}
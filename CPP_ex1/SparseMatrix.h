@@ -0,0 +1,90 @@
+// SparseMatrix.h
+
+#ifndef SPARSEMATRIX_H
+#define SPARSEMATRIX_H
+
+#include <vector>
+#include "Gemm.h"
+#include "Kernels.h"
+#include "Matrix.h"
+
+// a single image product runs on the SparseMatrix when its work, the block density times the
+// fraction of nonzero inputs, is under this fraction of the dense gemv's: the sparse product
+// runs at about a third of the dense one's flop rate (see mlpbench).
+#define SPARSE_WORK_THRESHOLD 0.3f
+// a layer only gets a SparseMatrix copy of its weights when at most this fraction of their
+// blocks holds a nonzero: the copy then takes at most about half the memory of the dense
+// weights, and runs its single image products at 2.6-3.4x the dense gemv on a digit. A dense
+// layer's copy would be another full copy of its weights in every process, for the zero
+// pixels alone.
+#define SPARSE_BUILD_DENSITY 0.5f
+
+/**
+ * @class SparseMatrix
+ * @brief Read-only blocked compressed sparse column copy of a Matrix: every column is cut in
+ *        blocks of SPARSE_BLOCK rows and only the blocks holding a nonzero are kept, zero
+ *        padded past the last row. A product with a vector walks the columns of the nonzero
+ *        inputs only, and adds each of their blocks to the output with a single vector FMA,
+ *        so it skips zero weights and zero inputs alike: most pixels of a digit are 0.
+ *        Column blocks rather than CSR rows because skipping an input skips a whole column,
+ *        and a block is one vector of contiguous outputs. The blocks are what mlpprune
+ *        zeroes, element wise sparsity seldom empties a whole block.
+ */
+class SparseMatrix
+{
+private:
+    int _rows;
+    int _cols;
+    /**
+     * the blocks of column j are [_colStart[j], _colStart[j + 1]).
+     */
+    std::vector<int> _colStart;
+    /**
+     * first row of every block.
+     */
+    std::vector<int> _blockRows;
+    /**
+     * SPARSE_BLOCK values per block.
+     */
+    std::vector<float> _values;
+
+public:
+    explicit SparseMatrix(const Matrix &m);
+
+    /**
+     * @return the fraction of the blocks of m (SPARSE_BLOCK rows of a column) holding a
+     *         nonzero: the work of a SparseMatrix product relative to a dense one.
+     */
+    static float blockDensity(const Matrix &m);
+
+    /**
+     * @return true if m is pruned enough for a SparseMatrix of it to pay for its memory: its
+     *         blockDensity is at most SPARSE_BUILD_DENSITY.
+     */
+    static bool worthBuilding(const Matrix &m);
+
+    int getRows() const;
+    int getCols() const;
+    int getBlockCount() const;
+    /**
+     * @return blockDensity of the matrix this was built from.
+     */
+    float getBlockDensity() const;
+
+    /**
+     * Counts the nonzeros of x, a cheap pass next to the product.
+     * @param x cols inputs
+     * @return true if the product with x is cheaper on this than on the dense matrix (see
+     *         SPARSE_WORK_THRESHOLD).
+     */
+    bool beatsDense(const float *x) const;
+
+    /**
+     * y[rows] = epilogue(A * x[cols]), see Kernels::gemvSparse.
+     * @param kern kernel table, nullptr for kernels()
+     */
+    void gemv(const float *x, float *y, GemmEpilogue epilogue = NO_EPILOGUE,
+              const Kernels *kern = nullptr) const;
+};
+
+#endif //SPARSEMATRIX_H
@@ -0,0 +1,123 @@
+// SpscQueue.h
+
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// a blocked push or pop yields this many times before it starts sleeping between polls.
+#define SPSC_SPIN_ITERATIONS 100
+#define SPSC_SLEEP_MICROS 50
+#define CACHE_LINE_SIZE 64
+
+/**
+ * @class SpscQueue
+ * @brief Bounded lock-free queue between exactly one producer thread and one consumer
+ *        thread: a ring buffer where the producer only writes the tail index and the
+ *        consumer only writes the head index, each on its own cache line.
+ *        push and pop wait while the queue is full / empty, first yielding, then sleeping
+ *        SPSC_SLEEP_MICROS between polls so an idle stage doesn't burn a core.
+ */
+template <typename T>
+class SpscQueue
+{
+private:
+    std::vector<T> _slots;
+    size_t _mask;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _head;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> _tail;
+
+    /**
+     * Calls poll until it returns true.
+     */
+    template <typename Poll>
+    static void waitFor(Poll poll)
+    {
+        for (int i = 0; !poll(); i++)
+        {
+            if (i < SPSC_SPIN_ITERATIONS)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::this_thread::sleep_for(std::chrono::microseconds(SPSC_SLEEP_MICROS));
+            }
+        }
+    }
+
+public:
+    /**
+     * @param capacity most items queued at once, rounded up to a power of 2
+     */
+    explicit SpscQueue(size_t capacity)
+    : _mask(0), _head(0), _tail(0)
+    {
+        size_t size = 1;
+        while (size < capacity)
+        {
+            size *= 2;
+        }
+        _slots.resize(size);
+        _mask = size - 1;
+    }
+
+    SpscQueue(const SpscQueue &other) = delete;
+    SpscQueue& operator=(const SpscQueue &other) = delete;
+
+    /**
+     * Producer side.
+     * @return false if the queue is full
+     */
+    bool tryPush(const T &item)
+    {
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) == _slots.size())
+        {
+            return false;
+        }
+        _slots[tail & _mask] = item;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Consumer side.
+     * @return false if the queue is empty
+     */
+    bool tryPop(T &item)
+    {
+        size_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        item = _slots[head & _mask];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * Producer side, waits for room.
+     */
+    void push(const T &item)
+    {
+        waitFor([&]() { return tryPush(item); });
+    }
+
+    /**
+     * Consumer side, waits for an item.
+     */
+    T pop()
+    {
+        T item;
+        waitFor([&]() { return tryPop(item); });
+        return item;
+    }
+};
+
+#endif //SPSCQUEUE_H
@@ -0,0 +1,108 @@
+// StaticMatrix.h
+
+#ifndef STATICMATRIX_H
+#define STATICMATRIX_H
+
+#include <cstdlib>
+#include <iostream>
+#include "Matrix.h"
+
+#define STATIC_DIM_ERR "Error: matrix dims don't match the fixed shape they are loaded into"
+
+/**
+ * @class StaticMatrix
+ * @brief Row-major R x C float matrix whose shape is part of its type: the storage is a
+ *        member array, so it lives wherever the object does (no heap), and every loop over
+ *        it has a compile time trip count the compiler can unroll and vectorize.
+ *        Element access isn't bounds checked. The values come from a dynamic Matrix, so
+ *        whatever loads a Matrix (mapped parameter files, ModelFile) loads this one too.
+ */
+template <int R, int C>
+class StaticMatrix
+{
+private:
+    // aligned like a Matrix's storage, for the vector loads of a row not to split cache lines,
+    // wherever the object lives: a heap allocated one gets C++17's aligned new.
+    alignas(MATRIX_ALIGNMENT) float _data[R * C];
+
+public:
+    static_assert(R > 0 && C > 0, "StaticMatrix dims must be positive");
+
+    /**
+     * Zero matrix.
+     */
+    StaticMatrix()
+    : _data{}
+    {
+    }
+
+    /**
+     * Copies m. Exits (code == 1) if m isn't R x C.
+     */
+    explicit StaticMatrix(const Matrix &m)
+    {
+        if (m.getRows() != R || m.getCols() != C)
+        {
+            std::cerr << STATIC_DIM_ERR << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < R; i++)
+        {
+            for (int j = 0; j < C; j++)
+            {
+                _data[i * C + j] = m(i, j);
+            }
+        }
+    }
+
+    static constexpr int getRows()
+    {
+        return R;
+    }
+
+    static constexpr int getCols()
+    {
+        return C;
+    }
+
+    const float *getData() const
+    {
+        return _data;
+    }
+
+    float *getData()
+    {
+        return _data;
+    }
+
+    float operator()(int i, int j) const
+    {
+        return _data[i * C + j];
+    }
+
+    float& operator()(int i, int j)
+    {
+        return _data[i * C + j];
+    }
+
+    /**
+     * Loads the transpose of m: *this = m^T. Exits (code == 1) if m isn't C x R.
+     */
+    void assignTranspose(const Matrix &m)
+    {
+        if (m.getRows() != C || m.getCols() != R)
+        {
+            std::cerr << STATIC_DIM_ERR << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < R; i++)
+        {
+            for (int j = 0; j < C; j++)
+            {
+                _data[i * C + j] = m(j, i);
+            }
+        }
+    }
+};
+
+#endif //STATICMATRIX_H
@@ -0,0 +1,7 @@
+// StaticNetwork.cpp
+// Built with -O3 (see the Makefile and CMakeLists.txt): the fixed trip count loops of the
+// StaticMlp forward passes are only vectorized and unrolled at that level.
+
+#include "StaticNetwork.h"
+
+template class StaticMlp<784, 128, 64, 20, 10>;
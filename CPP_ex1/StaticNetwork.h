@@ -0,0 +1,300 @@
+// StaticNetwork.h
+
+#ifndef STATICNETWORK_H
+#define STATICNETWORK_H
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "Digit.h"
+#include "Kernels.h"
+#include "Matrix.h"
+#include "MlpNetwork.h"
+#include "StaticMatrix.h"
+#include "Workspace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define STATIC_X86
+#define STATIC_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define STATIC_TARGET_AVX512 __attribute__((target("avx512f,avx512bw,avx2,fma")))
+#endif
+// the layer kernels are inlined into the per SimdLevel forward passes, and so compiled for
+// each level's instruction set.
+#define STATIC_INLINE __attribute__((always_inline)) inline
+
+/**
+ * @class StaticDense
+ * @brief Dense layer of a fixed R x C shape: activation(weights * input + bias).
+ *        The weights are stored transposed, so the product is C axpy's over contiguous rows
+ *        of R floats: the inner loop runs across the outputs with no reduction, which the
+ *        compiler vectorizes as is, and the R partial sums stay in registers.
+ */
+template <int R, int C>
+class StaticDense
+{
+private:
+    StaticMatrix<C, R> _weightsT;
+    StaticMatrix<R, 1> _bias;
+
+public:
+    /**
+     * Exits (code == 1) if weights isn't R x C or bias R x 1.
+     */
+    StaticDense(const Matrix &weights, const Matrix &bias)
+    : _bias(bias)
+    {
+        _weightsT.assignTranspose(weights);
+    }
+
+    /**
+     * y = weights * x + bias, clamped at 0 if Relu.
+     * @param x C inputs
+     * @param y R outputs
+     */
+    template <bool Relu>
+    STATIC_INLINE void forward(const float *x, float *y) const
+    {
+        const float *w = _weightsT.getData();
+        const float *bias = _bias.getData();
+        float acc[R];
+        for (int i = 0; i < R; i++)
+        {
+            acc[i] = bias[i];
+        }
+        for (int p = 0; p < C; p++)
+        {
+            float xp = x[p];
+            for (int i = 0; i < R; i++)
+            {
+                acc[i] += w[p * R + i] * xp;
+            }
+        }
+        for (int i = 0; i < R; i++)
+        {
+            y[i] = (Relu && acc[i] < 0) ? 0.0f : acc[i];
+        }
+    }
+};
+
+/**
+ * @class StaticLayers
+ * @brief Chain of StaticDense layers through the given widths: In -> Out -> Rest...
+ *        Relu on all of them but the last one, which leaves its outputs for the softmax.
+ *        The intermediate activations are arrays on the stack.
+ */
+template <int In, int Out, int... Rest>
+class StaticLayers
+{
+private:
+    StaticDense<Out, In> _layer;
+    StaticLayers<Out, Rest...> _next;
+
+public:
+    static constexpr int INPUTS = In;
+    static constexpr int OUTPUTS = StaticLayers<Out, Rest...>::OUTPUTS;
+
+    /**
+     * @param layers the layers of this chain, from its input to its output
+     */
+    explicit StaticLayers(const Dense layers[])
+    : _layer(layers[0].getWeights(), layers[0].getBias()), _next(layers + 1)
+    {
+    }
+
+    STATIC_INLINE void forward(const float *x, float *out) const
+    {
+        float hidden[Out];
+        _layer.template forward<true>(x, hidden);
+        _next.forward(hidden, out);
+    }
+};
+
+template <int In, int Out>
+class StaticLayers<In, Out>
+{
+private:
+    StaticDense<Out, In> _layer;
+
+public:
+    static constexpr int INPUTS = In;
+    static constexpr int OUTPUTS = Out;
+
+    explicit StaticLayers(const Dense layers[])
+    : _layer(layers[0].getWeights(), layers[0].getBias())
+    {
+    }
+
+    STATIC_INLINE void forward(const float *x, float *out) const
+    {
+        _layer.template forward<false>(x, out);
+    }
+};
+
+/**
+ * @class StaticMlp
+ * @brief Fixed-shape MlpNetwork: the layer widths (input first) are template arguments, so
+ *        every loop of a forward pass has a constant trip count, which the compiler unrolls
+ *        and vectorizes without any of the loop, dispatch and bounds overhead that dominates
+ *        the small layers of the dynamic network. A forward pass touches no heap at all.
+ *        The pass is compiled once per SimdLevel and the one matching kernels() is picked at
+ *        construction. Instantiate it in a translation unit built with -O3, like
+ *        StaticNetwork.cpp does for DefaultStaticMlp: -O2 leaves the loops scalar.
+ *        It is built from an MlpNetwork of the same topology, so it shares its loaders, and
+ *        has the same interface: the Workspace arguments are accepted and ignored, which makes
+ *        it thread safe. It's a single image latency network: the weights are copied out of
+ *        the MlpNetwork, a mapped model included, and classifyBatch is a loop of single
+ *        passes, so main only runs the interactive cli on it.
+ */
+template <int... Widths>
+class StaticMlp
+{
+private:
+    typedef StaticLayers<Widths...> Layers;
+    static constexpr int INPUTS = Layers::INPUTS;
+    static constexpr int OUTPUTS = Layers::OUTPUTS;
+    static constexpr int LAYERS = (int) sizeof...(Widths) - 1;
+
+    Layers _layers;
+    SimdLevel _level;
+
+    /**
+     * Checks the topology of network. Exits (code == 1) if it doesn't match.
+     * @return network's layers
+     */
+    static const Dense *checked(const MlpNetwork &network)
+    {
+        if (!matches(network))
+        {
+            std::cerr << STATIC_DIM_ERR << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        return network.getLayers().data();
+    }
+
+    /**
+     * The forward pass up to the softmax, one per SimdLevel. Defined out of the class so that
+     * the extern template below keeps them from being instantiated, or inlined, outside of
+     * StaticNetwork.cpp.
+     * @param x INPUTS inputs
+     * @param out OUTPUTS outputs of the last layer
+     */
+    void forwardBaseline(const float *x, float *out) const;
+#ifdef STATIC_X86
+    STATIC_TARGET_AVX2 void forwardAvx2(const float *x, float *out) const;
+    STATIC_TARGET_AVX512 void forwardAvx512(const float *x, float *out) const;
+#endif
+
+public:
+    /**
+     * @return true if network has exactly this topology: the widths, Relu on the hidden
+     *         layers and Softmax on the last one.
+     */
+    static bool matches(const MlpNetwork &network)
+    {
+        const int widths[] = {Widths...};
+        const std::vector<Dense> &layers = network.getLayers();
+        if ((int) layers.size() != LAYERS)
+        {
+            return false;
+        }
+        for (int i = 0; i < LAYERS; i++)
+        {
+            const Matrix &w = layers[i].getWeights();
+            ActivationType activation = (i == LAYERS - 1) ? Softmax : Relu;
+            if (w.getRows() != widths[i + 1] || w.getCols() != widths[i] ||
+                layers[i].getActivation().getType() != activation)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Copies the parameters of network. Exits (code == 1) if its topology doesn't match
+     * (see matches).
+     */
+    explicit StaticMlp(const MlpNetwork &network)
+    : _layers(checked(network)), _level(kernels().level)
+    {
+    }
+
+    Digit operator()(const Matrix &img) const
+    {
+        if (img.getRows() * img.getCols() != INPUTS)
+        {
+            std::cerr << BATCH_DIM_ERR << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        float out[OUTPUTS];
+        switch (_level)
+        {
+#ifdef STATIC_X86
+            case Avx512:
+                forwardAvx512(img.getData(), out);
+                break;
+            case Avx2:
+                forwardAvx2(img.getData(), out);
+                break;
+#endif
+            default:
+                forwardBaseline(img.getData(), out);
+        }
+        return Activation::softmaxDigit(out, OUTPUTS);
+    }
+
+    Digit operator()(const Matrix &img, Workspace &) const
+    {
+        return (*this)(img);
+    }
+
+    /**
+     * Classifies count images, one forward pass each.
+     * @param images array of count images of the network input size.
+     * @param results array of count digits, results[j] is set to the j'th image's digit.
+     */
+    void classifyBatch(const Matrix images[], int count, Digit results[], Workspace &) const
+    {
+        for (int j = 0; j < count; j++)
+        {
+            results[j] = (*this)(images[j]);
+        }
+    }
+
+    /**
+     * @return a minimal workspace, for the callers written against MlpNetwork.
+     */
+    Workspace makeWorkspace(int) const
+    {
+        return Workspace(std::vector<MatrixDims>(), DEFAULT_MAX_BATCH);
+    }
+};
+
+template <int... Widths>
+void StaticMlp<Widths...>::forwardBaseline(const float *x, float *out) const
+{
+    _layers.forward(x, out);
+}
+
+#ifdef STATIC_X86
+template <int... Widths>
+STATIC_TARGET_AVX2 void StaticMlp<Widths...>::forwardAvx2(const float *x, float *out) const
+{
+    _layers.forward(x, out);
+}
+
+template <int... Widths>
+STATIC_TARGET_AVX512 void StaticMlp<Widths...>::forwardAvx512(const float *x, float *out) const
+{
+    _layers.forward(x, out);
+}
+#endif
+
+/**
+ * The default topology, weightsDims, as a StaticMlp.
+ */
+typedef StaticMlp<784, 128, 64, 20, 10> DefaultStaticMlp;
+
+extern template class StaticMlp<784, 128, 64, 20, 10>;
+
+#endif //STATICNETWORK_H
@@ -0,0 +1,227 @@
+// ThreadPool.cpp
+
+#include <algorithm>
+#include <cstdlib>
+#include "ThreadPool.h"
+
+namespace
+{
+// pool and slot of the current thread, set for the pool's own workers only.
+thread_local const ThreadPool *currentPool = nullptr;
+thread_local int currentSlot = -1;
+// parallelFor chunks running on the current thread, of any pool.
+thread_local int taskDepth = 0;
+}
+
+int defaultThreadCount()
+{
+    const char *env = std::getenv(THREADS_ENV_VAR);
+    if (env != nullptr && std::atoi(env) > 0)
+    {
+        return std::atoi(env);
+    }
+    int hardware = (int) std::thread::hardware_concurrency();
+    return hardware > 0 ? hardware : 1;
+}
+
+ThreadPool::ThreadPool(int threads)
+: _queued(0), _stopping(false)
+{
+    if (threads <= 0)
+    {
+        threads = defaultThreadCount() - 1;
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        _queues.emplace_back(new WorkerQueue());
+    }
+    for (int i = 0; i < threads; i++)
+    {
+        _threads.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _stopping = true;
+    }
+    _wake.notify_all();
+    for (std::thread &thread : _threads)
+    {
+        thread.join();
+    }
+}
+
+int ThreadPool::getThreadCount() const
+{
+    // _queues is complete before the first worker starts, unlike _threads.
+    return (int) _queues.size();
+}
+
+bool ThreadPool::inTask()
+{
+    return taskDepth > 0;
+}
+
+int ThreadPool::getSlotCount() const
+{
+    return getThreadCount() + 1;
+}
+
+void ThreadPool::parallelFor(int count, int grain, const RangeFunc &func)
+{
+    int slot = (currentPool == this) ? currentSlot : getThreadCount();
+    int chunks = (count + grain - 1) / grain;
+    if (chunks <= 1 || _queues.empty())
+    {
+        taskDepth++;
+        for (int begin = 0; begin < count; begin += grain)
+        {
+            func(begin, std::min(begin + grain, count), slot);
+        }
+        taskDepth--;
+        return;
+    }
+
+    // a worker queues its chunks locally and lets the others steal them, an outside thread
+    // deals them round robin.
+    std::atomic<int> pending(chunks);
+    for (int c = 0; c < chunks; c++)
+    {
+        int begin = c * grain;
+        Task task = {&func, begin, std::min(begin + grain, count), &pending};
+        WorkerQueue &queue = *_queues[slot < getThreadCount() ? slot : c % getThreadCount()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.pushBack(task);
+    }
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _queued += chunks;
+    }
+    _wake.notify_all();
+
+    Task task;
+    while (pending.load() > 0)
+    {
+        if (takeTask(slot, task))
+        {
+            runTask(task, slot);
+        }
+        else
+        {
+            // the remaining chunks are running on other threads.
+            std::unique_lock<std::mutex> lock(_sleepMutex);
+            _done.wait(lock, [&]() { return pending.load() == 0; });
+        }
+    }
+}
+
+void ThreadPool::workerLoop(int slot)
+{
+    currentPool = this;
+    currentSlot = slot;
+    Task task;
+    while (true)
+    {
+        if (takeTask(slot, task))
+        {
+            runTask(task, slot);
+            continue;
+        }
+        bool queued = false;
+        for (int i = 0; i < POOL_SPIN_ITERATIONS && !queued; i++)
+        {
+            std::this_thread::yield();
+            queued = _queued.load() > 0;
+        }
+        if (queued)
+        {
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _wake.wait(lock, [this]() { return _stopping || _queued.load() > 0; });
+        if (_stopping)
+        {
+            return;
+        }
+    }
+}
+
+bool ThreadPool::takeTask(int slot, Task &task)
+{
+    int queues = getThreadCount();
+    if (slot < queues)
+    {
+        WorkerQueue &own = *_queues[slot];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (own.size > 0)
+        {
+            task = own.popBack();
+            _queued--;
+            return true;
+        }
+    }
+    for (int i = 1; i <= queues; i++)
+    {
+        WorkerQueue &victim = *_queues[(slot + i) % queues];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.size > 0)
+        {
+            task = victim.popFront();
+            _queued--;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::runTask(const Task &task, int slot)
+{
+    taskDepth++;
+    (*task.func)(task.begin, task.end, slot);
+    taskDepth--;
+    if (task.pending->fetch_sub(1) == 1)
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _done.notify_all();
+    }
+}
+
+void ThreadPool::WorkerQueue::pushBack(const Task &task)
+{
+    if (size == ring.size())
+    {
+        // unroll into a twice bigger ring, oldest task first.
+        std::vector<Task> grown(std::max<size_t>(2 * ring.size(), 16));
+        for (size_t i = 0; i < size; i++)
+        {
+            grown[i] = ring[(head + i) % ring.size()];
+        }
+        ring.swap(grown);
+        head = 0;
+    }
+    ring[(head + size) % ring.size()] = task;
+    size++;
+}
+
+ThreadPool::Task ThreadPool::WorkerQueue::popBack()
+{
+    size--;
+    return ring[(head + size) % ring.size()];
+}
+
+ThreadPool::Task ThreadPool::WorkerQueue::popFront()
+{
+    Task task = ring[head];
+    head = (head + 1) % ring.size();
+    size--;
+    return task;
+}
+
+ThreadPool& defaultPool()
+{
+    static ThreadPool pool;
+    return pool;
+}
@@ -0,0 +1,137 @@
+// ThreadPool.h
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define THREADS_ENV_VAR "MLP_THREADS"
+// polls for new tasks before a worker goes to sleep, so back to back parallelFor calls (e.g.
+// the layers of one forward pass) don't pay a wake-up each.
+#define POOL_SPIN_ITERATIONS 1000
+
+/**
+ * @return the thread count to use: the MLP_THREADS environment variable if set to a positive
+ *         number, the number of hardware threads otherwise.
+ */
+int defaultThreadCount();
+
+/**
+ * @class ThreadPool
+ * @brief Persistent work-stealing pool.
+ *        Every worker owns a deque of tasks: it pops from its back, and when it runs dry it
+ *        steals from the front of the other workers' deques, so uneven chunks balance
+ *        themselves without a central queue everyone contends on.
+ *        The thread calling parallelFor takes part in the work instead of sleeping, which
+ *        also makes nested parallelFor calls (from inside a task) safe: the waiting worker
+ *        keeps running tasks, including the ones of the inner loop.
+ */
+class ThreadPool
+{
+public:
+    /**
+     * func(begin, end, slot) runs the items [begin, end) of a parallelFor, slot identifies the
+     * executing thread (see getSlotCount()).
+     */
+    typedef std::function<void(int, int, int)> RangeFunc;
+
+    /**
+     * @param threads worker threads to start, 0 for defaultThreadCount() - 1 since the
+     *        calling thread works too.
+     */
+    explicit ThreadPool(int threads = 0);
+    ThreadPool(const ThreadPool &other) = delete;
+    ThreadPool& operator=(const ThreadPool &other) = delete;
+    ~ThreadPool();
+
+    int getThreadCount() const;
+
+    /**
+     * @return true if the calling thread is running a parallelFor chunk, of any pool.
+     *         Code that may run both ways can use it to stay serial inside an already parallel
+     *         region instead of splitting its work further.
+     */
+    static bool inTask();
+
+    /**
+     * @return number of distinct slots tasks may run on: slot i < getThreadCount() is the
+     *         i'th worker, slot getThreadCount() is any thread outside the pool. Per thread
+     *         state (e.g. one Workspace per slot) indexed by slot is therefore safe as long as
+     *         a single outside thread calls parallelFor at a time.
+     */
+    int getSlotCount() const;
+
+    /**
+     * Splits [0, count) into chunks of at most grain items and runs func on all of them,
+     * returning once every chunk is done.
+     * @param count number of items
+     * @param grain largest chunk size, at least 1
+     * @param func called once per chunk, possibly concurrently
+     */
+    void parallelFor(int count, int grain, const RangeFunc &func);
+
+private:
+    /**
+     * A chunk of a parallelFor, pending counts the chunks of its loop still running.
+     */
+    typedef struct Task
+    {
+        const RangeFunc *func;
+        int begin;
+        int end;
+        std::atomic<int> *pending;
+    } Task;
+
+    /**
+     * Worker owned task deque: a ring buffer that only ever grows, since std::deque frees and
+     * reallocates its blocks as tasks come and go, which would make every parallel forward
+     * pass allocate.
+     */
+    typedef struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::vector<Task> ring;
+        size_t head = 0;
+        size_t size = 0;
+
+        void pushBack(const Task &task);
+        Task popBack();
+        Task popFront();
+    } WorkerQueue;
+
+    std::vector<std::unique_ptr<WorkerQueue>> _queues;
+    std::vector<std::thread> _threads;
+    std::mutex _sleepMutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    std::atomic<int> _queued;
+    bool _stopping;
+
+    void workerLoop(int slot);
+
+    /**
+     * Takes a task: from the back of slot's own queue first, then from the front of the
+     * other queues.
+     * @return true if a task was taken
+     */
+    bool takeTask(int slot, Task &task);
+
+    /**
+     * Runs a task and signals its loop's completion if it was the last chunk.
+     */
+    void runTask(const Task &task, int slot);
+};
+
+/**
+ * @return process wide pool of defaultThreadCount() - 1 workers, started on first use and
+ *         shared by everything that doesn't need a pool of its own.
+ */
+ThreadPool& defaultPool();
+
+#endif //THREADPOOL_H
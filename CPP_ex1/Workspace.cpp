@@ -0,0 +1,63 @@
+// Workspace.cpp
+
+#include <algorithm>
+#include "MlpNetwork.h"
+#include "Workspace.h"
+
+Workspace::Workspace(int maxBatch)
+: Workspace(std::vector<MatrixDims>(weightsDims, weightsDims + MLP_SIZE), maxBatch)
+{
+}
+
+Workspace::Workspace(const std::vector<MatrixDims> &layerDims, int maxBatch)
+: _maxBatch(maxBatch)
+{
+    // layers i and i + 2 share a buffer, so every buffer is sized for the widest of its layers.
+    int rows[WORKSPACE_BUFFERS] = {};
+    int widestInput = 0;
+    for (size_t i = 0; i < layerDims.size(); i++)
+    {
+        rows[i % WORKSPACE_BUFFERS] = std::max(rows[i % WORKSPACE_BUFFERS], layerDims[i].rows);
+        widestInput = std::max(widestInput, layerDims[i].cols);
+    }
+    for (int i = 0; i < WORKSPACE_BUFFERS; i++)
+    {
+        _buffers[i] = Matrix(std::max(rows[i], 1), maxBatch);
+    }
+    _batch = Matrix(layerDims.empty() ? 1 : layerDims[0].cols, maxBatch);
+    _quantized.resize(widestInput);
+    _digits.resize(maxBatch);
+}
+
+int Workspace::getMaxBatch() const
+{
+    return _maxBatch;
+}
+
+Matrix& Workspace::layerOutput(int layer)
+{
+    return _buffers[layer % WORKSPACE_BUFFERS];
+}
+
+Matrix& Workspace::batchInput()
+{
+    return _batch;
+}
+
+uint8_t *Workspace::quantizedInput(int size)
+{
+    if (_quantized.size() < (size_t) size)
+    {
+        _quantized.resize(size);
+    }
+    return _quantized.data();
+}
+
+Digit *Workspace::digits(int count)
+{
+    if (_digits.size() < (size_t) count)
+    {
+        _digits.resize(count);
+    }
+    return _digits.data();
+}
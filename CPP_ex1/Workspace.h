@@ -0,0 +1,73 @@
+// Workspace.h
+
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <cstdint>
+#include <vector>
+#include "Digit.h"
+#include "Matrix.h"
+
+#define WORKSPACE_BUFFERS 2
+#define DEFAULT_MAX_BATCH 1
+
+/**
+ * @class Workspace
+ * @brief Scratch memory of MlpNetwork / QuantizedNetwork forward passes: ping-pong
+ *        activation buffers, a buffer for gathering images into a batch, one for
+ *        quantized layer inputs and one for the digits of a CascadeNetwork's full passes.
+ *        Everything is allocated once, sized from the layers of the network for up to
+ *        maxBatch images, and reused by every forward pass; a bigger batch or network grows
+ *        the buffers once.
+ *        A workspace must only be used by one thread at a time, the usual setup is one
+ *        workspace per scoring thread.
+ */
+class Workspace
+{
+private:
+    int _maxBatch;
+    Matrix _buffers[WORKSPACE_BUFFERS];
+    Matrix _batch;
+    std::vector<uint8_t> _quantized;
+    std::vector<Digit> _digits;
+
+public:
+    /**
+     * Workspace of the default topology (weightsDims).
+     * @param maxBatch largest number of images a forward pass is expected to hold.
+     */
+    explicit Workspace(int maxBatch = DEFAULT_MAX_BATCH);
+
+    /**
+     * @param layerDims weights dims of every layer of the network, in order
+     * @param maxBatch largest number of images a forward pass is expected to hold.
+     */
+    Workspace(const std::vector<MatrixDims> &layerDims, int maxBatch);
+
+    int getMaxBatch() const;
+
+    /**
+     * @param layer layer index
+     * @return the buffer layer writes its output to, layers alternate between the buffers.
+     */
+    Matrix& layerOutput(int layer);
+
+    /**
+     * @return the buffer images are gathered to before a batched forward pass.
+     */
+    Matrix& batchInput();
+
+    /**
+     * @param size length of the layer input
+     * @return the buffer a QuantizedNetwork layer quantizes its input to, of at least size
+     *         bytes. Sized for the widest layer input up front.
+     */
+    uint8_t *quantizedInput(int size);
+
+    /**
+     * @return a buffer of at least count digits. Sized for maxBatch up front.
+     */
+    Digit *digits(int count);
+};
+
+#endif //WORKSPACE_H
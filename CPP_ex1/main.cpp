@@ -1,26 +1,101 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
 
 #include "Matrix.h"
 #include "Activation.h"
+#include "BatchScheduler.h"
+#include "CascadeNetwork.h"
 #include "Dense.h"
+#include "ImageList.h"
+#include "ImageStream.h"
+#include "InferenceServer.h"
 #include "MlpNetwork.h"
+#include "MappedFile.h"
+#include "ModelFile.h"
+#include "QuantizedNetwork.h"
+#include "ResultCache.h"
+#include "SpscQueue.h"
+#include "StaticNetwork.h"
+#include "ThreadPool.h"
+#include "Workspace.h"
 
 #define QUIT "q"
 #define INSERT_IMAGE_PATH "Please insert image path:"
 #define ERROR_INAVLID_PARAMETER "Error: invalid Parameters file for layer: "
 #define ERROR_INVALID_INPUT "Error: Failed to retrieve input. Exiting.."
 #define ERROR_INVALID_IMG "Error: invalid image path or size: "
+#define ERROR_INVALID_MODEL "Error: invalid model file: "
+#define ERROR_MODEL_TOPOLOGY "Error: model's last layer isn't Softmax: "
+#define ERROR_INVALID_CALIBRATION "Error: invalid calibration file: "
+#define ERROR_INVALID_BATCH "Error: unable to read images directory or list: "
+#define ERROR_INVALID_STREAM "Error: unable to read images stream: "
+#define ERROR_TRUNCATED_STREAM "Error: images stream ends with a partial image of bytes: "
+#define ERROR_SERVER_SOCKET "Error: unable to listen on socket: "
+#define ERROR_INVALID_HEAD "Error: invalid exit head file: "
+#define ERROR_HEAD_CALIBRATION "Error: the exit head runs on the float network, not the INT8 one"
+#define CASCADE_STATS_MSG "Cascade: early exits, images: "
 #define USAGE_MSG "Usage:\n" \
-                  "\t./mlpnetwork w1 w2 w3 w4 b1 b2 b3 b4\n" \
+                  "\t./mlpnetwork [mode input] w1 w2 w3 w4 b1 b2 b3 b4 [calibration]\n" \
+                  "\t./mlpnetwork [mode input] model [calibration]\n" \
                   "\twi - the i'th layer's weights\n" \
-                  "\tbi - the i'th layer's biases"
+                  "\tbi - the i'th layer's biases\n" \
+                  "\tmodel - packed model file, of any number and sizes of layers " \
+                  "(see mlpconvert)\n" \
+                  "\tcalibration - run the INT8 network with these input ranges " \
+                  "(see mlpcalibrate)\n" \
+                  "\tmode input - instead of prompting for paths, classify on all cores " \
+                  "(MLP_THREADS threads):\n" \
+                  "\t\t--batch images - a directory or list file of images\n" \
+                  "\t\t--stream file - concatenated images from a file or - for stdin, " \
+                  "printing index,digit,probability CSV\n" \
+                  "\t\t--stream-binary file - same, printing a uint8 digit and a float32 " \
+                  "probability per image\n" \
+                  "\t\t--serve socket - serve requests of images on a Unix domain socket " \
+                  "until SIGINT or SIGTERM (see InferenceServer), batching concurrent ones " \
+                  "up to MLP_BATCH_MAX images or MLP_BATCH_WAIT_US microseconds\n" \
+                  "\tMLP_GEMM_THREADS - split the large layers of a single image across " \
+                  "this many threads\n" \
+                  "\tMLP_CACHE_MB - cache the digits of up to this many megabytes of " \
+                  "images, for the images seen before (see ResultCache)\n" \
+                  "\tMLP_EXIT_HEAD - classify the images the head of this file is sure of " \
+                  "with it, skipping the rest of the network (see mlpcascade), at least " \
+                  "MLP_EXIT_THRESHOLD sure"
 
 
 #define ARGS_START_IDX 1
 #define ARGS_COUNT (ARGS_START_IDX + (MLP_SIZE * 2))
 #define WEIGHTS_START_IDX ARGS_START_IDX
 #define BIAS_START_IDX (ARGS_START_IDX + MLP_SIZE)
+#define MODEL_ARGS_COUNT (ARGS_START_IDX + 1)
+#define MODEL_PATH_IDX ARGS_START_IDX
+// either form may be followed by a calibration file.
+#define CALIBRATED_ARGS_COUNT (ARGS_COUNT + 1)
+#define CALIBRATED_MODEL_ARGS_COUNT (MODEL_ARGS_COUNT + 1)
+// and all forms may start with a mode flag and its input.
+#define BATCH_FLAG "--batch"
+#define STREAM_FLAG "--stream"
+#define STREAM_BINARY_FLAG "--stream-binary"
+#define SERVE_FLAG "--serve"
+#define MODE_ARGS 2
+
+// images per batch mode task: a batched forward pass, and the stealing granularity.
+#define BATCH_CHUNK 64
+// aim for this many tasks per thread, so the stealing has something to balance.
+#define BATCH_TASKS_PER_THREAD 4
+
+#define STREAM_CSV_HEADER "index,digit,probability"
+// longest CSV line: 20 digits index, digit, 6 significant digits probability.
+#define STREAM_CSV_LINE_MAX 48
+// binary results: a uint8 digit followed by its native endian float32 probability.
+#define STREAM_BINARY_RECORD_BYTES (1 + sizeof(float))
+// blocks in flight in the stream pipeline: one per stage, so no stage waits for a buffer.
+#define STREAM_BLOCKS 4
 
 
 
@@ -35,7 +110,7 @@ void usage()
 
 /**
  * Given a binary file path and a matrix,
- * reads the content of the file into the matrix.
+ * reads the content of the file into the matrix, with a single read (see Matrix::readBinary).
  * file must match matrix in size in order to read successfully.
  * @param filePath - path of the binary file to read
  * @param mat -  matrix to read the file into.
@@ -61,32 +136,37 @@ bool readFileToMatrix(const std::string &filePath, Matrix &mat)
 
     is.seekg(0, std::ios_base::beg);
     is >> mat;
+    bool read = !is.fail();
     is.close();
-    return true;
+    return read;
 }
 
 /**
  * Loads MLP parameters from weights & biases paths
  * to Weights[] and Biases[].
+ * The files are memory mapped and the matrices are read-only views of the mapped pages,
+ * so the parameters are never copied and worker processes share one physical copy.
  * Exits (code == 1) upon failures.
  * @param paths array of programs arguments, expected to be mlp parameters
  *        path.
+ * @param files mappings backing the matrices, files[i] for weights[i] and
+ *        files[MLP_SIZE + i] for biases[i]. Must outlive the matrices.
  * @param weights array of matrix, weigths[i] is the i'th layer weights matrix
  * @param biases array of matrix, biases[i] is the i'th layer bias matrix
  *          (which is actually a vector)
  */
-void loadParameters(char *paths[ARGS_COUNT], Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE])
+void loadParameters(char *paths[ARGS_COUNT], MappedFile files[2 * MLP_SIZE],
+                    Matrix weights[MLP_SIZE], Matrix biases[MLP_SIZE])
 {
     for(int i = 0; i < MLP_SIZE; i++)
     {
-        weights[i] = Matrix(weightsDims[i].rows, weightsDims[i].cols);
-        biases[i] = Matrix(biasDims[i].rows, biasDims[i].cols);
-
         std::string weightsPath(paths[WEIGHTS_START_IDX + i]);
         std::string biasPath(paths[BIAS_START_IDX + i]);
 
-        if(!(readFileToMatrix(weightsPath, weights[i]) &&
-           readFileToMatrix(biasPath, biases[i])))
+        if(!(mapFileToMatrix(weightsPath, files[i], weightsDims[i].rows, weightsDims[i].cols,
+                             weights[i]) &&
+             mapFileToMatrix(biasPath, files[MLP_SIZE + i], biasDims[i].rows, biasDims[i].cols,
+                             biases[i])))
         {
             std::cerr << ERROR_INAVLID_PARAMETER << (i + 1) << std::endl;
             exit(EXIT_FAILURE);
@@ -95,6 +175,75 @@ void loadParameters(char *paths[ARGS_COUNT], Matrix weights[MLP_SIZE], Matrix bi
     }
 }
 
+/**
+ * Loads a packed model file. Its layers may be of any number and sizes, the network is built
+ * from them (see MlpNetwork(const ModelFile &)).
+ * Exits (code == 1) upon failures, including a model whose output isn't a Softmax.
+ * @param path packed model file path.
+ * @param model model object to load.
+ */
+void loadModel(const std::string &path, ModelFile &model)
+{
+    if (!model.load(path))
+    {
+        std::cerr << ERROR_INVALID_MODEL << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (model.getActivation(model.getLayerCount() - 1) != Softmax)
+    {
+        std::cerr << ERROR_MODEL_TOPOLOGY << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * @return a ResultCache of images of inputDims of the defaultCacheBytes() cap, nullptr for
+ *         none.
+ */
+std::unique_ptr<ResultCache> makeCache(MatrixDims inputDims)
+{
+    size_t bytes = defaultCacheBytes();
+    if (bytes == 0)
+    {
+        return nullptr;
+    }
+    return std::unique_ptr<ResultCache>(new ResultCache(inputDims.rows * inputDims.cols,
+                                                        bytes));
+}
+
+/**
+ * Prints the counters of cache to stderr, if there's one.
+ */
+void printCacheStats(const ResultCache *cache)
+{
+    if (cache != nullptr)
+    {
+        std::cerr << CACHE_STATS_MSG << cache->getHits() << ", " << cache->getMisses() << ", "
+                  << cache->getEntryCount() << std::endl;
+    }
+}
+
+/**
+ * Classifies count images with mlp, through cache unless it's nullptr.
+ * @param scratch buffers of the calling thread for the cache
+ * @param ws workspace of the calling thread, for up to count images
+ */
+template <typename Network>
+void classifyCached(const Network &mlp, ResultCache *cache, ResultCache::Scratch &scratch,
+                    const Matrix images[], int count, Digit results[], Workspace &ws)
+{
+    if (cache == nullptr)
+    {
+        mlp.classifyBatch(images, count, results, ws);
+        return;
+    }
+    cache->classify(images, count, results, scratch,
+                    [&](const Matrix missing[], int n, Digit digits[])
+    {
+        mlp.classifyBatch(missing, n, digits, ws);
+    });
+}
+
 /**
  * This programs Command line interface for the mlp network.
  * Looping on: {
@@ -103,12 +252,16 @@ void loadParameters(char *paths[ARGS_COUNT], Matrix weights[MLP_SIZE], Matrix bi
  *                  print image & netowrk prediction
  *             }
  * Exits (code == 1) on fatal errors: unable to read user input path.
- * @param mlp MlpNetwork to use in order to predict img.
+ * @param mlp MlpNetwork or QuantizedNetwork to use in order to predict img.
+ * @param inputDims dims of the images
  */
-void mlpCli(MlpNetwork &mlp)
+template <typename Network>
+void mlpCli(const Network &mlp, MatrixDims inputDims)
 {
-    Matrix img(imgDims.rows, imgDims.cols);
+    Matrix img(inputDims.rows, inputDims.cols);
     std::string imgPath;
+    std::unique_ptr<ResultCache> cache = makeCache(inputDims);
+    ResultCache::Scratch scratch;
 
     std::cout << INSERT_IMAGE_PATH << std::endl;
     std::cin >> imgPath;
@@ -123,7 +276,20 @@ void mlpCli(MlpNetwork &mlp)
         if(readFileToMatrix(imgPath, img))
         {
             Matrix imgVec = img;
-            Digit output = mlp(imgVec.vectorize());
+            imgVec.vectorize();
+            Digit output;
+            if (cache != nullptr)
+            {
+                cache->classify(&imgVec, 1, &output, scratch,
+                                [&](const Matrix missing[], int, Digit digits[])
+                {
+                    digits[0] = mlp(missing[0]);
+                });
+            }
+            else
+            {
+                output = mlp(imgVec);
+            }
             std::cout << "Image processed:" << std::endl
                       << img << std::endl;
             std::cout << "Mlp result: " << output.value <<
@@ -144,6 +310,331 @@ void mlpCli(MlpNetwork &mlp)
     }
 }
 
+/**
+ * Batch mode: classifies every image listed by input and prints one
+ * "path<TAB>digit<TAB>probability" line per image, in input order.
+ * The images are mapped and classified in chunks spread over the default work-stealing pool,
+ * every thread of the pool uses its own Workspace. The chunks go through the makeCache()
+ * cache, if MLP_CACHE_MB asks for one, whose counters are printed to stderr at the end.
+ * Exits (code == 1) if input can't be listed.
+ * @param mlp MlpNetwork or QuantizedNetwork to use in order to predict the images.
+ * @param input directory or list file of images (see listImages)
+ * @param inputDims dims of the images
+ */
+template <typename Network>
+void mlpBatch(const Network &mlp, const std::string &input, MatrixDims inputDims)
+{
+    std::vector<std::string> paths;
+    if (!listImages(input, paths))
+    {
+        std::cerr << ERROR_INVALID_BATCH << input << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    int count = (int) paths.size();
+    std::vector<Digit> results(count);
+    std::vector<char> valid(count, 0);
+
+    ThreadPool &pool = defaultPool();
+    std::vector<Workspace> workspaces(pool.getSlotCount(), mlp.makeWorkspace(BATCH_CHUNK));
+    std::unique_ptr<ResultCache> cache = makeCache(inputDims);
+    std::vector<ResultCache::Scratch> scratches(pool.getSlotCount());
+    int grain = count / (pool.getSlotCount() * BATCH_TASKS_PER_THREAD);
+    grain = std::min(std::max(grain, 1), BATCH_CHUNK);
+    pool.parallelFor(count, grain, [&](int begin, int end, int slot)
+    {
+        MappedFile files[BATCH_CHUNK];
+        Matrix images[BATCH_CHUNK];
+        int positions[BATCH_CHUNK];
+        Digit digits[BATCH_CHUNK];
+        int n = 0;
+        for (int j = begin; j < end; j++)
+        {
+            if (mapFileToMatrix(paths[j], files[n], inputDims.rows, inputDims.cols, images[n]))
+            {
+                valid[j] = 1;
+                positions[n++] = j;
+            }
+        }
+        if (n > 0)
+        {
+            classifyCached(mlp, cache.get(), scratches[slot], images, n, digits,
+                           workspaces[slot]);
+        }
+        for (int i = 0; i < n; i++)
+        {
+            results[positions[i]] = digits[i];
+        }
+    });
+
+    for (int j = 0; j < count; j++)
+    {
+        if (valid[j])
+        {
+            std::cout << paths[j] << '\t' << results[j].value << '\t'
+                      << results[j].probability << '\n';
+        }
+        else
+        {
+            std::cout.flush();
+            std::cerr << ERROR_INVALID_IMG << paths[j] << std::endl;
+        }
+    }
+    std::cout.flush();
+    printCacheStats(cache.get());
+}
+
+/**
+ * Appends the stream mode output of count results to out.
+ * @param results digits of consecutive images
+ * @param firstIndex stream index of results[0]
+ * @param binary STREAM_BINARY_RECORD_BYTES per result instead of a CSV line
+ */
+void formatResults(const Digit results[], int count, long firstIndex, bool binary,
+                   std::vector<char> &out)
+{
+    for (int j = 0; j < count; j++)
+    {
+        if (binary)
+        {
+            char record[STREAM_BINARY_RECORD_BYTES];
+            record[0] = (char) results[j].value;
+            std::memcpy(record + 1, &results[j].probability, sizeof(float));
+            out.insert(out.end(), record, record + STREAM_BINARY_RECORD_BYTES);
+        }
+        else
+        {
+            char line[STREAM_CSV_LINE_MAX];
+            int length = std::snprintf(line, sizeof(line), "%ld,%u,%g\n", firstIndex + j,
+                                       results[j].value, results[j].probability);
+            out.insert(out.end(), line, line + length);
+        }
+    }
+}
+
+/**
+ * A block of consecutive stream images, recycled through the stages of mlpStream.
+ * @var buffer - the images, read or copied into it by the read and decode stages
+ * @var records - first image of the block
+ * @var count - images in the block
+ * @var index - stream index of the first image
+ * @var images - matrix views of the images, set by the decode stage
+ * @var results - digits of the images, set by the forward stage
+ * @var out - formatted results
+ */
+typedef struct StreamBlock
+{
+    std::vector<float> buffer;
+    const float *records;
+    int count;
+    long index;
+    std::vector<Matrix> images;
+    std::vector<Digit> results;
+    std::vector<char> out;
+} StreamBlock;
+
+/**
+ * Stream mode: classifies the images of a stream of concatenated raw float32 images
+ * (inputDims each, no header) as it is read, and prints one result per image in stream order.
+ * Runs as a pipeline of four stages passing STREAM_BLOCKS blocks of images around through
+ * lock-free queues, so that while a block is classified the next ones are being read and
+ * decoded and the previous one is written:
+ *      read    - reads a block from the stream (a read(2) into the block's buffer, or just
+ *                the position of the block in a mapped file)
+ *      decode  - copies a mapped block into its buffer, which is where the pages of the file
+ *                are actually read, and points the block's matrices at the images
+ *      forward - classifies the block on the default pool, like batch mode (cache included)
+ *      format  - formats the results and writes them with a single write
+ * The forward stage runs on the calling thread, the others on a thread each.
+ * Exits (code == 1) if input can't be opened or read, or ends with a partial image.
+ * @param mlp MlpNetwork or QuantizedNetwork to use in order to predict the images.
+ * @param input file of images or STREAM_STDIN (see ImageStream)
+ * @param binary print binary records instead of CSV (see formatResults)
+ * @param inputDims dims of the images
+ */
+template <typename Network>
+void mlpStream(const Network &mlp, const std::string &input, bool binary, MatrixDims inputDims)
+{
+    const int imgSize = inputDims.rows * inputDims.cols;
+    ImageStream stream(imgSize);
+    if (!stream.open(input))
+    {
+        std::cerr << ERROR_INVALID_STREAM << input << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    ThreadPool &pool = defaultPool();
+    std::vector<Workspace> workspaces(pool.getSlotCount(), mlp.makeWorkspace(BATCH_CHUNK));
+    std::unique_ptr<ResultCache> cache = makeCache(inputDims);
+    std::vector<ResultCache::Scratch> scratches(pool.getSlotCount());
+    int blockSize = pool.getSlotCount() * BATCH_TASKS_PER_THREAD * BATCH_CHUNK;
+    std::vector<StreamBlock> blocks(STREAM_BLOCKS);
+    // one extra slot for the nullptr that ends the stream.
+    SpscQueue<StreamBlock *> freeBlocks(STREAM_BLOCKS + 1);
+    SpscQueue<StreamBlock *> readBlocks(STREAM_BLOCKS + 1);
+    SpscQueue<StreamBlock *> decodedBlocks(STREAM_BLOCKS + 1);
+    SpscQueue<StreamBlock *> classifiedBlocks(STREAM_BLOCKS + 1);
+    for (StreamBlock &block : blocks)
+    {
+        block.buffer.resize((size_t) blockSize * imgSize);
+        block.images.resize(blockSize);
+        block.results.resize(blockSize);
+        block.out.reserve((size_t) blockSize * STREAM_CSV_LINE_MAX);
+        freeBlocks.push(&block);
+    }
+    if (!binary)
+    {
+        std::cout << STREAM_CSV_HEADER << '\n';
+    }
+
+    std::thread reader([&]()
+    {
+        long index = 0;
+        StreamBlock *block = freeBlocks.pop();
+        while ((block->count = stream.next(blockSize, block->buffer, block->records)) > 0)
+        {
+            block->index = index;
+            index += block->count;
+            readBlocks.push(block);
+            block = freeBlocks.pop();
+        }
+        readBlocks.push(nullptr);
+    });
+    std::thread decoder([&]()
+    {
+        StreamBlock *block;
+        while ((block = readBlocks.pop()) != nullptr)
+        {
+            if (block->records != block->buffer.data())
+            {
+                std::memcpy(block->buffer.data(), block->records,
+                            (size_t) block->count * imgSize * sizeof(float));
+                block->records = block->buffer.data();
+            }
+            for (int j = 0; j < block->count; j++)
+            {
+                block->images[j] = Matrix(imgSize, 1, block->records + (size_t) j * imgSize);
+            }
+            decodedBlocks.push(block);
+        }
+        decodedBlocks.push(nullptr);
+    });
+    std::thread formatter([&]()
+    {
+        StreamBlock *block;
+        while ((block = classifiedBlocks.pop()) != nullptr)
+        {
+            block->out.clear();
+            formatResults(block->results.data(), block->count, block->index, binary,
+                          block->out);
+            std::cout.write(block->out.data(), (std::streamsize) block->out.size());
+            freeBlocks.push(block);
+        }
+    });
+
+    StreamBlock *block;
+    while ((block = decodedBlocks.pop()) != nullptr)
+    {
+        pool.parallelFor(block->count, BATCH_CHUNK, [&](int begin, int end, int slot)
+        {
+            classifyCached(mlp, cache.get(), scratches[slot], block->images.data() + begin,
+                           end - begin, block->results.data() + begin, workspaces[slot]);
+        });
+        classifiedBlocks.push(block);
+    }
+    classifiedBlocks.push(nullptr);
+    reader.join();
+    decoder.join();
+    formatter.join();
+    std::cout.flush();
+    printCacheStats(cache.get());
+
+    if (stream.hasFailed())
+    {
+        std::cerr << ERROR_INVALID_STREAM << input << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    if (stream.getTrailingBytes() != 0)
+    {
+        std::cerr << ERROR_TRUNCATED_STREAM << stream.getTrailingBytes() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Server mode: serves the requests of any number of clients on a Unix domain socket, with the
+ * network loaded once (see InferenceServer for the protocol). Concurrent requests are
+ * batched by a BatchScheduler with the default limits (see defaultBatchMax and
+ * defaultBatchWait), and the batches are classified on the default pool, like batch mode.
+ * With a makeCache() cache, the images seen before are answered without joining a batch.
+ * Exits (code == 1) if the socket can't be created.
+ * @param mlp MlpNetwork or QuantizedNetwork to use in order to predict the images.
+ * @param path socket file path
+ * @param inputDims dims of the images
+ */
+template <typename Network>
+void mlpServe(const Network &mlp, const std::string &path, MatrixDims inputDims)
+{
+    ThreadPool &pool = defaultPool();
+    std::vector<Workspace> workspaces(pool.getSlotCount(), mlp.makeWorkspace(BATCH_CHUNK));
+    BatchScheduler scheduler([&](const Matrix images[], int count, Digit results[])
+    {
+        pool.parallelFor(count, BATCH_CHUNK, [&](int begin, int end, int slot)
+        {
+            mlp.classifyBatch(images + begin, end - begin, results + begin, workspaces[slot]);
+        });
+    }, defaultBatchMax(), defaultBatchWait());
+    std::unique_ptr<ResultCache> cache = makeCache(inputDims);
+    InferenceServer server(path, inputDims.rows * inputDims.cols, scheduler, cache.get());
+    if (!server.run())
+    {
+        std::cerr << ERROR_SERVER_SOCKET << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    printCacheStats(cache.get());
+}
+
+/**
+ * Loads the exit head of a CascadeNetwork: a packed model file of a single layer.
+ * Exits (code == 1) upon failures.
+ * @param path head file path.
+ * @param head model object to load.
+ */
+void loadHead(const std::string &path, ModelFile &head)
+{
+    if (!head.load(path) || head.getLayerCount() != 1)
+    {
+        std::cerr << ERROR_INVALID_HEAD << path << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+/**
+ * Runs the mode selected on the command line.
+ * @param mlp MlpNetwork or QuantizedNetwork to use in order to predict the images.
+ * @param mode mode flag, or nullptr for the interactive mlpCli
+ * @param input the mode's input
+ * @param inputDims dims of the images
+ */
+template <typename Network>
+void runMode(const Network &mlp, const char *mode, const char *input, MatrixDims inputDims)
+{
+    if (mode == nullptr)
+    {
+        mlpCli(mlp, inputDims);
+    }
+    else if (std::strcmp(mode, BATCH_FLAG) == 0)
+    {
+        mlpBatch(mlp, input, inputDims);
+    }
+    else if (std::strcmp(mode, SERVE_FLAG) == 0)
+    {
+        mlpServe(mlp, input, inputDims);
+    }
+    else
+    {
+        mlpStream(mlp, input, std::strcmp(mode, STREAM_BINARY_FLAG) == 0, inputDims);
+    }
+}
+
 /**
  * Program's main
  * @param argc count of args
@@ -152,19 +643,88 @@ void mlpCli(MlpNetwork &mlp)
  */
 int main(int argc, char **argv)
 {
-    if(argc != ARGS_COUNT)
+    const char *mode = nullptr;
+    const char *modeInput = nullptr;
+    if (argc > MODE_ARGS && (std::strcmp(argv[ARGS_START_IDX], BATCH_FLAG) == 0 ||
+                             std::strcmp(argv[ARGS_START_IDX], STREAM_FLAG) == 0 ||
+                             std::strcmp(argv[ARGS_START_IDX], STREAM_BINARY_FLAG) == 0 ||
+                             std::strcmp(argv[ARGS_START_IDX], SERVE_FLAG) == 0))
+    {
+        mode = argv[ARGS_START_IDX];
+        modeInput = argv[ARGS_START_IDX + 1];
+        argc -= MODE_ARGS;
+        argv += MODE_ARGS;
+    }
+
+    if(argc != ARGS_COUNT && argc != MODEL_ARGS_COUNT && argc != CALIBRATED_ARGS_COUNT &&
+       argc != CALIBRATED_MODEL_ARGS_COUNT)
     {
         usage();
         exit(EXIT_FAILURE);
     }
 
+    MappedFile paramFiles[2 * MLP_SIZE];
+    ModelFile model;
     Matrix weights[MLP_SIZE];
     Matrix biases[MLP_SIZE];
-    loadParameters(argv, weights, biases);
+    MatrixDims inputDims = imgDims;
+    bool modelForm = argc == MODEL_ARGS_COUNT || argc == CALIBRATED_MODEL_ARGS_COUNT;
+    if (modelForm)
+    {
+        loadModel(argv[MODEL_PATH_IDX], model);
+        inputDims = model.getInputDims();
+    }
+    else
+    {
+        loadParameters(argv, paramFiles, weights, biases);
+    }
+    MlpNetwork mlp = modelForm ? MlpNetwork(model) : MlpNetwork(weights, biases);
+
+    const char *headPath = std::getenv(EXIT_HEAD_ENV_VAR);
+    if (argc == CALIBRATED_ARGS_COUNT || argc == CALIBRATED_MODEL_ARGS_COUNT)
+    {
+        if (headPath != nullptr)
+        {
+            std::cerr << ERROR_HEAD_CALIBRATION << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        const char *path = argv[modelForm ? MODEL_ARGS_COUNT : ARGS_COUNT];
+        std::vector<float> ranges(mlp.getLayerCount());
+        if (!readCalibration(path, ranges.data(), mlp.getLayerCount()))
+        {
+            std::cerr << ERROR_INVALID_CALIBRATION << path << std::endl;
+            exit(EXIT_FAILURE);
+        }
+        QuantizedNetwork quantized(mlp, ranges.data());
+        runMode(quantized, mode, modeInput, inputDims);
+        return EXIT_SUCCESS;
+    }
 
-    MlpNetwork mlp(weights, biases);
+    if (headPath != nullptr)
+    {
+        // the cascade runs the network's layers one range at a time, on MlpNetwork.
+        ModelFile headModel;
+        loadHead(headPath, headModel);
+        Dense head(headModel.getWeights(0), headModel.getBias(0), headModel.getActivation(0));
+        CascadeNetwork cascade(mlp, head, headModel.getInputLayer(), defaultExitThreshold());
+        runMode(cascade, mode, modeInput, inputDims);
+        std::cerr << CASCADE_STATS_MSG << cascade.getExitCount() << ", "
+                  << cascade.getImageCount() << std::endl;
+        return EXIT_SUCCESS;
+    }
+
+    if (mode == nullptr && DefaultStaticMlp::matches(mlp) && !mlp.hasPrunedLayers())
+    {
+        // the interactive cli classifies one image at a time, on the network compiled for the
+        // exact shapes of the default topology, unless it was pruned: the fixed-shape layers
+        // are dense. The other modes batch their images, which only MlpNetwork's gemm does,
+        // and read the weights of a mapped model in place.
+        std::unique_ptr<DefaultStaticMlp> fixed(new DefaultStaticMlp(mlp));
+        mlpCli(*fixed, inputDims);
+        return EXIT_SUCCESS;
+    }
 
-    mlpCli(mlp);
+    runMode(mlp, mode, modeInput, inputDims);
 
 
     return EXIT_SUCCESS;